@@ -0,0 +1,621 @@
+#include "Chip8.hpp"
+#include "PixelKernels.hpp"
+#include "PostProcess.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Microbenchmarks for the interpreter core; no window, no SDL.
+// The SIMD pixel kernels are first checked against the scalar ones, and the post-processor against
+// ScaleVideoLuma; a mismatch fails the run.
+// Results go to stdout (or --out) as JSON so runs can be compared across commits:
+//   chip8-bench [--out <file>] [--filter <substring>] [--min-time <ms>] [--games <dir>]
+
+const unsigned int BENCH_CYCLES = 10000;  // instructions per timed call
+const unsigned int BODY_COPIES = 200;     // unrolled copies of the measured instruction before the loop jump
+const unsigned int FRAME_CYCLES = 16;     // instructions per frame at the 1 ms cycle delay
+const unsigned int EXPAND_BATCH = 16;     // expansions per timed call
+const unsigned int VERIFY_FRAMES = 200;   // random frames each kernel variant is checked on
+const unsigned int MAX_VERIFY_SCALE = 20; // ScaleVideoLuma is checked at every scale up to this
+const unsigned int ROW_VERIFY_SCALES[] = {33, 60, 64, 100, POST_MAX_SCALE}; // and the scaleRow kernels at these too
+const unsigned int POST_4K_SCALE = 60;    // 3840x1920
+
+struct BenchResult
+{
+    std::string group;
+    std::string name;
+    const char *unit;
+    double nsPerOp;
+    double opsPerSec;
+    uint64_t ops;
+};
+
+struct BenchOptions
+{
+    const char *out = nullptr;
+    std::string filter;
+    double minTimeMs = 200.0;
+    std::string games = "games";
+};
+
+static BenchOptions options;
+static std::vector<BenchResult> results;
+
+// Runs body (opsPerCall operations each) once untimed, then repeatedly until minTimeMs has passed
+template <typename Body>
+static void Measure(const char *group, const std::string &name, const char *unit, uint64_t opsPerCall, Body body)
+{
+    std::string id = std::string(group) + "/" + name;
+    if (!options.filter.empty() && id.find(options.filter) == std::string::npos)
+    {
+        return;
+    }
+    body();
+    uint64_t calls = 0;
+    double elapsedNs;
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        body();
+        calls++;
+        elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsedNs < options.minTimeMs * 1e6);
+
+    uint64_t ops = calls * opsPerCall;
+    results.push_back({group, name, unit, elapsedNs / ops, ops / (elapsedNs / 1e9), ops});
+    fprintf(stderr, "%-24s %10.2f ns/%s\n", id.c_str(), elapsedNs / ops, unit);
+}
+
+static std::vector<uint8_t> Bytes(const std::vector<uint16_t> &words)
+{
+    std::vector<uint8_t> bytes;
+    for (uint16_t word : words)
+    {
+        bytes.push_back(static_cast<uint8_t>(word >> 8));
+        bytes.push_back(static_cast<uint8_t>(word));
+    }
+    return bytes;
+}
+
+// prologue once, then body unrolled and looped so the jump back is a small share of the instructions run
+static std::vector<uint8_t> Loop(const std::vector<uint16_t> &prologue, const std::vector<uint16_t> &body)
+{
+    std::vector<uint16_t> words = prologue;
+    uint16_t bodyStart = static_cast<uint16_t>(START_ADDRESS + 2 * prologue.size());
+    for (unsigned int i = 0; i < BODY_COPIES; ++i)
+    {
+        words.insert(words.end(), body.begin(), body.end());
+    }
+    words.push_back(0x1000u | bodyStart);
+    return Bytes(words);
+}
+
+static void BenchProgram(const char *group, const std::string &name, const std::vector<uint8_t> &program, uint16_t keys = 0)
+{
+    Chip8 chip8;
+    chip8.Seed(1);
+    chip8.LoadProgram(program.data(), program.size());
+    chip8.setKeypadMask(keys);
+    Measure(group, name, "instruction", BENCH_CYCLES, [&] { chip8.RunFrame(BENCH_CYCLES); });
+}
+
+static void BenchOpcodes()
+{
+    // Every program keeps branches not taken so execution never runs off the unrolled body
+    const std::vector<uint16_t> setup{0x6005, 0x6103};
+    const std::vector<uint16_t> scratch{0xAE00};
+    BenchProgram("opcode", "00E0", Loop({}, {0x00E0}));
+    BenchProgram("opcode", "2nnn+00EE", Bytes({0x2204, 0x1200, 0x00EE}));
+    BenchProgram("opcode", "1nnn", Bytes({0x1200}));
+    BenchProgram("opcode", "3xkk", Loop({}, {0x3001}));
+    BenchProgram("opcode", "4xkk", Loop({}, {0x4000}));
+    BenchProgram("opcode", "5xy0", Loop(setup, {0x5010}));
+    BenchProgram("opcode", "6xkk", Loop({}, {0x6012}));
+    BenchProgram("opcode", "7xkk", Loop({}, {0x7001}));
+    BenchProgram("opcode", "8xy0", Loop(setup, {0x8010}));
+    BenchProgram("opcode", "8xy1", Loop(setup, {0x8011}));
+    BenchProgram("opcode", "8xy2", Loop(setup, {0x8012}));
+    BenchProgram("opcode", "8xy3", Loop(setup, {0x8013}));
+    BenchProgram("opcode", "8xy4", Loop(setup, {0x8014}));
+    BenchProgram("opcode", "8xy5", Loop(setup, {0x8015}));
+    BenchProgram("opcode", "8xy6", Loop(setup, {0x8016}));
+    BenchProgram("opcode", "8xy7", Loop(setup, {0x8017}));
+    BenchProgram("opcode", "8xyE", Loop(setup, {0x801E}));
+    BenchProgram("opcode", "9xy0", Loop({}, {0x9010}));
+    BenchProgram("opcode", "Annn", Loop({}, {0xA300}));
+    BenchProgram("opcode", "Bnnn", Bytes({0xB200}));
+    BenchProgram("opcode", "Cxkk", Loop({}, {0xC0FF}));
+    BenchProgram("opcode", "Ex9E", Loop({}, {0xE09E}));
+    BenchProgram("opcode", "ExA1", Loop({}, {0xE0A1}), 0x0001);
+    BenchProgram("opcode", "Fx07", Loop({}, {0xF007}));
+    BenchProgram("opcode", "Fx0A", Bytes({0xF00A}));
+    BenchProgram("opcode", "Fx15", Loop({}, {0xF015}));
+    BenchProgram("opcode", "Fx18", Loop({}, {0xF018}));
+    BenchProgram("opcode", "Fx1E", Loop({}, {0xF01E}));
+    BenchProgram("opcode", "Fx29", Loop({}, {0xF029}));
+    BenchProgram("opcode", "Fx33", Loop(scratch, {0xF033}));
+    BenchProgram("opcode", "Fx55", Loop(scratch, {0xFF55}));
+    BenchProgram("opcode", "Fx65", Loop(scratch, {0xFF65}));
+}
+
+static void BenchDispatch()
+{
+    // The cheapest handler reached through each table; unassigned entries fall through to OP_NULL
+    BenchProgram("dispatch", "table", Loop({}, {0x6000}));
+    BenchProgram("dispatch", "table0", Loop({}, {0x0001}));
+    BenchProgram("dispatch", "table8", Loop({}, {0x8008}));
+    BenchProgram("dispatch", "tableE", Loop({}, {0xE000}));
+    BenchProgram("dispatch", "tableF", Loop({}, {0xF000}));
+}
+
+static void BenchDraw()
+{
+    struct Position
+    {
+        const char *name;
+        uint8_t x, y;
+    };
+    // byte-aligned, unaligned, and clipped at the right and bottom edges
+    const Position positions[] = {{"x0y0", 0, 0}, {"x3y4", 3, 4}, {"x60y28", 60, 28}};
+    for (unsigned int height : {1u, 5u, 8u, 15u})
+    {
+        for (const Position &position : positions)
+        {
+            std::vector<uint16_t> prologue{static_cast<uint16_t>(0x6000u | position.x),
+                                           static_cast<uint16_t>(0x6100u | position.y), 0xA050};
+            BenchProgram("Dxyn", "h" + std::to_string(height) + "_" + position.name,
+                         Loop(prologue, {static_cast<uint16_t>(0xD010u | height)}));
+        }
+    }
+}
+
+static void BenchVideo()
+{
+    uint64_t rows[VIDEO_HEIGHT];
+    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+    struct Pattern
+    {
+        const char *name;
+        uint64_t even, odd;
+    };
+    for (const Pattern &pattern : {Pattern{"expand_blank", 0, 0},
+                                   Pattern{"expand_checker", 0xAAAAAAAAAAAAAAAAull, 0x5555555555555555ull},
+                                   Pattern{"expand_full", ~0ull, ~0ull}})
+    {
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+        {
+            rows[y] = y & 1 ? pattern.odd : pattern.even;
+        }
+        Measure("video", pattern.name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                ExpandVideo(rows, pixels);
+            }
+        });
+    }
+}
+
+static uint64_t NextRandom(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Random frames: dense noise, sparse noise, or a few set rows, plus the all-off and all-on frames
+static void RandomFrame(uint64_t &state, unsigned int frame, uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint64_t bits = NextRandom(state);
+        switch (frame % 5)
+        {
+        case 0: rows[y] = 0; break;
+        case 1: rows[y] = ~0ull; break;
+        case 2: rows[y] = bits; break;
+        case 3: rows[y] = bits & NextRandom(state) & NextRandom(state); break;
+        default: rows[y] = y % 7 == 0 ? bits : 0; break;
+        }
+    }
+}
+
+// Every kernel variant this CPU can run must give exactly what the scalar reference gives
+static bool VerifyKernels()
+{
+    const PixelKernels *reference = GetPixelKernels(CPU_SCALAR);
+    std::vector<uint8_t> expectedLuma(VIDEO_WIDTH * VIDEO_HEIGHT * MAX_VERIFY_SCALE * MAX_VERIFY_SCALE);
+    std::vector<uint8_t> actualLuma(expectedLuma.size());
+    bool ok = true;
+    for (int level = CPU_SCALAR + 1; level < CPU_LEVEL_COUNT; ++level)
+    {
+        const PixelKernels *kernels = GetPixelKernels(static_cast<CpuLevel>(level));
+        if (!kernels)
+        {
+            continue;
+        }
+        const char *name = CpuLevelName(kernels->level);
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        unsigned int failures = 0;
+        auto check = [&](bool same, const char *kernel, unsigned int frame, const std::string &detail) {
+            if (!same && failures++ < 10)
+            {
+                fprintf(stderr, "%s %s differs from scalar on frame %u%s\n", name, kernel, frame, detail.c_str());
+            }
+        };
+        for (unsigned int frame = 0; frame < VERIFY_FRAMES; ++frame)
+        {
+            uint64_t rows[VIDEO_HEIGHT], expected[VIDEO_HEIGHT], actual[VIDEO_HEIGHT];
+            RandomFrame(state, frame, rows);
+
+            memcpy(expected, rows, sizeof(rows));
+            memcpy(actual, rows, sizeof(rows));
+            reference->clearVideo(expected);
+            kernels->clearVideo(actual);
+            check(memcmp(expected, actual, sizeof(rows)) == 0, "clearVideo", frame, "");
+
+            // Every column, height and row, including sprites clipped at the right and bottom edges
+            uint8_t sprite[16];
+            for (uint8_t &byte : sprite)
+            {
+                byte = static_cast<uint8_t>(NextRandom(state));
+            }
+            for (unsigned int x = 0; x < VIDEO_WIDTH; ++x)
+            {
+                for (unsigned int height = 0; height <= 15; ++height)
+                {
+                    unsigned int y = static_cast<unsigned int>(NextRandom(state) % VIDEO_HEIGHT);
+                    unsigned int rowsDrawn = std::min(height, VIDEO_HEIGHT - y);
+                    memcpy(expected, rows, sizeof(rows));
+                    memcpy(actual, rows, sizeof(rows));
+                    bool expectedHit = reference->blitSprite(expected + y, sprite, rowsDrawn, x);
+                    bool actualHit = kernels->blitSprite(actual + y, sprite, rowsDrawn, x);
+                    check(expectedHit == actualHit && memcmp(expected, actual, sizeof(rows)) == 0, "blitSprite", frame,
+                          " at x " + std::to_string(x) + " y " + std::to_string(y) + " height " + std::to_string(height));
+                }
+            }
+
+            uint32_t expectedPixels[VIDEO_WIDTH * VIDEO_HEIGHT], actualPixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+            reference->expandVideo(rows, expectedPixels);
+            kernels->expandVideo(rows, actualPixels);
+            check(memcmp(expectedPixels, actualPixels, sizeof(expectedPixels)) == 0, "expandVideo", frame, "");
+
+            for (unsigned int scale = 1; scale <= MAX_VERIFY_SCALE; ++scale)
+            {
+                size_t size = VIDEO_WIDTH * VIDEO_HEIGHT * scale * scale;
+                reference->scaleVideoLuma(rows, scale, expectedLuma.data());
+                kernels->scaleVideoLuma(rows, scale, actualLuma.data());
+                check(memcmp(expectedLuma.data(), actualLuma.data(), size) == 0, "scaleVideoLuma", frame,
+                      " at scale " + std::to_string(scale));
+            }
+
+            check(reference->hashFrame(rows) == kernels->hashFrame(rows), "hashFrame", frame, "");
+
+            // Fading from random levels, the ones at the floor included, by every kind of keep
+            uint8_t keep = static_cast<uint8_t>(frame % 4 == 0 ? 0 : NextRandom(state));
+            uint8_t expectedLevels[VIDEO_WIDTH * VIDEO_HEIGHT], actualLevels[VIDEO_WIDTH * VIDEO_HEIGHT];
+            for (uint8_t &level : expectedLevels)
+            {
+                level = static_cast<uint8_t>(NextRandom(state) >> (frame % 8));
+            }
+            memcpy(actualLevels, expectedLevels, sizeof(expectedLevels));
+            reference->fadeLevels(rows, keep, expectedLevels);
+            kernels->fadeLevels(rows, keep, actualLevels);
+            check(memcmp(expectedLevels, actualLevels, sizeof(expectedLevels)) == 0, "fadeLevels", frame,
+                  " keeping " + std::to_string(keep));
+
+            std::vector<unsigned int> rowScales(std::begin(ROW_VERIFY_SCALES), std::end(ROW_VERIFY_SCALES));
+            for (unsigned int scale = 1; scale <= MAX_VERIFY_SCALE; ++scale)
+            {
+                rowScales.push_back(scale);
+            }
+            uint32_t palette[256];
+            for (uint32_t &colour : palette)
+            {
+                colour = static_cast<uint32_t>(NextRandom(state));
+            }
+            const uint8_t *levelRow = expectedLevels + frame % VIDEO_HEIGHT * VIDEO_WIDTH;
+            for (unsigned int scale : rowScales)
+            {
+                size_t bytes = VIDEO_WIDTH * scale * sizeof(uint32_t);
+                reference->scaleRowLuma(levelRow, scale, expectedLuma.data());
+                kernels->scaleRowLuma(levelRow, scale, actualLuma.data());
+                check(memcmp(expectedLuma.data(), actualLuma.data(), VIDEO_WIDTH * scale) == 0, "scaleRowLuma", frame,
+                      " at scale " + std::to_string(scale));
+                reference->scaleRowRgba(levelRow, palette, scale, reinterpret_cast<uint32_t *>(expectedLuma.data()));
+                kernels->scaleRowRgba(levelRow, palette, scale, reinterpret_cast<uint32_t *>(actualLuma.data()));
+                check(memcmp(expectedLuma.data(), actualLuma.data(), bytes) == 0, "scaleRowRgba", frame,
+                      " at scale " + std::to_string(scale));
+            }
+        }
+        if (failures)
+        {
+            fprintf(stderr, "%s kernels: %u mismatches\n", name, failures);
+            ok = false;
+        }
+        else
+        {
+            fprintf(stderr, "%s kernels match scalar\n", name);
+        }
+    }
+    return ok;
+}
+
+// With no effects the post-processor must draw exactly what ScaleVideoLuma does, and with them its workers
+// exactly what one thread draws
+static bool VerifyPostProcess()
+{
+    const unsigned int scale = 12; // 384 rows: enough for the workers to be woken
+    PostOptions plain;
+    plain.scale = scale;
+    plain.threads = 3;
+    PostOptions effects = plain;
+    effects.phosphor = 70;
+    effects.scanlines = true;
+    effects.scanlineLevel = 40;
+    PostOptions single = effects;
+    single.threads = 1;
+    PostProcessor plainPost, threadedPost, singlePost;
+    if (!plainPost.Open(plain, POST_LUMA) || !threadedPost.Open(effects, POST_RGBA) || !singlePost.Open(single, POST_RGBA))
+    {
+        fprintf(stderr, "post-processor did not open\n");
+        return false;
+    }
+    std::vector<uint8_t> luma(VIDEO_WIDTH * VIDEO_HEIGHT * scale * scale);
+    size_t rgbaRow = VIDEO_WIDTH * scale * sizeof(uint32_t);
+    uint64_t state = 0xD1B54A32D192ED03ull;
+    unsigned int failures = 0;
+    for (unsigned int frame = 0; frame < VERIFY_FRAMES; ++frame)
+    {
+        uint64_t rows[VIDEO_HEIGHT];
+        RandomFrame(state, frame / 3, rows); // each frame three times, so phosphor fades between changes
+        plainPost.Process(rows);
+        threadedPost.Process(rows);
+        singlePost.Process(rows);
+        ScaleVideoLuma(rows, scale, luma.data());
+        for (unsigned int y = 0; y < plainPost.getHeight(); ++y)
+        {
+            const uint8_t *plainRow = plainPost.getPixels() + y * plainPost.getPitch();
+            const uint8_t *threadedRow = threadedPost.getPixels() + y * threadedPost.getPitch();
+            const uint8_t *singleRow = singlePost.getPixels() + y * singlePost.getPitch();
+            if ((memcmp(plainRow, luma.data() + y * VIDEO_WIDTH * scale, VIDEO_WIDTH * scale) != 0 ||
+                 memcmp(threadedRow, singleRow, rgbaRow) != 0) &&
+                failures++ < 10)
+            {
+                fprintf(stderr, "post-processing differs on frame %u row %u\n", frame, y);
+            }
+        }
+    }
+    if (failures)
+    {
+        fprintf(stderr, "post-processing: %u mismatches\n", failures);
+        return false;
+    }
+    fprintf(stderr, "post-processing matches ScaleVideoLuma and one thread\n");
+    return true;
+}
+
+// Each kernel in every variant this CPU can run; the video and frame groups use the one selected at startup
+static void BenchKernels()
+{
+    uint64_t checker[VIDEO_HEIGHT];
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        checker[y] = y & 1 ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull;
+    }
+    const uint8_t sprite[16] = {0xF0, 0x90, 0x90, 0x90, 0xF0, 0x20, 0x60, 0x20, 0x20, 0x70, 0xF0, 0x10, 0xF0, 0x80, 0xF0};
+    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+    std::vector<uint8_t> luma(VIDEO_WIDTH * VIDEO_HEIGHT * 16);
+    for (int level = CPU_SCALAR; level < CPU_LEVEL_COUNT; ++level)
+    {
+        const PixelKernels *kernels = GetPixelKernels(static_cast<CpuLevel>(level));
+        if (!kernels)
+        {
+            continue;
+        }
+        std::string name = CpuLevelName(kernels->level);
+        uint64_t rows[VIDEO_HEIGHT];
+        memcpy(rows, checker, sizeof(rows));
+        Measure("kernels", "clear_" + name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->clearVideo(rows);
+            }
+        });
+        memcpy(rows, checker, sizeof(rows));
+        Measure("kernels", "blit_h15_x3_" + name, "sprite", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->blitSprite(rows + 4, sprite, 15, 3);
+            }
+        });
+        Measure("kernels", "expand_" + name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->expandVideo(checker, pixels);
+            }
+        });
+        Measure("kernels", "scale4_" + name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->scaleVideoLuma(checker, 4, luma.data());
+            }
+        });
+        uint8_t levels[VIDEO_WIDTH * VIDEO_HEIGHT] = {};
+        Measure("kernels", "fade_" + name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->fadeLevels(i & 1 ? checker : rows, 160, levels);
+            }
+        });
+        Measure("kernels", "row60_" + name, "row", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                kernels->scaleRowLuma(levels, POST_4K_SCALE, luma.data());
+            }
+        });
+        uint64_t hash = 0;
+        Measure("kernels", "hash_" + name, "frame", EXPAND_BATCH, [&] {
+            for (unsigned int i = 0; i < EXPAND_BATCH; ++i)
+            {
+                hash += kernels->hashFrame(checker);
+            }
+        });
+    }
+}
+
+// A 4K display with every effect on, redrawn completely each frame; on one thread and on every core
+static void BenchPost()
+{
+    uint64_t frames[2][VIDEO_HEIGHT];
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    RandomFrame(state, 2, frames[0]);
+    RandomFrame(state, 2, frames[1]);
+    std::vector<unsigned int> threadCounts = {1};
+    if (std::thread::hardware_concurrency() > 1)
+    {
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (PostFormat format : {POST_LUMA, POST_RGBA})
+    {
+        for (unsigned int threads : threadCounts)
+        {
+            PostOptions options;
+            options.scale = POST_4K_SCALE;
+            options.phosphor = 60;
+            options.scanlines = true;
+            options.threads = threads;
+            PostProcessor post;
+            post.Open(options, format);
+            unsigned int frame = 0;
+            std::string name = std::string("4k_") + (format == POST_LUMA ? "luma_" : "rgba_") + std::to_string(threads) + "t";
+            Measure("post", name, "frame", 1, [&] { post.Process(frames[frame++ & 1]); });
+        }
+    }
+}
+
+static void BenchGame(const char *rom)
+{
+    Chip8 chip8;
+    std::string path = options.games + "/" + rom;
+    if (!chip8.LoadROM(path.c_str()))
+    {
+        fprintf(stderr, "skipping %s: could not load\n", path.c_str());
+        return;
+    }
+    chip8.Seed(1);
+    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+    uint32_t input = 0x12345678u;
+    uint32_t frame = 0;
+    // Scripted input so the game keeps moving; the whole per-frame core path: keypad, instructions, expansion
+    Measure("frame", rom, "frame", 1, [&] {
+        if (frame++ % 8 == 0)
+        {
+            input ^= input << 13;
+            input ^= input >> 17;
+            input ^= input << 5;
+            chip8.setKeypadMask(static_cast<uint16_t>(input));
+        }
+        chip8.RunFrame(FRAME_CYCLES);
+        ExpandVideo(chip8.video, pixels);
+    });
+}
+
+static void WriteJson(FILE *file)
+{
+#ifdef __OPTIMIZE__
+    const char *optimized = "true";
+#else
+    const char *optimized = "false";
+#endif
+    fprintf(file, "{\n  \"bench\": \"chip8\",\n  \"compiler\": \"%s\",\n  \"optimized\": %s,\n", __VERSION__, optimized);
+    fprintf(file, "  \"pixel_kernels\": \"%s\",\n", CpuLevelName(pixelKernels->level));
+    fprintf(file, "  \"min_time_ms\": %.0f,\n  \"results\": [\n", options.minTimeMs);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult &result = results[i];
+        fprintf(file,
+                "    {\"group\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", \"ns_per_op\": %.3f, "
+                "\"ops_per_sec\": %.0f, \"ops\": %llu}%s\n",
+                result.group.c_str(), result.name.c_str(), result.unit, result.nsPerOp, result.opsPerSec,
+                static_cast<unsigned long long>(result.ops), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue)
+        {
+            options.out = argv[++i];
+        }
+        else if (arg == "--filter" && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--min-time" && hasValue)
+        {
+            options.minTimeMs = std::stod(argv[++i]);
+        }
+        else if (arg == "--games" && hasValue)
+        {
+            options.games = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--out <file>] [--filter <substring>] [--min-time <ms>] [--games <dir>]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+#ifndef __OPTIMIZE__
+    // Unoptimized, the SIMD kernels run slower than the scalar ones and every comparison is meaningless
+    fprintf(stderr, "**************************************************************\n"
+                    "WARNING: chip8-bench was built without optimisation (-O0).\n"
+                    "Timings do not reflect a release build; use 'make bench'.\n"
+                    "**************************************************************\n");
+#endif
+    if (!VerifyKernels() || !VerifyPostProcess())
+    {
+        return 1;
+    }
+    BenchOpcodes();
+    BenchDispatch();
+    BenchDraw();
+    BenchVideo();
+    BenchKernels();
+    BenchPost();
+    BenchGame("Pong.ch8");
+    BenchGame("Tetris.ch8");
+
+#ifndef __OPTIMIZE__
+    if (options.out)
+    {
+        fprintf(stderr, "Not writing %s: results from an unoptimized build would be mistaken for real ones\n",
+                options.out);
+        return 1;
+    }
+#endif
+    FILE *file = options.out ? fopen(options.out, "w") : stdout;
+    if (!file)
+    {
+        fprintf(stderr, "Could not create %s\n", options.out);
+        return 1;
+    }
+    WriteJson(file);
+    if (options.out)
+    {
+        fclose(file);
+    }
+    return 0;
+}
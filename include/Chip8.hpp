@@ -24,16 +24,89 @@ const unsigned int FONTSET_START_ADDRESS = 0x50;
 const uint16_t START_ADDRESS{0x200};
 const uint8_t FONT_SIZE{80};
 
+class ExecTraceWriter;
+class FlightRecorder;
+
+// Guest behaviour CHIP-8 leaves undefined, plus the limits a batch run puts on a ROM. Faults never stop
+// the machine by themselves: the offending call or return is skipped, out-of-range addresses wrap at
+// 4 KB and out-of-range keys read as not pressed. RunFrame reports them and the caller decides.
+enum GuestFault : uint8_t
+{
+    FAULT_NONE,
+    FAULT_INVALID_OPCODE,  // no instruction has this encoding (OP_NULL)
+    FAULT_STACK_OVERFLOW,  // 2nnn with all 16 levels in use
+    FAULT_STACK_UNDERFLOW, // 00EE with an empty stack
+    FAULT_MEMORY_BOUNDS,   // fetch, Dxyn, Fx33, Fx55 or Fx65 past the end of memory
+    FAULT_INVALID_KEY,     // Ex9E/ExA1 with Vx above F
+    FAULT_PC_RANGE,        // instruction fetched from outside setPCRange
+    FAULT_STALLED,         // raised by Watchdog: the display stopped changing
+    FAULT_COUNT
+};
+
+const char *GuestFaultName(GuestFault fault);
+
+// Everything that determines how the machine continues; plain data so it can be copied and saved as-is
+struct Chip8State
+{
+    uint8_t memory[MEMORY_SIZE];
+    uint8_t registers[REGISTER_COUNT];
+    uint16_t stack[STACK_LEVELS];
+    uint16_t index;
+    uint16_t PC;
+    uint8_t SP;
+    uint16_t opcode;
+    uint8_t sound_timer;
+    uint8_t delay_timer;
+    uint8_t keypad[16];
+    uint64_t video[VIDEO_HEIGHT];
+    uint32_t rngState;
+};
+
+// What a rewind puts back besides Chip8State: the latched fault, the flags the caller reads and clears, and
+// the flight recorder's position. Kept out of Chip8State, which movies store.
+struct Chip8Latches
+{
+    GuestFault fault;
+    uint16_t faultPC;
+    uint16_t keypadPolled;
+    uint16_t polledBeforeDraw;
+    bool videoChanged;
+    uint64_t recorderSteps;
+};
+
 class Chip8
 {
 public:
     Chip8();
     uint8_t getRandomByte();
-    void LoadROM(char const *filename);
+    bool LoadROM(char const *filename);
+    bool LoadProgram(const uint8_t *program, size_t size); // at START_ADDRESS; false if it does not fit
     void Cycle();
+    GuestFault RunFrame(unsigned int cycles); // runs every cycle; returns getFault() afterwards
+
+    void Seed(uint32_t seed);
+    void SaveState(Chip8State &state) const;
+    void LoadState(const Chip8State &state);
+    void SaveLatches(Chip8Latches &latches) const;
+    void LoadLatches(const Chip8Latches &latches);
+    void setKeypadMask(uint16_t mask);
+    uint16_t getKeypadMask() const;
+    uint64_t HashVideo() const;
+    static uint64_t HashState(const Chip8State &state);
+    void setExecTrace(ExecTraceWriter *writer); // records every executed instruction; null to stop
+    ExecTraceWriter *getExecTrace() const;
+    void setFlightRecorder(FlightRecorder *recorder); // dumped on the first guest fault
+    FlightRecorder *getFlightRecorder() const;
+    GuestFault getFault() const; // first fault since the last clearFault
+    uint16_t getFaultPC() const; // address of the instruction that faulted
+    void clearFault();
+    void setPCRange(uint16_t low, uint16_t high); // fetches outside [low, high] raise FAULT_PC_RANGE
 
     uint8_t keypad[16]{};
-    uint32_t video[64 * 32]{};
+    uint64_t video[VIDEO_HEIGHT]{}; // one bit per pixel, most significant bit is x = 0
+    uint16_t keypadPolled{}; // keys read by Ex9E/ExA1/Fx0A since the caller last cleared it
+    uint16_t polledBeforeDraw{}; // keys in keypadPolled when a later 00E0/Dxyn ran, cleared by the caller
+    bool videoChanged{};     // set by 00E0/Dxyn, cleared by the caller
 
     //GETTERS
     uint8_t * getRegisters();
@@ -46,6 +119,8 @@ public:
     uint8_t getDelayTimer();
     uint8_t *getMemory();
     std::string getInstruction();
+    uint32_t getSeed() const;
+    uint64_t getRomHash() const;
 
 private:
     uint8_t memory[MEMORY_SIZE]{};
@@ -57,7 +132,15 @@ private:
     uint16_t opcode{};
     uint8_t sound_timer{};
     uint8_t delay_timer{};
-    std::string instruction = "";
+    uint32_t seed{};
+    uint32_t rngState{};
+    uint64_t romHash{};
+    ExecTraceWriter *execTrace{};
+    FlightRecorder *flightRecorder{};
+    GuestFault fault{};
+    uint16_t faultPC{};
+    uint16_t pcLow{};
+    uint16_t pcSpan{MEMORY_SIZE - 2}; // high - low; one unsigned compare checks both ends
     const uint8_t font_data[FONT_SIZE] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -121,12 +204,30 @@ private:
 
     typedef void (Chip8::*Chip8Func)();
     Chip8Func table[0xF + 1];
-    Chip8Func table0[0xE + 1];
-    Chip8Func table8[0xE + 1];
-    Chip8Func tableE[0xE + 1];
-    Chip8Func tableF[0x65 + 1];
+    Chip8Func table0[0xF + 1];
+    Chip8Func table8[0xF + 1];
+    Chip8Func tableE[0xF + 1];
+    Chip8Func tableF[0xFF + 1];
 
     void setup_table();
+    void Fault(GuestFault kind, uint16_t address); // address of the faulting instruction
+};
+
+// Runs frames that LoadState will throw away (run-ahead, rollback): while it lives neither the execution
+// trace nor the flight recorder sees them, and it puts the latches back as they were when it ends
+class SpeculativeRun
+{
+public:
+    explicit SpeculativeRun(Chip8 &chip8);
+    ~SpeculativeRun();
+    SpeculativeRun(const SpeculativeRun &) = delete;
+    SpeculativeRun &operator=(const SpeculativeRun &) = delete;
+
+private:
+    Chip8 &chip8;
+    ExecTraceWriter *execTrace;
+    FlightRecorder *flightRecorder;
+    Chip8Latches latches;
 };
 
 #endif // CHIP8_HPP
\ No newline at end of file
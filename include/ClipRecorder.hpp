@@ -0,0 +1,95 @@
+#ifndef CLIP_RECORDER_HPP
+#define CLIP_RECORDER_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const unsigned int CLIP_DEFAULT_SCALE = 4;
+const size_t CLIP_QUEUE_FRAMES = 256;  // about four seconds of frames waiting for the encoder
+const uint32_t CLIP_TICKS_PER_SECOND = 60; // one tick per emulated frame
+
+enum ClipFormat
+{
+    CLIP_GIF,
+    CLIP_APNG
+};
+
+// Records the interactive session as an animated GIF or APNG. Submit copies the 256-byte bit-packed
+// frame into a queue and never waits; a full queue drops the frame, which only lengthens the one before.
+// The worker writes a frame only when the display changes, as the rectangle that changed, with a
+// two-colour palette. GIF delays are whole centiseconds of at least 2, so frames shown for a single
+// tick are merged into the next one; this also hides most of CHIP-8's sprite flicker.
+class ClipRecorder
+{
+public:
+    ~ClipRecorder();
+    void setFormat(ClipFormat format);
+    void setScale(unsigned int scale);
+
+    bool Start(); // chip8-<date>-<time>.gif/.png in the working directory
+    bool Start(const std::string &filename);
+    void Stop();  // the worker finishes the file in the background
+    bool isRecording() const;
+    const std::string &getFilename() const;
+
+    void Submit(const uint64_t *video); // call once per emulated frame
+
+private:
+    struct QueuedFrame
+    {
+        uint64_t tick;
+        uint64_t video[VIDEO_HEIGHT];
+    };
+    struct Rect
+    {
+        unsigned int x, y, width, height;
+    };
+
+    void Join();
+    void WorkerLoop();
+    void Begin();
+    void Frame(const QueuedFrame &queued);
+    void Finish();
+    void WriteFrame(uint64_t durationTicks);
+    void WriteGifFrame(const Rect &rect, uint64_t durationTicks);
+    void WriteApngFrame(const Rect &rect, uint64_t durationTicks);
+    Rect ChangedRect() const;
+    void ScaleRect(const Rect &rect, std::vector<uint8_t> &indices) const;
+
+    ClipFormat format = CLIP_GIF;
+    unsigned int scale = CLIP_DEFAULT_SCALE;
+    std::string filename;
+    bool recording{};
+    uint64_t tick{};
+
+    // Worker state
+    FILE *file{};
+    uint64_t written[VIDEO_HEIGHT]{}; // what the file shows after the frames written so far
+    uint64_t pending[VIDEO_HEIGHT]{}; // latest frame, not written until its duration is known
+    uint64_t pendingTick{};
+    bool havePending{};
+    bool first{};
+    uint32_t frames{};
+    uint32_t sequence{};  // APNG chunk sequence number
+    long frameCountAt{};  // APNG acTL frame count, patched at the end
+    std::vector<uint8_t> indices;
+    std::vector<uint8_t> encoded;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<QueuedFrame> queue;
+    size_t head{};
+    size_t count{};
+    bool stopping{};
+    uint64_t dropped{};
+};
+
+#endif // CLIP_RECORDER_HPP
@@ -4,14 +4,173 @@
 #pragma once
 
 #include "Chip8.hpp"
+#include "ClipRecorder.hpp"
+#include "ExecTrace.hpp"
+#include "FlightRecorder.hpp"
+#include "FrameDumper.hpp"
+#include "FrameStream.hpp"
 #include "Graphics.hpp"
+#include "Movie.hpp"
+#include "Netplay.hpp"
+#include "PixelKernels.hpp"
+#include "Video.hpp"
+#include "Watchdog.hpp"
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <optional>
+
+const float FRAME_MS = 1000.0f / 60.0f; // guest time covered by one emulated frame
+const float MAX_BEHIND_MS = 100.0f;     // catch-up limit at 1x after a stall (e.g. window drag)
+const float MAX_PENDING_CYCLES = 1000.0f; // cap on the instruction budget carried from one frame to the next
+const float UNCAPPED_BATCH_MS = 4.0f;   // uncapped speed polls input at least this often
+const float BACKGROUND_PRESENT_MS = 100.0f; // --background-throttle: present at most this often without focus
+const uint32_t BENCH_DEFAULT_FRAMES = 3600; // one emulated minute
+const int EXIT_GUEST_FAULT = 3;             // a headless run stopped on a guest fault or the watchdog
+
+// Host time spent by --run-ahead, summed over all frames
+struct RunAheadStats
+{
+    uint64_t frames = 0;
+    double saveUs = 0.0;
+    double aheadUs = 0.0;
+    double restoreUs = 0.0;
+};
+
+// Host time spent by --bench in each part of the main loop
+enum BenchPhase
+{
+    BENCH_INPUT,   // ProcessInput
+    BENCH_EMULATE, // movie/netplay/recording and Chip8::RunFrame
+    BENCH_UPLOAD,  // run-ahead, Graphics::UpdateVideo
+    BENCH_PANELS,  // overlay and debug panels
+    BENCH_PRESENT, // Graphics::EndDraw
+    BENCH_PHASE_COUNT
+};
+
+struct BenchStats
+{
+    uint32_t frames = 0;
+    double wallNs = 0.0;
+    double cpuNs = 0.0;
+    double phaseNs[BENCH_PHASE_COUNT]{};
+};
+
+// The loader thread's side of startup: it reads the ROM and, for a plain session, runs the guest in real time
+// until the main thread has created the window and asks it to stop
+struct EarlyStart
+{
+    bool loaded = false;
+    double romLoadedMs = 0.0;        // since launch
+    double firstInstructionMs = 0.0; // since launch; 0 if no frame ran
+    uint32_t frames = 0;
+    uint64_t instructions = 0;
+    float pendingCycles = 0.0f; // handed to the main loop so it carries on where the loader stopped
+    float behindMs = 0.0f;
+    double windowMs = 0.0; // since launch, once the window and renderer exist
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+};
+
+// The command line, as parsed by emulate
+struct EmulatorOptions
+{
+    bool benchmark = false;
+    int cycleDelay = 1; // ms per instruction
+    uint32_t benchFrames = BENCH_DEFAULT_FRAMES;
+    char const *romFilename = nullptr;
+
+    // Logs, traces and dumps
+    char const *latencyLog = nullptr;
+    char const *traceFilename = nullptr;
+    char const *execTraceFilename = nullptr;
+    bool execTraceCompress = false;
+    char const *flightFilename = FLIGHT_RECORDER_DEFAULT_FILE;
+    char const *frameStreamFilename = nullptr;
+    char const *metricsFilename = nullptr;
+    uint16_t pcLow = 0;
+    uint16_t pcHigh = MEMORY_SIZE - 2;
+    uint32_t watchdogFrames = 0;
+    FrameDumpOptions pngOptions; // format set to DUMP_PNG by the parser
+    FrameDumpOptions y4mOptions; // format set to DUMP_Y4M by the parser
+    ClipFormat clipFormat = CLIP_GIF;
+    unsigned int clipScale = CLIP_DEFAULT_SCALE;
+    CpuLevel cpuLevel = CPU_LEVEL_COUNT; // CPU_LEVEL_COUNT keeps the detected kernels
+
+    // Movies
+    char const *recordFilename = nullptr;
+    char const *playFilename = nullptr;
+    uint32_t keyframeInterval = MOVIE_DEFAULT_KEYFRAME_INTERVAL;
+    uint32_t seekFrame = 0;
+    bool seeded = false;
+    uint32_t seed = 0;
+
+    // Frontends
+    bool headless = false;
+    bool terminal = false;
+    unsigned int wallInstances = 0;
+    unsigned int wallThreads = 0;
+    PostOptions postOptions;
+    bool postProcess = false;
+    RenderBackend renderBackend = RENDER_SDL;
+    PresentMode presentMode = PRESENT_VSYNC;
+
+    // Netplay
+    uint16_t netplayPort = 0;
+    std::string netplayPeer;
+    int player = 1;
+    NetConditions conditions;
+    uint32_t netplayTestFrames = 0;
+
+    // Speed
+    float emulationSpeed = 1.0f;
+    float fastForwardSpeed = 0.0f;
+    unsigned int frameSkip = 1;
+    bool backgroundThrottle = false;
+    int runAheadFrames = 0;
+};
 
 class Emulator
 {
 public:
     int emulate(int argc, char **argv);
+
+private:
+    double sinceLaunch() const;
+    bool loadROM(Chip8 &chip8);
+    void startWindow(Chip8 &chip8, std::optional<Graphics> &window, EarlyStart &early);
+    void startMovie(Chip8 &chip8, MoviePlayer &movie);
+    void openFrameDumps();
+    int runWindowed(Chip8 &chip8, Graphics &platform, EarlyStart &early, MoviePlayer &movie, bool playing,
+                    ExecTraceWriter &execTrace);
+    int replayHeadless(Chip8 &chip8, MoviePlayer &movie);
+    int runHeadless(Chip8 &chip8, uint32_t frames, unsigned int cycles);
+    int runTerminal(Chip8 &chip8, int cycleDelay, const char *title);
+    int runWall(const char *romFilename, uint32_t seed, unsigned int count, unsigned int threads, unsigned int cycles,
+                RenderBackend backend, PresentMode present);
+    void reportFault(Chip8 &chip8, uint32_t frame); // frame counts from 1, the index its --png/--y4m dump carries
+    void dumpFrame(const Chip8 &chip8, uint32_t frame);
+    void closeFrameDumps();
+    void runAhead(Chip8 &chip8, unsigned int cycles, uint64_t *video);
+    void runEarly(Chip8 &chip8, int cycleDelay, float speed, EarlyStart &early);
+    void reportStartup(const EarlyStart &early, double firstInstructionMs, double firstFrameMs);
+    void reportBenchmark(const BenchStats &stats);
+    int runNetplayTest(const char *romFilename, uint32_t seed, uint32_t frames, unsigned int cycles, NetConditions conditions);
+
+    EmulatorOptions options;
+    std::chrono::high_resolution_clock::time_point launchTime;
+    int runAheadFrames = 0;
+    Chip8State runAheadState;
+    RunAheadStats runAheadStats;
+    FlightRecorder flightRecorder;
+    Watchdog watchdog;
+    FrameDumper pngDumper;
+    FrameDumper y4mDumper;
+    ClipRecorder clip;
+    FrameStreamWriter frameStream;
 };
 
-#endif // EMULATOR_HPP
\ No newline at end of file
+#endif // EMULATOR_HPP
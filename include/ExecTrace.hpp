@@ -0,0 +1,99 @@
+#ifndef EXEC_TRACE_HPP
+#define EXEC_TRACE_HPP
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const uint16_t EXEC_TRACE_VERSION = 1;
+const size_t EXEC_TRACE_BLOCK_RECORDS = 1u << 20; // records per buffer handed to the writer thread, and per block
+const uint16_t EXEC_TRACE_COMPRESSED = 0x1;
+
+// One executed instruction. File layout (little-endian):
+//   header   "C8TR", version, record size, flags, reserved u16, ROM hash u64, seed u32
+//   body     raw records, or with EXEC_TRACE_COMPRESSED blocks of: u32 records, u32 bytes, payload
+//            where each record is XORed with the previous one in its block and stored as a byte mask
+//            of the non-zero bytes followed by those bytes
+struct ExecRecord
+{
+    uint16_t pc;     // address the instruction was fetched from
+    uint16_t opcode;
+    uint16_t index;  // I after the instruction
+    uint8_t vx;      // the register named by the opcode's x nibble, after the instruction
+    uint8_t vf;
+};
+static_assert(sizeof(ExecRecord) == 8, "ExecRecord is written to disk as-is");
+
+// Records go into one buffer while a background thread writes the other; the interpreter only waits
+// when it fills a buffer before the previous one reached the disk
+class ExecTraceWriter
+{
+public:
+    ~ExecTraceWriter();
+    bool Open(const char *filename, uint64_t romHash, uint32_t seed, bool compress);
+    void Close();
+    uint64_t getSteps() const;
+
+    void Record(uint16_t pc, uint16_t opcode, uint16_t index, uint8_t vx, uint8_t vf)
+    {
+        buffers[active][count] = ExecRecord{pc, opcode, index, vx, vf};
+        if (++count == EXEC_TRACE_BLOCK_RECORDS)
+        {
+            Submit();
+        }
+    }
+
+private:
+    void Submit();
+    void WriterLoop();
+    bool WriteBlock(const ExecRecord *records, size_t size);
+
+    FILE *file{};
+    bool compress{};
+    std::vector<ExecRecord> buffers[2];
+    int active{};
+    size_t count{};
+    uint64_t submitted{};
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool pending{};
+    int pendingBuffer{};
+    size_t pendingCount{};
+    bool stopping{};
+    bool failed{};
+    std::vector<uint8_t> packed;
+};
+
+class ExecTraceReader
+{
+public:
+    ~ExecTraceReader();
+    bool Open(const char *filename);
+    // Fills up to max records; 0 at the end of the trace
+    size_t Read(ExecRecord *records, size_t max);
+    uint64_t getRomHash() const;
+    uint32_t getSeed() const;
+    bool isCompressed() const;
+    bool isTruncated() const;
+
+private:
+    bool ReadBlock();
+
+    FILE *file{};
+    uint16_t flags{};
+    uint64_t romHash{};
+    uint32_t seed{};
+    bool truncated{};
+    std::vector<uint8_t> packed;
+    std::vector<ExecRecord> block;
+    size_t blockPosition{};
+};
+
+#endif // EXEC_TRACE_HPP
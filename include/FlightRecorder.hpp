@@ -0,0 +1,73 @@
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#pragma once
+
+#include <cstdint>
+
+const uint32_t FLIGHT_RECORDER_ENTRIES = 4096; // power of two
+const uint16_t FLIGHT_RECORDER_VERSION = 1;
+const char *const FLIGHT_RECORDER_DEFAULT_FILE = "chip8-flight.bin";
+
+// Machine state just before one instruction ran
+struct FlightEntry
+{
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t index;
+    uint8_t sp;
+    uint8_t reserved;
+};
+static_assert(sizeof(FlightEntry) == 8, "FlightEntry is written to disk as-is");
+
+// Dump file layout (little-endian): this header, then `count` FlightEntry records, oldest first
+struct FlightDumpHeader
+{
+    char magic[4]; // "C8FR"
+    uint16_t version;
+    uint8_t fault;  // GuestFault that triggered the dump, 0 for a host signal
+    uint8_t signal; // host signal number, 0 for a guest fault
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t steps; // instructions recorded over the whole run
+};
+static_assert(sizeof(FlightDumpHeader) == 24, "FlightDumpHeader is written to disk as-is");
+
+// Always-on history of the last FLIGHT_RECORDER_ENTRIES instructions. Recording is one store into a
+// fixed ring; dumping allocates nothing and only uses open/write, so it is safe from a signal handler.
+class FlightRecorder
+{
+public:
+    ~FlightRecorder();
+    void setDumpFile(const char *filename);
+    const char *getDumpFile() const;
+
+    void Record(uint16_t pc, uint16_t opcode, uint8_t sp, uint16_t index)
+    {
+        entries[steps++ & (FLIGHT_RECORDER_ENTRIES - 1)] = FlightEntry{pc, opcode, index, sp, 0};
+    }
+
+    // Writes the ring once per run; later faults keep the first dump, which holds the history that led
+    // up to the original problem
+    bool DumpFault(uint8_t fault);
+    bool isDumped() const;
+
+    uint64_t getSteps() const;
+    // Forgets the instructions recorded since getSteps() returned `to`; the next ones overwrite them
+    void Rewind(uint64_t to);
+
+    // Dumps this recorder on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, then lets the signal kill the
+    // process as it would have
+    void InstallSignalHandlers();
+
+private:
+    bool Dump(uint8_t fault, uint8_t signal);
+    static void HandleSignal(int signal);
+
+    FlightEntry entries[FLIGHT_RECORDER_ENTRIES]{};
+    uint64_t steps{};
+    char dumpFile[512]{};
+    bool dumped{};
+};
+
+#endif // FLIGHT_RECORDER_HPP
@@ -0,0 +1,87 @@
+#ifndef FRAME_DUMPER_HPP
+#define FRAME_DUMPER_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const unsigned int FRAME_DUMP_DEFAULT_SCALE = 4;
+const size_t FRAME_DUMP_DEFAULT_QUEUE = 64;       // frames waiting for the encoder
+const uint32_t FRAME_DUMP_DEFAULT_PNG_EVERY = 60; // one still per emulated second
+
+enum FrameDumpFormat
+{
+    DUMP_PNG, // one greyscale still per chosen frame: <path>-<frame>.png
+    DUMP_Y4M  // every frame as a raw YUV4MPEG2 stream; "-" writes to stdout for piping into an encoder
+};
+
+struct FrameDumpOptions
+{
+    FrameDumpFormat format = DUMP_PNG;
+    std::string path;
+    unsigned int scale = FRAME_DUMP_DEFAULT_SCALE;
+    size_t queueFrames = FRAME_DUMP_DEFAULT_QUEUE;
+    bool dropWhenFull = false; // otherwise Submit waits for the encoder
+    uint32_t pngEvery = FRAME_DUMP_DEFAULT_PNG_EVERY;
+    std::vector<uint32_t> pngFrames; // replaces pngEvery when not empty
+};
+
+struct FrameDumpStats
+{
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t waits = 0; // Submit calls that found the queue full and waited
+    double encodeMs = 0.0;
+    uint64_t bytes = 0;
+};
+
+// Writes frames from the headless runner without SDL. Submit only copies the 256-byte bit-packed frame
+// into a bounded queue; scaling, encoding and file I/O happen on a worker thread.
+class FrameDumper
+{
+public:
+    ~FrameDumper();
+    bool Open(const FrameDumpOptions &options);
+    bool isOpen() const;
+    bool Wants(uint32_t frame) const;
+    void Submit(uint32_t frame, const uint64_t *video);
+    void Close(); // waits until every queued frame is written
+    const FrameDumpStats &getStats() const;
+    const FrameDumpOptions &getOptions() const;
+
+private:
+    struct QueuedFrame
+    {
+        uint32_t frame;
+        uint64_t video[VIDEO_HEIGHT];
+    };
+
+    void WorkerLoop();
+    bool Write(const QueuedFrame &queued, uint64_t &bytes); // runs unlocked; bytes is added to stats by the caller
+
+    FrameDumpOptions options;
+    FILE *stream{}; // Y4M output
+    bool open{};
+    uint32_t width{};
+    uint32_t height{};
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> encoded;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<QueuedFrame> queue;
+    size_t head{};
+    size_t count{};
+    bool stopping{};
+    bool failed{};
+    FrameDumpStats stats;
+};
+
+#endif // FRAME_DUMPER_HPP
@@ -0,0 +1,128 @@
+#ifndef FRAME_STREAM_HPP
+#define FRAME_STREAM_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+const uint16_t FRAME_STREAM_VERSION = 1;
+const uint32_t FRAME_STREAM_DEFAULT_KEYFRAME_INTERVAL = 3600; // one minute at 60 frames per second
+const size_t FRAME_STREAM_FRAME_BYTES = VIDEO_HEIGHT * sizeof(uint64_t);
+
+// File layout (little-endian):
+//   header   FrameStreamHeader
+//   records  varint (repeats << 1 | changed): `repeats` frames identical to the one before, then if
+//            `changed` one more frame stored as the XOR of its 256 bytes with the previous frame's,
+//            column-major (byte b * 32 + y is pixels 8b to 8b + 7 of row y, most significant bit
+//            leftmost), run-length encoded as tokens:
+//              0x00-0x7E  1-127 zero bytes
+//              0x7F       zero bytes to the end of the frame
+//              0x80-0xFF  1-128 literal bytes follow
+//            Every keyframe-interval'th frame is a keyframe, XORed with a blank screen instead, and
+//            starts a new record so it can be decoded without what came before
+//   index    FrameStreamKeyframe per keyframe
+//   trailer  FrameStreamTrailer
+struct FrameStreamHeader
+{
+    char magic[4]; // "C8FS"
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t keyframeInterval;
+    uint32_t reserved2;
+    uint64_t romHash;
+};
+static_assert(sizeof(FrameStreamHeader) == 24, "FrameStreamHeader is written to disk as-is");
+
+struct FrameStreamKeyframe
+{
+    uint32_t frame;
+    uint32_t reserved;
+    uint64_t offset; // of the keyframe's record from the start of the file
+};
+static_assert(sizeof(FrameStreamKeyframe) == 16, "FrameStreamKeyframe is written to disk as-is");
+
+struct FrameStreamTrailer
+{
+    uint64_t indexOffset;
+    uint32_t frames;
+    uint32_t keyframes;
+    uint32_t reserved;
+    char magic[4]; // "C8FI"
+};
+static_assert(sizeof(FrameStreamTrailer) == 24, "FrameStreamTrailer is written to disk as-is");
+
+// Appends one frame per call. An unchanged frame only increments a counter; a changed one costs a
+// 256-byte XOR and a few bytes of buffered output.
+class FrameStreamWriter
+{
+public:
+    ~FrameStreamWriter();
+    bool Open(const char *filename, uint64_t romHash, uint32_t keyframeInterval = FRAME_STREAM_DEFAULT_KEYFRAME_INTERVAL);
+    void Frame(const uint64_t *video);
+    void Close(); // writes the seek index; a stream that was never closed is still readable
+    bool isOpen() const;
+    uint32_t getFrames() const;
+    uint64_t getBytes() const;
+
+private:
+    void WriteRecord(uint64_t repeats, bool changed);
+    void WriteDelta(const uint64_t *rows);
+    void Write(const void *data, size_t size);
+
+    FILE *file{};
+    uint32_t keyframeInterval{};
+    uint32_t frames{};
+    uint32_t repeats{};
+    uint64_t position{};
+    bool failed{};
+    uint64_t previous[VIDEO_HEIGHT]{};
+    std::vector<FrameStreamKeyframe> index;
+};
+
+// Random access to any frame: decoding starts from the closest keyframe at or before it, or carries on
+// from the frame read last when that is closer, so reading frames in order decodes each one once
+class FrameStreamReader
+{
+public:
+    ~FrameStreamReader();
+    bool Open(const char *filename);
+    uint32_t getFrameCount() const;
+    uint32_t getKeyframeInterval() const;
+    uint64_t getRomHash() const;
+    uint64_t getBytes() const;
+    // The writer did not close the stream, so the index was rebuilt by scanning it; a partly written
+    // last frame is left out
+    bool isRecovered() const;
+
+    // Fills VIDEO_HEIGHT rows
+    bool ReadFrame(uint32_t frame, uint64_t *video);
+
+private:
+    bool Rebuild(uint64_t fileSize);
+    bool LoadSegment(size_t keyframe);
+    bool Step();
+    static bool ReadVarint(const std::vector<uint8_t> &data, size_t &position, uint64_t &value);
+    static bool ApplyDelta(const std::vector<uint8_t> &data, size_t &position, uint8_t *frame);
+
+    FILE *file{};
+    FrameStreamHeader header{};
+    uint32_t frames{};
+    uint64_t dataEnd{};
+    uint64_t bytes{};
+    bool recovered{};
+    std::vector<FrameStreamKeyframe> index;
+
+    // Decoder position: `current` holds frame nextFrame - 1 of the loaded segment
+    size_t segment = SIZE_MAX;
+    std::vector<uint8_t> data;
+    size_t position{};
+    uint32_t nextFrame{};
+    uint64_t repeatsLeft{};
+    bool changedLeft{};
+    uint8_t current[FRAME_STREAM_FRAME_BYTES]{};
+};
+
+#endif // FRAME_STREAM_HPP
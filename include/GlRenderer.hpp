@@ -0,0 +1,62 @@
+#ifndef GL_RENDERER_HPP
+#define GL_RENDERER_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <glad/glad.h>
+
+const unsigned int GL_UPLOAD_SLOTS = 3; // frames in flight: one being drawn, one queued, one being written
+
+// Draws the CHIP-8 display with OpenGL 3.3 core, without SDL_Renderer. Each frame is expanded straight
+// into a pixel buffer object as one byte per pixel and copied into an R8 texture; a shader scales it
+// with nearest sampling and maps the two levels to colours. With OpenGL 4.4 or ARB_buffer_storage the
+// buffer stays mapped for the renderer's lifetime; otherwise each upload maps its slot unsynchronized.
+// Fences keep the CPU from overwriting a slot the GPU has not finished reading. The texture can also be
+// larger than one display, for VideoWall's atlas, and be updated a band of rows at a time.
+class GlRenderer
+{
+public:
+    ~GlRenderer();
+    // The context must be current and glad loaded; false if a shader or buffer could not be created or
+    // the texture is larger than the driver allows
+    bool Init(GLADloadproc getProcAddress, unsigned int width = VIDEO_WIDTH, unsigned int height = VIDEO_HEIGHT);
+    void Shutdown();
+
+    void Upload(const uint64_t *video); // the texture must be VIDEO_WIDTH * VIDEO_HEIGHT
+    // Replaces texture rows [top, top + rows) with one byte per pixel, `pitch` bytes apart
+    void UploadRows(const uint8_t *luma, size_t pitch, unsigned int top, unsigned int rows);
+    // Clears the framebuffer and draws the display into the given rectangle (GL window coordinates,
+    // origin at the bottom left)
+    void Draw(int framebufferWidth, int framebufferHeight, int x, int y, int width, int height);
+    void setColours(uint32_t on, uint32_t off); // 0xRRGGBBAA
+    bool isPersistent() const;
+    uint64_t getFenceWaits() const;
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+
+private:
+    GLuint CompileProgram();
+    uint8_t *BeginUpload(); // the next slot, once the GPU is done with it; null if it could not be mapped
+    void EndUpload(unsigned int top, unsigned int rows);
+
+    bool ready{};
+    bool persistent{};
+    GLuint program{};
+    GLuint vertexArray{};
+    GLuint texture{};
+    GLuint buffer{};
+    unsigned int width{};
+    unsigned int height{};
+    size_t slotBytes{};
+    GLint onLocation = -1;
+    GLint offLocation = -1;
+    uint8_t *mapped{};
+    GLsync fences[GL_UPLOAD_SLOTS]{};
+    unsigned int slot{};
+    uint64_t fenceWaits{};
+    float on[3] = {1.0f, 1.0f, 1.0f};
+    float off[3] = {0.0f, 0.0f, 0.0f};
+};
+
+#endif // GL_RENDERER_HPP
@@ -6,18 +6,39 @@
 #include <cstdint>
 #include <SDL3/SDL.h>
 #include <glad/glad.h>
+#include "ClipRecorder.hpp"
+#include "GlRenderer.hpp"
+#include "Latency.hpp"
+#include "Netplay.hpp"
+#include "PostProcess.hpp"
+#include "Telemetry.hpp"
+#include "VideoWall.hpp"
 #include <string>
 #include <queue>
 
+enum RenderBackend
+{
+    RENDER_SDL, // SDL_Renderer, with the debug panels and overlay
+    RENDER_GL   // OpenGL 3.3 core drawing only the display (see GlRenderer)
+};
+
+enum PresentMode
+{
+    PRESENT_VSYNC,
+    PRESENT_ADAPTIVE, // vsync, but a late frame is shown at once and may tear
+    PRESENT_IMMEDIATE
+};
+
 class Graphics
 {
     friend class Imgui;
 
 public:
-    Graphics(const char *title);
+    Graphics(const char *title, bool offscreen = false, RenderBackend backend = RENDER_SDL, PresentMode present = PRESENT_VSYNC);
     ~Graphics();
 
-    void Update(const void *buffer, int pitch);
+    void Update(const void *buffer, int pitch); // a null buffer keeps the texture from the last upload
+    void UpdateVideo(const uint64_t *video);    // Chip8::video; null keeps the last frame
     void DisplayRegisters(uint8_t *registers);
     void DisplayStack(uint16_t *stack);
     void DisplayPC(uint16_t pc);
@@ -25,15 +46,47 @@ public:
     void DisplayCycleDelay();
     void DisplayMemory(uint8_t *memory);
     void DistplayInstructions(std::string instruction);
+    void DisplayLatency(const LatencyTracker &tracker);
+    void DisplayRunAhead(int frames, float saveUs, float aheadUs, float restoreUs, float framePercent);
+    void DisplayNetplay(const NetplayStats &stats);
+    void DisplaySpeed(float speed, float emulatedFps);
+    void DisplayTelemetry(const TelemetrySnapshot &snapshot);
+    void DisplayRecording();
     void DrawDebugBordrer();
     void EndDraw();
 
+    // Video wall: the window shows a VideoWall atlas instead of one display and the panels
+    WallFormat getWallFormat() const;
+    void OpenWall(const VideoWall &wall);
+    void UpdateWall(const VideoWall &wall); // uploads the rows the last Compose rewrote, if any
+    void DrawWall();
+
+    // Post-processing: UpdateVideo draws the display through a PostProcessor at a high resolution.
+    // scale = 0 fills the display area (SDL_Renderer) or most of the screen (OpenGL).
+    void OpenPostProcess(const PostOptions &options);
+
     bool ProcessInput(uint8_t *keys);
+    // Blocks until an event arrives or timeoutMs passes; -1 waits for an event however long it takes
+    void WaitForEvents(int timeoutMs);
+
+    // Host window state. Nothing needs drawing while the window is hidden, minimized or occluded.
+    bool isVisible() const;
+    bool hasFocus() const;
+    bool isPaused() const;            // toggled with P or Pause
+    void setPausable(bool pausable);  // off for netplay and --bench, which cannot stop
+    bool ConsumeRedraw();             // the window was exposed since the last call and must be drawn again
     
     int getCycleDelay();
     void setCycleDelay(int delay);
+    void setLatencyTracker(LatencyTracker *tracker);
+    void setClipRecorder(ClipRecorder *recorder);
+    bool isFastForward();
 
 private:
+    void DrawOverlayLine(const char *text);
+    void CreateDisplayTexture(int width, int height, const char *what); // replaces the display texture
+    void UploadRows(const uint8_t *pixels, size_t pitch, unsigned int top, unsigned int rows, int width);
+
     const float WINDOW_WIDTH = 740;
     const float WINDOW_HEIGHT = 520;
     const float CHIP8_SCREEN_WIDTH = 640;
@@ -48,12 +101,29 @@ private:
     
     std::queue<std::string> instructionQueue;
     int cycleDelay = 3;
+    bool showOverlay = false;
+    bool fastForward = false;
+    bool visible = true;
+    bool focused = true;
+    bool paused = false;
+    bool pausable = true;
+    bool redraw = false;
+    std::string title;
+    int overlayLine = 0;
+    LatencyTracker *latency{};
+    ClipRecorder *clip{};
 
     SDL_Window *window{};
     SDL_Renderer *renderer{};
     SDL_Texture *texture{};
     SDL_GLContext gl_context{};
-    GLuint framebuffer_texture;
+    RenderBackend backend;
+    GlRenderer gl;
+    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+    int wallWidth{};
+    int wallHeight{};
+    PostProcessor post;
+    uint64_t postVideo[VIDEO_HEIGHT]{}; // the last frame given to UpdateVideo, which phosphor keeps fading
 };
 
 #endif // GRAPHICS_HPP
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#pragma once
+
+#include <cstdint>
+
+const unsigned int LATENCY_BUCKET_US = 250; // width of one histogram bucket
+const unsigned int LATENCY_BUCKETS = 400;   // 0 - 100 ms, last bucket collects everything slower
+// Six frames, the histograms' whole range: a press the game has not shown by then is dropped, not measured
+const uint64_t LATENCY_TIMEOUT_NS = 100000000ull;
+
+enum LatencyStage
+{
+    LATENCY_INPUT_TO_POLL,     // key event -> first Ex9E/ExA1/Fx0A that reads the key
+    LATENCY_POLL_TO_FRAME,     // that read -> end of the first frame that changes the video buffer after it
+    LATENCY_FRAME_TO_PRESENT,  // that change -> SDL_RenderPresent returns
+    LATENCY_INPUT_TO_PRESENT,  // whole input-to-photon path
+    LATENCY_STAGE_COUNT
+};
+
+class LatencyHistogram
+{
+public:
+    void Add(uint64_t ns);
+    uint64_t getCount() const;
+    double getMeanMs() const;
+    double getMaxMs() const;
+    double Percentile(double p) const; // upper bound of the bucket holding the p-th percentile, in ms
+    const uint64_t *getBuckets() const;
+
+private:
+    uint64_t buckets[LATENCY_BUCKETS]{};
+    uint64_t count{};
+    uint64_t totalNs{};
+    uint64_t maxNs{};
+};
+
+// Follows one keypad press at a time through the emulator. All timestamps are
+// SDL_GetTicksNS() nanoseconds, the same clock SDL stamps key events with.
+class LatencyTracker
+{
+public:
+    void KeyPressed(uint8_t key, uint64_t timestampNs);
+    void KeypadPolled(uint16_t keysRead, uint64_t nowNs);
+    // The frame changed the video after reading a key in keysReadBefore; a key read in an earlier frame was
+    // read before anything this frame drew, so callers pass all keys for it
+    void VideoChanged(uint16_t keysReadBefore, uint64_t nowNs);
+    void Presented(uint64_t nowNs);
+
+    // true while a key press is in flight, so callers can skip reading the clock otherwise
+    bool isTracking() const;
+    uint64_t getDropped() const; // presses given up on after LATENCY_TIMEOUT_NS
+    const LatencyHistogram &getHistogram(int stage) const;
+    static const char *getStageName(int stage);
+    bool Dump(const char *filename) const;
+
+private:
+    enum Phase
+    {
+        IDLE,
+        WAIT_POLL,
+        WAIT_FRAME,
+        WAIT_PRESENT
+    };
+
+    bool Expired(uint64_t nowNs); // drops the press in flight once it has timed out
+
+    Phase phase = IDLE;
+    uint8_t trackedKey{};
+    uint64_t keyTime{};
+    uint64_t pollTime{};
+    uint64_t frameTime{};
+    uint64_t dropped{};
+    LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+};
+
+#endif // LATENCY_HPP
@@ -0,0 +1,92 @@
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+const uint16_t MOVIE_VERSION = 2; // 2: bit-packed video in Chip8State
+const uint32_t MOVIE_DEFAULT_KEYFRAME_INTERVAL = 600; // 10 s at 60 frames per second
+const uint32_t MOVIE_MAX_FRAMES = 60 * 60 * 60 * 24;  // a day at 60 frames per second; a movie claiming more is corrupt
+const uint16_t QUIRKS_DEFAULT = 0;                    // the interpreter has a single behaviour today
+
+// File layout (little-endian):
+//   header   "C8MV", version, quirks, ROM hash, seed, keyframe interval, state size
+//   records  'I' varint frames, u16 keypad mask, varint cycles per frame   (a run of identical frames)
+//            'K' varint frame, u64 video hash, Chip8State                  (state before that frame runs)
+//            'E' varint frame count, u64 video hash after the last frame
+struct MovieHeader
+{
+    uint64_t romHash;
+    uint32_t seed;
+    uint16_t quirks;
+    uint32_t keyframeInterval;
+};
+
+struct MovieInput
+{
+    uint16_t keys;
+    uint16_t cycles;
+};
+
+class MovieRecorder
+{
+public:
+    ~MovieRecorder();
+    bool Open(const char *filename, const Chip8 &chip8, uint32_t keyframeInterval);
+    // Call once per frame before running it with chip8's current keypad
+    void RecordFrame(const Chip8 &chip8, unsigned int cycles);
+    void Close(const Chip8 &chip8);
+    bool isRecording() const;
+
+private:
+    void FlushRun();
+
+    std::ofstream file;
+    uint32_t keyframeInterval{};
+    uint32_t frame{};
+    MovieInput run{};
+    uint32_t runLength{};
+};
+
+class MoviePlayer
+{
+public:
+    bool Open(const char *filename);
+    const MovieHeader &getHeader() const;
+    uint32_t getFrameCount() const;
+    uint32_t getFrame() const;
+    uint32_t getMismatches() const;
+    bool isFinished() const;
+
+    // Seeds chip8 from the movie; chip8 must have the movie's ROM loaded and nothing executed yet
+    void Start(Chip8 &chip8);
+    // Restores the closest keyframe at or before frame and runs forward to it
+    bool Seek(Chip8 &chip8, uint32_t frame);
+    // Applies the next frame's keypad and returns its cycle count; false once the movie is over
+    bool NextFrame(Chip8 &chip8, unsigned int &cycles);
+    // Compares against the recorded hash after the last frame
+    bool VerifyEnd(const Chip8 &chip8) const;
+
+private:
+    struct Keyframe
+    {
+        uint32_t frame;
+        uint64_t videoHash;
+        Chip8State state;
+    };
+
+    MovieHeader header{};
+    std::vector<MovieInput> inputs;
+    std::vector<Keyframe> keyframes;
+    size_t nextKeyframe{};
+    uint32_t frame{};
+    uint32_t mismatches{};
+    bool complete{};
+    uint64_t finalVideoHash{};
+};
+
+#endif // MOVIE_HPP
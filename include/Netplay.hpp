@@ -0,0 +1,118 @@
+#ifndef NETPLAY_HPP
+#define NETPLAY_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+const unsigned int NETPLAY_MAX_ROLLBACK = 16; // frames a peer may run ahead of confirmed remote input
+const unsigned int NETPLAY_RING = 32;         // saved frames, must exceed NETPLAY_MAX_ROLLBACK
+const unsigned int NETPLAY_MAX_INPUTS = 32;   // inputs resent per packet until the peer acknowledges them
+const uint32_t NETPLAY_DEFAULT_SEED = 0xC8C8C8C8u; // both peers must run the same RNG sequence
+
+// Keypad split for two-player ROMs: player 1 owns the left two columns (Pong: 1/Q),
+// player 2 the right two (Pong: 4/R)
+const uint16_t PLAYER_ONE_KEYS = 0x05B7; // 0 1 2 4 5 7 8 A
+const uint16_t PLAYER_TWO_KEYS = 0xFA48; // 3 6 9 B C D E F
+
+// Conditions injected into outgoing packets so rollback can be exercised over loopback
+struct NetConditions
+{
+    float delayMs = 0.0f;
+    float lossPercent = 0.0f;
+};
+
+struct NetplayStats
+{
+    uint32_t frame = 0;
+    uint32_t confirmedFrame = 0;
+    uint64_t rollbacks = 0;
+    uint32_t maxRollbackFrames = 0;
+    double lastResimUs = 0.0;
+    double maxResimUs = 0.0;
+    uint64_t stalls = 0;
+    uint64_t hashChecks = 0;
+    bool desynced = false;
+    uint32_t desyncFrame = 0;
+    bool incompatible = false; // peer runs another ROM, seed or frame length
+};
+
+class UdpSocket
+{
+public:
+    UdpSocket();
+    ~UdpSocket();
+    bool Open(uint16_t localPort);
+    bool SetPeer(const char *host, uint16_t port);
+    void Send(const uint8_t *data, size_t size);
+    int Receive(uint8_t *data, size_t capacity); // -1 when nothing is waiting
+
+private:
+    intptr_t handle;
+    uint8_t peerAddress[16]{}; // sockaddr_in
+};
+
+class RollbackSession
+{
+public:
+    bool Start(const Chip8 &chip8, int player, uint16_t localPort, const char *peerHost, uint16_t peerPort,
+               unsigned int cyclesPerFrame, NetConditions conditions);
+    // Receives remote input, rolls back and resimulates on a misprediction, sends local input
+    void Poll(Chip8 &chip8, double nowMs);
+    // Poll, then run one frame with local keys and predicted remote keys; false while stalled
+    bool AdvanceFrame(Chip8 &chip8, uint16_t keys, double nowMs);
+    const NetplayStats &getStats() const;
+    uint16_t getLocalMask() const;
+
+private:
+    struct FrameSlot
+    {
+        uint32_t frame;
+        uint16_t local;
+        uint16_t remote; // as used in the last simulation of this frame
+        Chip8State state; // before the frame ran
+        Chip8Latches latches;
+    };
+
+    void Receive(double nowMs);
+    void Resimulate(Chip8 &chip8);
+    void UpdateConfirmed(const Chip8 &chip8);
+    void CompareHash(uint32_t frame, uint64_t hash);
+    void Send(double nowMs);
+    void Flush(double nowMs);
+    void RunSlot(Chip8 &chip8, const FrameSlot &slot);
+    uint16_t PredictRemote(uint32_t frame) const;
+
+    UdpSocket socket;
+    NetConditions conditions;
+    std::mt19937 lossRng{12345};
+    std::deque<std::pair<double, std::vector<uint8_t>>> outgoing; // release time, packet
+
+    uint64_t romHash{};
+    uint32_t seed{};
+    uint16_t cyclesPerFrame{};
+    uint8_t player{};
+    uint16_t localMask{};
+
+    uint32_t frame{};                 // next frame to run
+    FrameSlot slots[NETPLAY_RING];
+    uint16_t remoteInputs[NETPLAY_RING]{};
+    int64_t remoteFrames[NETPLAY_RING];
+    int64_t remoteConfirmed = -1;     // every remote input up to here has arrived
+    int64_t peerAck = -1;             // every local input up to here has reached the peer
+    int64_t rollbackFrame = -1;       // earliest mispredicted frame, -1 if none
+
+    uint64_t localHashes[NETPLAY_RING]{};
+    int64_t localHashFrames[NETPLAY_RING];
+    int64_t hashedUpTo = -1;
+    int64_t remoteHashFrame = -1;
+    uint64_t remoteHash{};
+
+    NetplayStats stats;
+};
+
+#endif // NETPLAY_HPP
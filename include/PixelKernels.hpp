@@ -0,0 +1,57 @@
+#ifndef PIXEL_KERNELS_HPP
+#define PIXEL_KERNELS_HPP
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction sets the pixel kernels are written for, in order of preference
+enum CpuLevel
+{
+    CPU_SCALAR,
+    CPU_SSE2,
+    CPU_AVX2,
+    CPU_AVX512, // AVX-512F and BW
+    CPU_LEVEL_COUNT
+};
+
+const uint8_t PHOSPHOR_FLOOR = 8;  // fading pixels dimmer than this go dark, so a still screen settles
+const size_t SCALE_ROW_SLACK = 64; // bytes past the end of a row that the scaleRow kernels may overwrite
+
+// The per-pixel loops of the core and the frontends. Every variant gives results identical to the scalar
+// one; chip8-bench checks that before timing them.
+struct PixelKernels
+{
+    CpuLevel level;
+    void (*clearVideo)(uint64_t *rows); // VIDEO_HEIGHT rows
+    // XORs `height` sprite bytes into consecutive rows at column x (0-63), dropping bits past column 63;
+    // true if any pixel was turned off. sprite must have 16 readable bytes whatever the height.
+    bool (*blitSprite)(uint64_t *rows, const uint8_t *sprite, unsigned int height, unsigned int x);
+    void (*expandVideo)(const uint64_t *rows, uint32_t *pixels);                      // see ExpandVideo
+    void (*scaleVideoLuma)(const uint64_t *rows, unsigned int scale, uint8_t *luma); // see ScaleVideoLuma
+    uint64_t (*hashFrame)(const uint64_t *rows);                                       // see HashFrame
+    // Phosphor persistence over VIDEO_WIDTH * VIDEO_HEIGHT levels: a lit pixel becomes LUMA_ON, an unlit one
+    // keeps keep / 256 of its level and goes dark below PHOSPHOR_FLOOR. keep = 0 gives the plain frame.
+    void (*fadeLevels)(const uint64_t *rows, uint8_t keep, uint8_t *levels);
+    // VIDEO_WIDTH levels, each repeated scale times, as luma or as colours from a 256-entry palette
+    void (*scaleRowLuma)(const uint8_t *levels, unsigned int scale, uint8_t *target);
+    void (*scaleRowRgba)(const uint8_t *levels, const uint32_t *palette, unsigned int scale, uint32_t *target);
+};
+
+const char *CpuLevelName(CpuLevel level); // "scalar", "sse2", "avx2", "avx512"
+CpuLevel DetectCpuLevel();                // the best level both this build and this CPU support
+const PixelKernels *GetPixelKernels(CpuLevel level); // null when this build or this CPU lacks the level
+bool UsePixelKernels(CpuLevel level);                // false, keeping the current kernels, when unsupported
+
+// Chosen once at startup from DetectCpuLevel; --cpu can lower it
+extern const PixelKernels *pixelKernels;
+
+// 64-bit hash of a frame's VIDEO_HEIGHT rows for telling frames apart in memory. Unlike
+// Chip8::HashVideo, which movies store, it reads eight rows per step in every variant.
+inline uint64_t HashFrame(const uint64_t *rows)
+{
+    return pixelKernels->hashFrame(rows);
+}
+
+#endif // PIXEL_KERNELS_HPP
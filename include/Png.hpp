@@ -0,0 +1,30 @@
+#ifndef PNG_HPP
+#define PNG_HPP
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal PNG encoder for the emulator's greyscale output, no zlib needed. Rows identical to the one
+// above use the Up filter and compress to almost nothing; everything else is deflated with fixed
+// Huffman codes and run-length matches, which suits images made of long runs of two values.
+
+// Appends a zlib stream holding data
+void DeflateRuns(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+// Filters an 8-bit image into PNG scanlines (a filter byte per row) ready for DeflateRuns
+void FilterRows(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+
+// Appends length, type, data and CRC
+void AppendPngChunk(std::vector<uint8_t> &png, const char *type, const uint8_t *data, size_t size);
+void AppendBigEndian(std::vector<uint8_t> &out, uint32_t value);
+
+// Signature and IHDR for an 8-bit image of the given PNG colour type (0 greyscale, 3 palette)
+void BeginPng(std::vector<uint8_t> &png, uint32_t width, uint32_t height, uint8_t colourType);
+
+// Complete 8-bit greyscale PNG
+void EncodePng(const uint8_t *luma, uint32_t width, uint32_t height, std::vector<uint8_t> &png);
+
+#endif // PNG_HPP
@@ -0,0 +1,96 @@
+#ifndef POST_PROCESS_HPP
+#define POST_PROCESS_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include "Video.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const unsigned int POST_MAX_SCALE = 128;   // 8192 pixels wide
+const unsigned int POST_BAND_ROWS = 64;    // output rows handed to a thread at a time
+const unsigned int POST_INLINE_ROWS = 256; // fewer changed rows than this are drawn without waking the workers
+
+enum PostFormat
+{
+    POST_LUMA, // one byte per pixel, for GlRenderer
+    POST_RGBA  // SDL_PIXELFORMAT_ABGR8888, for SDL_Renderer
+};
+
+struct PostOptions
+{
+    unsigned int scale = 0;          // 0: the frontend picks one that fills the screen
+    unsigned int phosphor = 0;       // percent of its brightness an unlit pixel keeps each frame; 0 = none
+    bool scanlines = false;          // darken the bottom third of every pixel row
+    unsigned int scanlineLevel = 50; // brightness of the darkened lines, in percent
+    unsigned int threads = 0;        // 0 = one per core, including the caller
+};
+
+// Draws Chip8::video at an integer scale on the CPU, with optional phosphor persistence and scanlines, so a
+// large display needs no filtering from the GPU. Each frame first updates one brightness level per guest
+// pixel; only the guest rows whose levels changed are redrawn, and the output rows they cover are split
+// into bands shared out between worker threads. Output rows with the same guest row and shade are drawn
+// once per band and copied.
+class PostProcessor
+{
+public:
+    ~PostProcessor();
+    bool Open(const PostOptions &options, PostFormat format, uint32_t onColour = PIXEL_ON, uint32_t offColour = PIXEL_OFF);
+    void Close();
+    bool isOpen() const;
+
+    // Call once per displayed frame, even with an unchanged video: phosphor keeps fading until it settles
+    void Process(const uint64_t *video);
+
+    const uint8_t *getPixels() const;
+    size_t getPitch() const; // bytes; rows are padded for the scaleRow kernels
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    unsigned int getScale() const;
+    PostFormat getFormat() const;
+    // Rows redrawn by the last Process: [getDirtyTop(), getDirtyTop() + getDirtyRows())
+    unsigned int getDirtyTop() const;
+    unsigned int getDirtyRows() const;
+    unsigned int getThreads() const; // including the caller
+
+private:
+    void WorkerLoop();
+    void DrawBands(); // takes bands until none are left
+    void DrawBand(unsigned int band);
+    void DrawRow(unsigned int guestRow, bool dark, uint8_t *target) const;
+
+    PostOptions options;
+    PostFormat format{};
+    unsigned int width{};
+    unsigned int height{};
+    unsigned int darkRows{}; // of each scaled guest row, the last this many are scanlines
+    uint8_t keep{};          // phosphor: level kept per frame, out of 256
+    uint8_t scanlineKeep{};
+    size_t pitch{};
+    std::vector<uint8_t> pixels;
+    uint32_t palette[256]{};
+    uint8_t levels[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+    uint8_t darkLevels[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+    bool rowChanged[VIDEO_HEIGHT]{};
+    bool drawn{}; // pixels[] shows levels[]
+    unsigned int dirtyTop{};
+    unsigned int dirtyRows{};
+
+    std::atomic<unsigned int> nextBand{};
+    unsigned int bands{}; // in the current batch
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t batch{};    // incremented to hand the workers a new batch
+    unsigned int busy{}; // workers still drawing the current batch
+    bool stopping{};
+};
+
+#endif // POST_PROCESS_HPP
@@ -0,0 +1,122 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#pragma once
+
+// Guest execution profiler, built only with CHIP8_PROFILE ('make PROFILE=1'); otherwise nothing here exists
+// and Chip8::Cycle carries no profiling code. The report is written when the process exits, to
+// chip8-profile.txt or the file named by the CHIP8_PROFILE_OUT environment variable, and the guest call
+// stacks next to it as chip8-profile.folded (one "main;sub_2D4;sub_300 count" line per stack, the format
+// flamegraph.pl and speedscope read).
+#ifdef CHIP8_PROFILE
+
+#include "Chip8.hpp"
+#include <cstdint>
+#include <vector>
+
+const unsigned int PROFILE_SAMPLE_INTERVAL = 64; // one handler in this many is timed
+const unsigned int PROFILE_TOP = 20;             // rows in the hottest-address and hottest-block tables
+const size_t PROFILE_MAX_STACKS = 1u << 16;      // distinct call stacks kept; deeper novelty is charged to the caller
+
+// One entry per handler reachable through Chip8's dispatch tables, plus OP_NULL
+enum OpcodeFamily
+{
+    FAMILY_00E0, FAMILY_00EE, FAMILY_1nnn, FAMILY_2nnn, FAMILY_3xkk, FAMILY_4xkk, FAMILY_5xy0, FAMILY_6xkk,
+    FAMILY_7xkk, FAMILY_8xy0, FAMILY_8xy1, FAMILY_8xy2, FAMILY_8xy3, FAMILY_8xy4, FAMILY_8xy5, FAMILY_8xy6,
+    FAMILY_8xy7, FAMILY_8xyE, FAMILY_9xy0, FAMILY_Annn, FAMILY_Bnnn, FAMILY_Cxkk, FAMILY_Dxyn, FAMILY_Ex9E,
+    FAMILY_ExA1, FAMILY_Fx07, FAMILY_Fx0A, FAMILY_Fx15, FAMILY_Fx18, FAMILY_Fx1E, FAMILY_Fx29, FAMILY_Fx33,
+    FAMILY_Fx55, FAMILY_Fx65, FAMILY_NULL,
+    FAMILY_COUNT
+};
+
+class Profiler
+{
+public:
+    ~Profiler();
+
+    // Called before each instruction executes; true when this one should be timed
+    bool Executed(uint16_t pc, uint16_t opcode)
+    {
+        pcCount[pc]++;
+        stacks[currentStack].count++;
+        pcOpcode[pc] = opcode;
+        familyCount[Family(opcode)]++;
+        // A basic block ends wherever execution does not fall through to the next instruction
+        if (pc != nextPC)
+        {
+            EndBlock();
+            blockStart = pc;
+            blockEntries[pc]++;
+        }
+        lastPC = pc;
+        nextPC = pc + 2;
+        return ++sinceSample % PROFILE_SAMPLE_INTERVAL == 0;
+    }
+
+    // The guest call stack as of the next instruction; only needed when SP differs from getStackDepth()
+    void StackChanged(const uint8_t *memory, const uint16_t *stack, uint8_t sp);
+    // After a state load the stack may differ even at the same depth
+    void InvalidateStack()
+    {
+        stackDepth = -1;
+    }
+    int getStackDepth() const
+    {
+        return stackDepth;
+    }
+
+    void Sampled(uint16_t opcode, uint64_t ns)
+    {
+        int family = Family(opcode);
+        sampledNs[family] += ns;
+        samples[family]++;
+    }
+
+    static int Family(uint16_t opcode);
+    static const char *FamilyName(int family);
+    bool Write(const char *filename);
+    bool WriteFolded(const char *filename) const;
+
+private:
+    // Call stacks form a tree: each node is one subroutine entered from its parent's stack
+    struct StackNode
+    {
+        uint16_t address; // subroutine entry, from the 2nnn that pushed the return address
+        uint32_t parent;
+        uint64_t count;   // instructions executed with exactly this stack
+        std::vector<uint32_t> children;
+    };
+    uint32_t Child(uint32_t parent, uint16_t address);
+
+    void EndBlock()
+    {
+        if (lastPC >= blockStart && lastPC < MEMORY_SIZE)
+        {
+            blockInstructions[blockStart] += (lastPC - blockStart) / 2u + 1u;
+            blockEnd[blockStart] = std::max<uint16_t>(blockEnd[blockStart], static_cast<uint16_t>(lastPC));
+        }
+    }
+
+    uint64_t pcCount[MEMORY_SIZE]{};
+    uint16_t pcOpcode[MEMORY_SIZE]{};
+    uint64_t blockEntries[MEMORY_SIZE]{};
+    uint64_t blockInstructions[MEMORY_SIZE]{};
+    uint16_t blockEnd[MEMORY_SIZE]{};
+    uint64_t familyCount[FAMILY_COUNT]{};
+    uint64_t sampledNs[FAMILY_COUNT]{};
+    uint64_t samples[FAMILY_COUNT]{};
+    uint32_t blockStart = MEMORY_SIZE;
+    uint32_t lastPC = MEMORY_SIZE;
+    uint32_t nextPC = MEMORY_SIZE;
+    uint32_t sinceSample = 0;
+    std::vector<StackNode> stacks{StackNode{START_ADDRESS, 0, 0, {}}};
+    uint32_t currentStack = 0;
+    int stackDepth = 0;
+};
+
+// Shared by every Chip8 instance in the process
+extern Profiler profiler;
+
+#endif // CHIP8_PROFILE
+
+#endif // PROFILER_HPP
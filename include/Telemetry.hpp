@@ -0,0 +1,83 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#pragma once
+
+#include "Latency.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+const uint64_t TELEMETRY_INTERVAL_NS = 1000000000ull; // rates and the metrics file are refreshed once a second
+
+// User plus kernel CPU time of the whole process, all threads. std::clock is wall time on Windows.
+uint64_t ProcessCpuNs();
+
+// Rates and percentiles over the last interval, plus running totals
+struct TelemetrySnapshot
+{
+    double instructionsPerSecond;
+    double emulatedFps;
+    double hostFps;      // presented frames per second
+    double realtimeRatio; // emulated time / wall time; below 1 the session is falling behind
+    double frameP50Ms;   // host time between presents
+    double frameP99Ms;
+    double frameMaxMs;
+    double cpuPercent;   // process CPU time / wall time, all threads
+    double cpuSeconds;
+    uint64_t instructions;
+    uint64_t emulatedFrames;
+    uint64_t presentedFrames;
+    uint64_t uploadsSkipped;
+    double behindMs; // emulated time dropped because the host could not catch up
+};
+
+// Counters are relaxed atomics so any thread can add to them; Presented and Tick belong to the main loop
+class Telemetry
+{
+public:
+    void FrameEmulated(uint64_t cycles, uint64_t frames = 1)
+    {
+        instructions.fetch_add(cycles, std::memory_order_relaxed);
+        emulatedFrames.fetch_add(frames, std::memory_order_relaxed);
+    }
+    void UploadSkipped()
+    {
+        uploadsSkipped.fetch_add(1, std::memory_order_relaxed);
+    }
+    void FellBehind(double ms)
+    {
+        behindUs.fetch_add(static_cast<uint64_t>(ms * 1000.0), std::memory_order_relaxed);
+    }
+    void Presented(uint64_t nowNs);
+
+    // Refreshes the snapshot once per interval and rewrites the metrics file if one is set
+    void Tick(uint64_t nowNs);
+    const TelemetrySnapshot &getSnapshot() const;
+    void setMetricsFile(const char *filename);
+    // Milliseconds from launch to the first guest instruction and to the first present
+    void setStartup(double firstInstructionMs, double firstFrameMs);
+
+private:
+    bool WriteMetrics() const;
+
+    std::atomic<uint64_t> instructions{};
+    std::atomic<uint64_t> emulatedFrames{};
+    std::atomic<uint64_t> presentedFrames{};
+    std::atomic<uint64_t> uploadsSkipped{};
+    std::atomic<uint64_t> behindUs{};
+
+    LatencyHistogram frameTimes; // this interval only
+    uint64_t lastPresentNs{};
+    uint64_t intervalStartNs{};
+    uint64_t intervalInstructions{};
+    uint64_t intervalEmulated{};
+    uint64_t intervalPresented{};
+    uint64_t intervalCpuNs{};
+    TelemetrySnapshot snapshot{};
+    std::string metricsFile;
+    double startupInstructionMs{};
+    double startupFrameMs{}; // 0 until the first present
+};
+
+#endif // TELEMETRY_HPP
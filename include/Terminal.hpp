@@ -0,0 +1,46 @@
+#ifndef TERMINAL_HPP
+#define TERMINAL_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <cstdint>
+#include <string>
+
+const unsigned int TERMINAL_ROWS = VIDEO_HEIGHT / 2; // two pixels per character cell
+const unsigned int TERMINAL_KEY_HOLD_FRAMES = 6;     // terminals report presses but not releases
+
+// Text-mode frontend for SSH sessions: draws the display with Unicode half blocks and reads the keypad
+// from stdin in raw mode. Each frame only the cells that changed are rewritten, so an idle screen costs
+// nothing and a moving sprite a few dozen bytes.
+class Terminal
+{
+public:
+    ~Terminal();
+    bool Open(const char *title); // false unless stdin and stdout are terminals
+    void Close();                 // restores the terminal's mode and screen
+
+    // Same keypad layout as the window. A key counts as held for TERMINAL_KEY_HOLD_FRAMES calls after
+    // each byte the terminal sends for it, so holding a key relies on the terminal's key repeat.
+    // Returns true on Esc or Ctrl-C.
+    bool ProcessInput(uint8_t *keys);
+    void Update(const uint64_t *video);
+
+    uint64_t getFrames() const;
+    uint64_t getBytes() const;
+
+private:
+    void MoveTo(unsigned int row, unsigned int column);
+    void Cell(const uint64_t *video, unsigned int row, unsigned int column);
+    void Flush();
+
+    bool open{};
+    bool drawn{}; // shown[] matches the screen
+    uint64_t shown[VIDEO_HEIGHT]{};
+    unsigned int held[16]{};
+    std::string out;
+    uint64_t frames{};
+    uint64_t bytes{};
+};
+
+#endif // TERMINAL_HPP
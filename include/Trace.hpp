@@ -0,0 +1,68 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+const size_t TRACE_BUFFER_EVENTS = 1u << 19; // per thread; events past this are counted and dropped
+
+struct TraceEvent
+{
+    const char *name; // must outlive the trace: string literals or __func__
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// Chrome trace-event recorder (loads in Perfetto and about:tracing). Each thread appends to its own
+// buffer without locking; Write reads them once recording threads are done.
+class Trace
+{
+public:
+    static void Start();
+    static bool Write(const char *filename);
+    static void SetThreadName(const char *name);
+
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+    static uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static void Record(const char *name, uint64_t startNs, uint64_t endNs);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+// Times its own lifetime; costs one relaxed load when tracing is off
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name) : name(name), startNs(Trace::isEnabled() ? Trace::Now() : 0) {}
+    ~TraceScope()
+    {
+        if (startNs)
+        {
+            Trace::Record(name, startNs, Trace::Now());
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t startNs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+
+#endif // TRACE_HPP
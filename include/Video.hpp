@@ -0,0 +1,23 @@
+#ifndef VIDEO_HPP
+#define VIDEO_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <cstdint>
+
+const uint32_t PIXEL_ON = 0xFFFFFFFF;
+const uint32_t PIXEL_OFF = 0x00000000;
+
+// Expands Chip8::video (one bit per pixel) into VIDEO_WIDTH * VIDEO_HEIGHT RGBA pixels for display.
+// Both functions run the best PixelKernels variant for this CPU.
+void ExpandVideo(const uint64_t *rows, uint32_t *pixels);
+
+const uint8_t LUMA_ON = 0xFF;
+const uint8_t LUMA_OFF = 0x00;
+
+// Expands Chip8::video into an 8-bit greyscale image scaled up by an integer factor:
+// (VIDEO_WIDTH * scale) * (VIDEO_HEIGHT * scale) bytes, rows packed
+void ScaleVideoLuma(const uint64_t *rows, unsigned int scale, uint8_t *luma);
+
+#endif // VIDEO_HPP
@@ -0,0 +1,86 @@
+#ifndef VIDEO_WALL_HPP
+#define VIDEO_WALL_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const unsigned int WALL_MAX_INSTANCES = 1024;
+const unsigned int WALL_GAP = 1;             // pixels between tiles
+const unsigned int WALL_INLINE_TILES = 8;    // fewer changed tiles than this are expanded without waking the workers
+const uint8_t LUMA_GAP = 0x40;               // grey between tiles and in unused grid cells
+const uint32_t PIXEL_GAP = 0xFF404040;       // the same grey as SDL_PIXELFORMAT_ABGR8888
+
+enum WallFormat
+{
+    WALL_LUMA, // one byte per pixel, for GlRenderer
+    WALL_RGBA  // SDL_PIXELFORMAT_ABGR8888, for SDL_Renderer
+};
+
+// Tiles the displays of many instances into one atlas image, so a host frame costs one texture update
+// and one draw however many instances there are. Compose compares each instance's frame with the one it
+// drew last and only expands the tiles that changed; when there are enough of them they are shared out
+// between worker threads. The rows it rewrote form one band, which is all that needs uploading.
+class VideoWall
+{
+public:
+    ~VideoWall();
+    // Lays the tiles out in a grid about twice as wide as it is tall, like the display itself.
+    // threads = 0 uses every core; the calling thread expands tiles too.
+    bool Open(unsigned int instances, WallFormat format, unsigned int threads = 0);
+    void Close();
+
+    // videos[i] is instance i's Chip8::video
+    void Compose(const uint64_t *const *videos);
+
+    const uint8_t *getPixels() const;
+    size_t getPitch() const; // bytes
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    WallFormat getFormat() const;
+    // Rows rewritten by the last Compose: [getDirtyTop(), getDirtyTop() + getDirtyRows())
+    unsigned int getDirtyTop() const;
+    unsigned int getDirtyRows() const;
+    uint64_t getTilesDrawn() const;
+    uint64_t getTilesSkipped() const;
+    unsigned int getThreads() const; // including the caller
+
+private:
+    void WorkerLoop();
+    void ExpandTiles(); // takes changed tiles until none are left
+    void ExpandTile(unsigned int tile);
+
+    unsigned int instances{};
+    unsigned int columns{};
+    unsigned int width{};
+    unsigned int height{};
+    WallFormat format{};
+    size_t pitch{};
+    std::vector<uint8_t> pixels;
+    std::vector<uint64_t> shown; // VIDEO_HEIGHT rows per tile, as last expanded
+    bool drawn{};                // shown[] matches pixels[]
+    unsigned int dirtyTop{};
+    unsigned int dirtyRows{};
+    uint64_t tilesDrawn{};
+    uint64_t tilesSkipped{};
+
+    // The batch the workers are expanding
+    std::vector<unsigned int> changed;
+    std::atomic<size_t> nextTile{};
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t batch{};    // incremented to hand the workers a new batch
+    unsigned int busy{}; // workers still expanding the current batch
+    bool stopping{};
+};
+
+#endif // VIDEO_WALL_HPP
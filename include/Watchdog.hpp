@@ -0,0 +1,24 @@
+#ifndef WATCHDOG_HPP
+#define WATCHDOG_HPP
+
+#pragma once
+
+#include "Chip8.hpp"
+
+// Frame-level limits for batch runs, so a ROM that has stopped doing anything useful ends early instead
+// of using up its time budget. PC range limits are checked per instruction by Chip8::setPCRange.
+class Watchdog
+{
+public:
+    void setStallFrames(uint32_t frames); // 0 turns the stall check off
+    // Call once per emulated frame; FAULT_STALLED once the display has been identical for stallFrames
+    GuestFault Frame(const Chip8 &chip8);
+    uint32_t getUnchangedFrames() const;
+
+private:
+    uint32_t stallFrames{};
+    uint32_t unchangedFrames{};
+    uint64_t lastVideoHash{};
+};
+
+#endif // WATCHDOG_HPP
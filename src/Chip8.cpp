@@ -1,4 +1,9 @@
 #include "Chip8.hpp"
+#include "ExecTrace.hpp"
+#include "FlightRecorder.hpp"
+#include "PixelKernels.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstring>
@@ -24,18 +29,36 @@ uint8_t fontset[FONTSET_SIZE] =
         0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
+
+// FNV-1a, used for ROM identity and frame comparison
+static uint64_t Hash(const void *data, size_t size, uint64_t hash = 0xCBF29CE484222325ull)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
 uint8_t Chip8::getRandomByte()
 {
-    static std::random_device rd;  // Seed generator
-    static std::mt19937 gen(rd()); // Mersenne Twister PRNG
-    static std::uniform_int_distribution<uint16_t> dist(0, 255);
-    return static_cast<uint8_t>(dist(gen));
+    // xorshift32: per-instance, seedable and only 4 bytes of state to snapshot
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return static_cast<uint8_t>(rngState >> 24);
 }
 Chip8::Chip8()
 {
     // initialize PC (0x200)
     PC = START_ADDRESS;
 
+    // nondeterministic unless a movie or the command line asks for a seed
+    std::random_device rd;
+    Seed(rd());
+
     // load fonts into memory
     for (unsigned int i = 0; i < FONTSET_SIZE; ++i)
     {
@@ -59,7 +82,8 @@ Chip8::Chip8()
     table[0xE] = &Chip8::TableE;
     table[0xF] = &Chip8::TableF;
 
-    for (size_t i = 0; i <= 0xE; i++)
+    // Every sub-opcode has an entry, so unknown opcodes dispatch to OP_NULL instead of past the table
+    for (size_t i = 0; i <= 0xF; i++)
     {
         table0[i] = &Chip8::OP_NULL;
         table8[i] = &Chip8::OP_NULL;
@@ -82,7 +106,7 @@ Chip8::Chip8()
     tableE[0x1] = &Chip8::OP_ExA1;
     tableE[0xE] = &Chip8::OP_Ex9E;
 
-    for (size_t i = 0; i <= 0x65; i++)
+    for (size_t i = 0; i <= 0xFF; i++)
     {
         tableF[i] = &Chip8::OP_NULL;
     }
@@ -97,35 +121,89 @@ Chip8::Chip8()
     tableF[0x55] = &Chip8::OP_Fx55;
     tableF[0x65] = &Chip8::OP_Fx65;
 }
-void Chip8::LoadROM(char const *filename)
+bool Chip8::LoadROM(char const *filename)
 {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    // Checked before reading, then read straight into memory with no intermediate buffer
+    std::streamoff size = file.tellg();
+    if (size < 0 || size > MEMORY_SIZE - START_ADDRESS)
+    {
+        return false;
+    }
+    file.seekg(0, std::ios::beg);
+    if (!file.read(reinterpret_cast<char *>(&memory[START_ADDRESS]), size))
+    {
+        return false;
+    }
+    romHash = Hash(&memory[START_ADDRESS], static_cast<size_t>(size));
+    return true;
+}
 
-    if (file.is_open())
+bool Chip8::LoadProgram(const uint8_t *program, size_t size)
+{
+    if (size > MEMORY_SIZE - START_ADDRESS)
     {
-        std::streampos size = file.tellg();
-        char *buffer = new char[size];
-        file.seekg(0, std::ios::beg);
-        file.read(buffer, size);
-        file.close();
-        for (long i = 0; i < size; ++i)
-        {
-            memory[START_ADDRESS + i] = buffer[i];
-        }
-        delete[] buffer;
+        return false;
     }
+    memcpy(&memory[START_ADDRESS], program, size);
+    romHash = Hash(program, size);
+    return true;
 }
 
 void Chip8::Cycle()
 {
     // Fetch
+    if (static_cast<uint16_t>(PC - pcLow) > pcSpan)
+    {
+        if (PC > MEMORY_SIZE - 2)
+        {
+            Fault(FAULT_MEMORY_BOUNDS, PC);
+            PC &= MEMORY_SIZE - 2;
+        }
+        else
+        {
+            Fault(FAULT_PC_RANGE, PC);
+        }
+    }
     opcode = (memory[PC] << 8u) | memory[PC + 1];
+    uint16_t fetchedFrom = PC;
+    if (flightRecorder)
+    {
+        flightRecorder->Record(PC, opcode, SP, index);
+    }
+
+#ifdef CHIP8_PROFILE
+    if (SP != profiler.getStackDepth())
+    {
+        profiler.StackChanged(memory, stack, SP);
+    }
+    uint16_t profiledOpcode = opcode;
+    bool timed = profiler.Executed(PC, opcode);
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+#endif
 
     // Increment the PC before we execute anything
     PC += 2;
     // Decode and Execute
     ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
 
+    if (execTrace)
+    {
+        execTrace->Record(fetchedFrom, opcode, index, registers[(opcode & 0x0F00u) >> 8u], registers[0xF]);
+    }
+
+#ifdef CHIP8_PROFILE
+    if (timed)
+    {
+        profiler.Sampled(profiledOpcode, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now() - start).count());
+    }
+#endif
+
     // Decrement the delay timer if it's been set
     if (delay_timer > 0)
     {
@@ -138,6 +216,201 @@ void Chip8::Cycle()
         --sound_timer;
     }
 }
+GuestFault Chip8::RunFrame(unsigned int cycles)
+{
+    for (unsigned int i = 0; i < cycles; ++i)
+    {
+        Cycle();
+    }
+    return fault;
+}
+
+void Chip8::setExecTrace(ExecTraceWriter *writer)
+{
+    execTrace = writer;
+}
+
+ExecTraceWriter *Chip8::getExecTrace() const
+{
+    return execTrace;
+}
+
+void Chip8::setFlightRecorder(FlightRecorder *recorder)
+{
+    flightRecorder = recorder;
+}
+
+FlightRecorder *Chip8::getFlightRecorder() const
+{
+    return flightRecorder;
+}
+
+GuestFault Chip8::getFault() const
+{
+    return fault;
+}
+
+uint16_t Chip8::getFaultPC() const
+{
+    return faultPC;
+}
+
+void Chip8::clearFault()
+{
+    fault = FAULT_NONE;
+}
+
+void Chip8::setPCRange(uint16_t low, uint16_t high)
+{
+    // Fetches past the end of memory are always out of range
+    high = std::min<uint16_t>(high, MEMORY_SIZE - 2);
+    pcLow = std::min(low, high);
+    pcSpan = high - pcLow;
+}
+
+void Chip8::Fault(GuestFault kind, uint16_t address)
+{
+    if (fault == FAULT_NONE)
+    {
+        fault = kind;
+        faultPC = address;
+    }
+    if (flightRecorder)
+    {
+        flightRecorder->DumpFault(kind);
+    }
+}
+
+const char *GuestFaultName(GuestFault fault)
+{
+    static const char *names[FAULT_COUNT] = {"none", "invalid opcode", "stack overflow", "stack underflow",
+                                             "memory access out of bounds", "invalid key", "PC out of range",
+                                             "display stalled"};
+    return fault < FAULT_COUNT ? names[fault] : "unknown";
+}
+
+void Chip8::Seed(uint32_t value)
+{
+    seed = value;
+    rngState = value ? value : 0x9E3779B9u; // xorshift must not start at zero
+}
+
+void Chip8::SaveState(Chip8State &state) const
+{
+    memcpy(state.memory, memory, sizeof(memory));
+    memcpy(state.registers, registers, sizeof(registers));
+    memcpy(state.stack, stack, sizeof(stack));
+    state.index = index;
+    state.PC = PC;
+    state.SP = SP;
+    state.opcode = opcode;
+    state.sound_timer = sound_timer;
+    state.delay_timer = delay_timer;
+    memcpy(state.keypad, keypad, sizeof(keypad));
+    memcpy(state.video, video, sizeof(video));
+    state.rngState = rngState;
+}
+
+void Chip8::LoadState(const Chip8State &state)
+{
+    memcpy(memory, state.memory, sizeof(memory));
+    memcpy(registers, state.registers, sizeof(registers));
+    memcpy(stack, state.stack, sizeof(stack));
+    index = state.index;
+    PC = state.PC;
+    SP = state.SP;
+    opcode = state.opcode;
+    sound_timer = state.sound_timer;
+    delay_timer = state.delay_timer;
+    memcpy(keypad, state.keypad, sizeof(keypad));
+    memcpy(video, state.video, sizeof(video));
+    rngState = state.rngState;
+#ifdef CHIP8_PROFILE
+    profiler.InvalidateStack();
+#endif
+}
+
+void Chip8::SaveLatches(Chip8Latches &latches) const
+{
+    latches.fault = fault;
+    latches.faultPC = faultPC;
+    latches.keypadPolled = keypadPolled;
+    latches.polledBeforeDraw = polledBeforeDraw;
+    latches.videoChanged = videoChanged;
+    latches.recorderSteps = flightRecorder ? flightRecorder->getSteps() : 0;
+}
+
+void Chip8::LoadLatches(const Chip8Latches &latches)
+{
+    fault = latches.fault;
+    faultPC = latches.faultPC;
+    keypadPolled = latches.keypadPolled;
+    polledBeforeDraw = latches.polledBeforeDraw;
+    videoChanged = latches.videoChanged;
+    if (flightRecorder)
+    {
+        flightRecorder->Rewind(latches.recorderSteps);
+    }
+}
+
+SpeculativeRun::SpeculativeRun(Chip8 &machine)
+    : chip8(machine), execTrace(machine.getExecTrace()), flightRecorder(machine.getFlightRecorder())
+{
+    chip8.SaveLatches(latches);
+    chip8.setExecTrace(nullptr);
+    chip8.setFlightRecorder(nullptr);
+}
+
+SpeculativeRun::~SpeculativeRun()
+{
+    chip8.setExecTrace(execTrace);
+    chip8.setFlightRecorder(flightRecorder);
+    chip8.LoadLatches(latches);
+}
+
+void Chip8::setKeypadMask(uint16_t mask)
+{
+    for (unsigned int key = 0; key < 16; ++key)
+    {
+        keypad[key] = (mask >> key) & 1u;
+    }
+}
+
+uint16_t Chip8::getKeypadMask() const
+{
+    uint16_t mask = 0;
+    for (unsigned int key = 0; key < 16; ++key)
+    {
+        if (keypad[key])
+        {
+            mask |= 1u << key;
+        }
+    }
+    return mask;
+}
+
+uint64_t Chip8::HashVideo() const
+{
+    return Hash(video, sizeof(video));
+}
+
+uint64_t Chip8::HashState(const Chip8State &state)
+{
+    // Field by field so padding bytes never reach the hash
+    uint64_t hash = Hash(state.memory, sizeof(state.memory));
+    hash = Hash(state.registers, sizeof(state.registers), hash);
+    hash = Hash(state.stack, sizeof(state.stack), hash);
+    hash = Hash(&state.index, sizeof(state.index), hash);
+    hash = Hash(&state.PC, sizeof(state.PC), hash);
+    hash = Hash(&state.SP, sizeof(state.SP), hash);
+    hash = Hash(&state.opcode, sizeof(state.opcode), hash);
+    hash = Hash(&state.sound_timer, sizeof(state.sound_timer), hash);
+    hash = Hash(&state.delay_timer, sizeof(state.delay_timer), hash);
+    hash = Hash(state.keypad, sizeof(state.keypad), hash);
+    hash = Hash(state.video, sizeof(state.video), hash);
+    return Hash(&state.rngState, sizeof(state.rngState), hash);
+}
+
 uint8_t *Chip8::getRegisters()
 {
     return registers;
@@ -176,24 +449,128 @@ uint8_t *Chip8::getMemory()
 }
 std::string Chip8::getInstruction()
 {
-    return instruction;
+    // Disassembled on demand so the interpreter does not build a string per instruction
+    std::string Vx = std::to_string((opcode & 0x0F00u) >> 8u);
+    std::string Vy = std::to_string((opcode & 0x00F0u) >> 4u);
+    std::string byte = std::to_string(opcode & 0x00FFu);
+    std::string address = std::to_string(opcode & 0x0FFFu);
+    switch (opcode >> 12u)
+    {
+    case 0x0:
+        if (opcode == 0x00E0)
+            return "Clear the display";
+        if (opcode == 0x00EE)
+            return "Return from a subroutine";
+        break;
+    case 0x1:
+        return "JP addr " + address;
+    case 0x2:
+        return "CALL addr " + address;
+    case 0x3:
+        return "SE Vx, byte " + Vx + ", " + byte;
+    case 0x4:
+        return "SNE Vx, byte " + Vx + ", " + byte;
+    case 0x5:
+        return "SE Vx, Vy " + Vx + ", " + Vy;
+    case 0x6:
+        return "LD Vx, byte " + Vx + ", " + byte;
+    case 0x7:
+        return "ADD Vx, byte " + Vx + ", " + byte;
+    case 0x8:
+        switch (opcode & 0x000Fu)
+        {
+        case 0x0:
+            return "LD Vx, Vy " + Vx + ", " + Vy;
+        case 0x1:
+            return "OR Vx, Vy " + Vx + ", " + Vy;
+        case 0x2:
+            return "AND Vx, Vy " + Vx + ", " + Vy;
+        case 0x3:
+            return "XOR Vx, Vy " + Vx + ", " + Vy;
+        case 0x4:
+            return "ADD Vx, Vy " + Vx + ", " + Vy;
+        case 0x5:
+            return "SUB Vx, Vy " + Vx + ", " + Vy;
+        case 0x6:
+            return "SHR Vx " + Vx;
+        case 0x7:
+            return "SUBN Vx, Vy " + Vx + ", " + Vy;
+        case 0xE:
+            return "SHL Vx " + Vx;
+        }
+        break;
+    case 0x9:
+        return "SNE Vx, Vy " + Vx + ", " + Vy;
+    case 0xA:
+        return "LD I, addr " + address;
+    case 0xB:
+        return "JP V0, addr " + address;
+    case 0xC:
+        return "RND Vx, byte " + Vx + ", " + byte;
+    case 0xD:
+        return "DRW Vx, Vy " + Vx + " " + Vy;
+    case 0xE:
+        if ((opcode & 0x00FFu) == 0x9E)
+            return "SKP Vx " + Vx;
+        if ((opcode & 0x00FFu) == 0xA1)
+            return "SKNP Vx " + Vx;
+        break;
+    case 0xF:
+        switch (opcode & 0x00FFu)
+        {
+        case 0x07:
+            return "LD Vx " + Vx + ", DT";
+        case 0x0A:
+            return "LD Vx " + Vx + ", K";
+        case 0x15:
+            return "LD DT, Vx " + Vx;
+        case 0x18:
+            return "LD ST, Vx " + Vx;
+        case 0x1E:
+            return "ADD I, Vx " + Vx;
+        case 0x29:
+            return "LD F, Vx " + Vx;
+        case 0x33:
+            return "LD B, V " + Vx;
+        case 0x55:
+            return "LD [I], V " + Vx;
+        case 0x65:
+            return "LD V " + Vx + ", [I]";
+        }
+        break;
+    }
+    return "NULL";
+}
+uint32_t Chip8::getSeed() const
+{
+    return seed;
+}
+uint64_t Chip8::getRomHash() const
+{
+    return romHash;
 }
 void Chip8::OP_NULL()
 {
-    instruction = "NULL";
+    // unknown opcode: ignored
+    Fault(FAULT_INVALID_OPCODE, PC - 2);
 }
 
 void Chip8::OP_00E0() //clear the display
 {
-    memset(video, 0, sizeof(video)); //set all the bytes in the video variable to 0.
-    instruction = "Clear the display";
+    pixelKernels->clearVideo(video); //set all the bits in the video rows to 0.
+    videoChanged = true;
+    polledBeforeDraw |= keypadPolled;
 }
 
 void Chip8::OP_00EE() //RET: Return from a subroutine.
 {
+    if (SP == 0)
+    {
+        Fault(FAULT_STACK_UNDERFLOW, PC - 2);
+        return;
+    }
     --SP;
     PC = stack[SP];
-    instruction = "Return from a subroutine";
 }
 
 void Chip8::OP_1nnn() //JP addr: Jump to location nnn.
@@ -201,17 +578,20 @@ void Chip8::OP_1nnn() //JP addr: Jump to location nnn.
     uint16_t address = opcode & 0x0FFFu;
 
     PC = address;
-    instruction = "JP addr " + std::to_string(address);
 }
 
 void Chip8::OP_2nnn() // CALL addr: Call subroutine at nnn.
 {
     uint16_t address = opcode & 0x0FFFu;
 
+    if (SP == STACK_LEVELS)
+    {
+        Fault(FAULT_STACK_OVERFLOW, PC - 2);
+        return;
+    }
     stack[SP] = PC;
     ++SP;
     PC = address;
-    instruction = "CALL addr " + std::to_string(address);
 }
 
 void Chip8::OP_3xkk() // SE Vx, byte: Skip next instruction if Vx = kk.
@@ -223,7 +603,6 @@ void Chip8::OP_3xkk() // SE Vx, byte: Skip next instruction if Vx = kk.
     {
         PC += 2;
     }
-    instruction = "SE Vx, byte " + std::to_string(Vx) + ", " + std::to_string(byte);
 }
 
 void Chip8::OP_4xkk() // SNE Vx, byte: Skip next instruction if Vx != kk.
@@ -235,7 +614,6 @@ void Chip8::OP_4xkk() // SNE Vx, byte: Skip next instruction if Vx != kk.
     {
         PC += 2;
     }
-    instruction = "SNE Vx, byte " + std::to_string(Vx) + ", " + std::to_string(byte);
 }
 
 void Chip8::OP_5xy0() //SE Vx, Vy: Skip next instruction if Vx = Vy.
@@ -247,7 +625,6 @@ void Chip8::OP_5xy0() //SE Vx, Vy: Skip next instruction if Vx = Vy.
     {
         PC += 2;
     }
-    instruction = "SE Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
 }
 
 void Chip8::OP_6xkk() //LD Vx, byte : Set Vx = kk.
@@ -256,7 +633,6 @@ void Chip8::OP_6xkk() //LD Vx, byte : Set Vx = kk.
     uint8_t byte = opcode & 0x00FFu;
 
     registers[Vx] = byte;
-    instruction = "LD Vx, byte " + std::to_string(Vx) + ", " + std::to_string(byte);
 }
 
 void Chip8::OP_7xkk() // ADD Vx, byte : Set Vx = Vx + kk.
@@ -265,7 +641,6 @@ void Chip8::OP_7xkk() // ADD Vx, byte : Set Vx = Vx + kk.
     uint8_t byte = opcode & 0x00FFu;
 
     registers[Vx] += byte;
-    instruction = "ADD Vx, byte " + std::to_string(Vx) + ", " + std::to_string(byte);
 }
 
 void Chip8::OP_8xy0() //LD Vx, Vy: Set Vx = Vy.
@@ -274,7 +649,6 @@ void Chip8::OP_8xy0() //LD Vx, Vy: Set Vx = Vy.
     uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
     registers[Vx] = registers[Vy];
-    instruction = "LD Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
 }
 
 void Chip8::OP_8xy1() //OR Vx, Vy : Set Vx = Vx OR Vy.
@@ -283,8 +657,6 @@ void Chip8::OP_8xy1() //OR Vx, Vy : Set Vx = Vx OR Vy.
     uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
     registers[Vx] |= registers[Vy];
-    instruction = "OR Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
-    
 }
 
 void Chip8::OP_8xy2() //AND Vx, Vy : Set Vx = Vx AND Vy
@@ -293,7 +665,6 @@ void Chip8::OP_8xy2() //AND Vx, Vy : Set Vx = Vx AND Vy
     uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
     registers[Vx] &= registers[Vy];
-    instruction = "AND Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
 }
  
 void Chip8::OP_8xy3() //XOR Vx, Vy: Set Vx = Vx XOR Vy.
@@ -302,7 +673,6 @@ void Chip8::OP_8xy3() //XOR Vx, Vy: Set Vx = Vx XOR Vy.
     uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
     registers[Vx] ^= registers[Vy];
-    instruction = "XOR Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
 }
 
 void Chip8::OP_8xy4() //ADD Vx, Vy: Set Vx = Vx + Vy, set VF = carry.
@@ -320,7 +690,6 @@ void Chip8::OP_8xy4() //ADD Vx, Vy: Set Vx = Vx + Vy, set VF = carry.
     {
         registers[0xF] = 0;
     }
-    instruction = "ADD Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
     registers[Vx] = sum & 0xFFu;
 }
 
@@ -337,7 +706,6 @@ void Chip8::OP_8xy5() //SUB Vx, Vy: Set Vx = Vx - Vy, set VF = NOT borrow.
     {
         registers[0xF] = 0;
     }
-    instruction = "SUB Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
     registers[Vx] -= registers[Vy];
 }
 
@@ -348,7 +716,6 @@ void Chip8::OP_8xy6() //SHR Set Vx = Vx SHR 1.
     // Save LSB in VF
     registers[0xF] = (registers[Vx] & 0x1u);
     registers[Vx] >>= 1;
-    instruction = "SHR Vx " + std::to_string(Vx);
 }
 
 void Chip8::OP_8xy7() //SUBN Vx, Vy: Set Vx = Vy - Vx, set VF = NOT borrow.
@@ -364,7 +731,6 @@ void Chip8::OP_8xy7() //SUBN Vx, Vy: Set Vx = Vy - Vx, set VF = NOT borrow.
     {
         registers[0xF] = 0;
     }
-    instruction = "SUBN Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
     registers[Vx] = registers[Vy] - registers[Vx];
 }
 
@@ -376,7 +742,6 @@ void Chip8::OP_8xyE() // SHL Set Vx = Vx SHL 1.
     registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
 
     registers[Vx] <<= 1;
-    instruction = "SHL Vx " + std::to_string(Vx);
 }
 
 void Chip8::OP_9xy0() //SNE Vx, Vy: Skip next instruction if Vx != Vy.
@@ -388,15 +753,12 @@ void Chip8::OP_9xy0() //SNE Vx, Vy: Skip next instruction if Vx != Vy.
     {
         PC += 2;
     }
-    instruction = "SNE Vx, Vy " + std::to_string(Vx) + ", " + std::to_string(Vy);
 }
 
 void Chip8::OP_Annn() //LD I, addr: Set I = nnn.
 {
     uint16_t address = opcode & 0x0FFFu;
-    instruction = "LD I, addr " + std::to_string(index)  + ", " + std::to_string(address);
     index = address;
-    
 }
 
 void Chip8::OP_Bnnn() // JP V0, addr: Jump to location nnn + V0.
@@ -404,7 +766,6 @@ void Chip8::OP_Bnnn() // JP V0, addr: Jump to location nnn + V0.
     uint16_t address = opcode & 0x0FFFu;
 
     PC = registers[0] + address;
-    instruction = "JP V0, addr " + std::to_string(registers[0]) + ", " + std::to_string(address);
 }
 
 void Chip8::OP_Cxkk() // RND Vx, byte: Set Vx = random byte AND kk.
@@ -413,7 +774,6 @@ void Chip8::OP_Cxkk() // RND Vx, byte: Set Vx = random byte AND kk.
     uint8_t byte = opcode & 0x00FFu;
 
     registers[Vx] = getRandomByte() & byte;
-    instruction = "RND Vx, byte " + std::to_string(Vx) + ", " + std::to_string(byte);
 }
 
 void Chip8::OP_Dxyn() //DRW Vx, Vy, nibble: Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
@@ -422,33 +782,34 @@ void Chip8::OP_Dxyn() //DRW Vx, Vy, nibble: Display n-byte sprite starting at me
     uint8_t Vy = (opcode & 0x00F0u) >> 4u;
     uint8_t height = opcode & 0x000Fu;
 
-    // Wrap if going beyond screen boundaries
+    // Wrap the starting position; the sprite itself is clipped at the right and bottom edges
     uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
     uint8_t yPos = registers[Vy] % VIDEO_HEIGHT;
 
     registers[0xF] = 0;
-
-    for (unsigned int row = 0; row < height; ++row)
+    videoChanged = true;
+    polledBeforeDraw |= keypadPolled;
+    if (index + height > MEMORY_SIZE)
     {
-        uint8_t spriteByte = memory[index + row];
+        Fault(FAULT_MEMORY_BOUNDS, PC - 2);
+    }
 
-        for (unsigned int col = 0; col < 8; ++col)
+    // The kernels read 16 sprite bytes; near the end of memory they are gathered with the address wrapped
+    const uint8_t *sprite = memory + index;
+    uint8_t wrapped[16];
+    if (index + sizeof(wrapped) > MEMORY_SIZE)
+    {
+        for (unsigned int row = 0; row < sizeof(wrapped); ++row)
         {
-            uint8_t spritePixel = spriteByte & (0x80u >> col);
-            uint32_t *screenPixel = &video[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
-
-            if (spritePixel)
-            {
-                if (*screenPixel == 0xFFFFFFFF)
-                {
-                    registers[0xF] = 1;
-                }
-
-                *screenPixel ^= 0xFFFFFFFF;
-            }
+            wrapped[row] = memory[(index + row) & (MEMORY_SIZE - 1)];
         }
+        sprite = wrapped;
+    }
+    unsigned int rows = std::min<unsigned int>(height, VIDEO_HEIGHT - yPos);
+    if (pixelKernels->blitSprite(video + yPos, sprite, rows, xPos))
+    {
+        registers[0xF] = 1;
     }
-    instruction = "DRW Vx, Vy " + std::to_string(Vx) + " " + std::to_string(Vy);
 }
 
 void Chip8::OP_Ex9E() //SKP Vx: Skip next instruction if key with the value of Vx is pressed.
@@ -456,12 +817,17 @@ void Chip8::OP_Ex9E() //SKP Vx: Skip next instruction if key with the value of V
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
 
     uint8_t key = registers[Vx];
+    keypadPolled |= 1u << (key & 0xFu);
+    if (key > 0xF)
+    {
+        Fault(FAULT_INVALID_KEY, PC - 2);
+        return;
+    }
 
     if (keypad[key])
     {
         PC += 2;
     }
-    instruction = "SKP Vx " + std::to_string(Vx);
 }
 
 void Chip8::OP_ExA1() //SKNP Vx: Skip next instruction if key with the value of Vx is not pressed.
@@ -469,12 +835,18 @@ void Chip8::OP_ExA1() //SKNP Vx: Skip next instruction if key with the value of
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
 
     uint8_t key = registers[Vx];
+    keypadPolled |= 1u << (key & 0xFu);
+    if (key > 0xF)
+    {
+        Fault(FAULT_INVALID_KEY, PC - 2);
+        PC += 2; // an invalid key is never pressed
+        return;
+    }
 
     if (!keypad[key])
     {
         PC += 2;
     }
-    instruction = "SKNP Vx " + std::to_string(Vx);
 }
 
 void Chip8::OP_Fx07() //LD Vx, DT: Set Vx = delay timer value.
@@ -482,13 +854,12 @@ void Chip8::OP_Fx07() //LD Vx, DT: Set Vx = delay timer value.
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
 
     registers[Vx] = delay_timer;
-
-    instruction = "LD Vx " + std::to_string(Vx) + ", DT";
 }
 
 void Chip8::OP_Fx0A() //LD Vx, K: Wait for a key press, store the value of the key in Vx.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    keypadPolled = 0xFFFFu;
 	for (uint8_t key = 0; key < 16; ++key) {
         if (keypad[key]) {
             registers[Vx] = key;
@@ -496,32 +867,24 @@ void Chip8::OP_Fx0A() //LD Vx, K: Wait for a key press, store the value of the k
         }
     }
     PC -= 2;
-    instruction = "LD Vx " + std::to_string(Vx) + ", K";
-
 }
 
 void Chip8::OP_Fx15()  //LD DT, Vx: Set delay timer = Vx.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
     delay_timer = registers[Vx];
-    instruction = "LD DT, Vx " + std::to_string(Vx);
-
 }
 
 void Chip8::OP_Fx18() //LD ST, Vx: Set sound timer = Vx.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
     sound_timer = registers[Vx];
-    instruction = "LD ST, Vx " + std::to_string(Vx);
-
 }
 
 void Chip8::OP_Fx1E() //ADD I, Vx: Set I = I + Vx.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
     index += registers[Vx];
-    instruction = "ADD I, Vx " + std::to_string(Vx);
-
 }
 
 void Chip8::OP_Fx29()  //LD F, Vx: Set I = location of sprite for digit Vx.
@@ -529,47 +892,52 @@ void Chip8::OP_Fx29()  //LD F, Vx: Set I = location of sprite for digit Vx.
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
     uint8_t digit = registers[Vx];
     index = FONTSET_START_ADDRESS + (5 * digit);
-    instruction = "LD F, Vx " + std::to_string(Vx);
-
 }
 
 void Chip8::OP_Fx33() //LD B, Vx: Store BCD representation of Vx in memory locations I, I+1, and I+2.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
     uint8_t value = registers[Vx];
+    if (index + 3u > MEMORY_SIZE)
+    {
+        Fault(FAULT_MEMORY_BOUNDS, PC - 2);
+    }
     // Ones-place
-    memory[index + 2] = value % 10;
+    memory[(index + 2) & (MEMORY_SIZE - 1)] = value % 10;
     value /= 10;
     // Tens-place
-    memory[index + 1] = value % 10;
+    memory[(index + 1) & (MEMORY_SIZE - 1)] = value % 10;
     value /= 10;
     // Hundreds-place
-    memory[index] = value % 10;
-    instruction = "LD B, V " + std::to_string(Vx);
-
+    memory[index & (MEMORY_SIZE - 1)] = value % 10;
 }
 
 void Chip8::OP_Fx55() //LD [I], Vx: Store registers V0 through Vx in memory starting at location I.
 { 
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    if (index + Vx + 1u > MEMORY_SIZE)
+    {
+        Fault(FAULT_MEMORY_BOUNDS, PC - 2);
+    }
 
     for (uint8_t i = 0; i <= Vx; ++i)
     {
-        memory[index + i] = registers[i];
+        memory[(index + i) & (MEMORY_SIZE - 1)] = registers[i];
     }
-    instruction = "LD [I], V " + std::to_string(Vx);
-
 }
 
 void Chip8::OP_Fx65() //LD Vx, [I]: Read registers V0 through Vx from memory starting at location I.
 {
     uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    if (index + Vx + 1u > MEMORY_SIZE)
+    {
+        Fault(FAULT_MEMORY_BOUNDS, PC - 2);
+    }
 
     for (uint8_t i = 0; i <= Vx; ++i)
     {
-        registers[i] = memory[index + i];
+        registers[i] = memory[(index + i) & (MEMORY_SIZE - 1)];
     }
-    instruction = "LD V " + std::to_string(Vx) + ", [I]";
 }
 
 void Chip8::Table0()
@@ -0,0 +1,476 @@
+#include "ClipRecorder.hpp"
+#include "Png.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+const unsigned int GIF_MIN_CODE_SIZE = 2; // the smallest GIF allows, even for two colours
+const unsigned int GIF_MAX_CODE = 4095;
+const uint64_t GIF_MIN_DELAY_CS = 2;      // viewers stretch shorter delays to 100 ms
+
+static const uint8_t palette[6] = {0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF};
+
+static uint64_t TicksToCentiseconds(uint64_t ticks)
+{
+    return (ticks * 100 + CLIP_TICKS_PER_SECOND / 2) / CLIP_TICKS_PER_SECOND;
+}
+
+static void AppendLittleEndian16(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void AppendBigEndian16(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// GIF LZW codes, packed least significant bit first into 255-byte sub-blocks
+class GifCodeWriter
+{
+public:
+    explicit GifCodeWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    void Code(uint32_t code, unsigned int size)
+    {
+        buffer |= code << used;
+        used += size;
+        while (used >= 8)
+        {
+            Byte(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+    void Finish()
+    {
+        if (used)
+        {
+            Byte(static_cast<uint8_t>(buffer));
+        }
+        if (!block.empty())
+        {
+            EndBlock();
+        }
+        out.push_back(0); // block terminator
+    }
+
+private:
+    void Byte(uint8_t byte)
+    {
+        block.push_back(byte);
+        if (block.size() == 255)
+        {
+            EndBlock();
+        }
+    }
+    void EndBlock()
+    {
+        out.push_back(static_cast<uint8_t>(block.size()));
+        out.insert(out.end(), block.begin(), block.end());
+        block.clear();
+    }
+
+    std::vector<uint8_t> &out;
+    std::vector<uint8_t> block;
+    uint32_t buffer = 0;
+    unsigned int used = 0;
+};
+
+static void GifLzw(const uint8_t *indices, size_t size, std::vector<uint8_t> &out)
+{
+    const uint32_t clearCode = 1u << GIF_MIN_CODE_SIZE;
+    // children[code * 4 + index]: the code for `code` followed by `index`, 0 if there is none yet
+    static thread_local std::vector<uint16_t> children;
+    children.assign((GIF_MAX_CODE + 1) * 4, 0);
+    out.push_back(GIF_MIN_CODE_SIZE);
+    GifCodeWriter codes(out);
+    unsigned int codeSize = GIF_MIN_CODE_SIZE + 1;
+    uint32_t maxCode = clearCode + 1;
+    codes.Code(clearCode, codeSize);
+    uint32_t current = indices[0];
+    for (size_t i = 1; i < size; ++i)
+    {
+        uint32_t next = children[current * 4 + indices[i]];
+        if (next)
+        {
+            current = next;
+            continue;
+        }
+        codes.Code(current, codeSize);
+        children[current * 4 + indices[i]] = static_cast<uint16_t>(++maxCode);
+        if (maxCode >= (1u << codeSize))
+        {
+            ++codeSize;
+        }
+        if (maxCode == GIF_MAX_CODE)
+        {
+            codes.Code(clearCode, codeSize);
+            children.assign(children.size(), 0);
+            codeSize = GIF_MIN_CODE_SIZE + 1;
+            maxCode = clearCode + 1;
+        }
+        current = indices[i];
+    }
+    codes.Code(current, codeSize);
+    // The decoder adds one more entry on reading that code unless it followed a clear, which can widen
+    // the codes after it
+    if (maxCode > clearCode + 1 && maxCode + 1 >= (1u << codeSize) && codeSize < 12)
+    {
+        ++codeSize;
+    }
+    codes.Code(clearCode, codeSize);
+    codes.Code(clearCode + 1, GIF_MIN_CODE_SIZE + 1); // end of information
+    codes.Finish();
+}
+
+ClipRecorder::~ClipRecorder()
+{
+    Stop();
+    Join();
+}
+
+void ClipRecorder::setFormat(ClipFormat clipFormat)
+{
+    format = clipFormat;
+}
+
+void ClipRecorder::setScale(unsigned int clipScale)
+{
+    scale = std::max(1u, clipScale);
+}
+
+bool ClipRecorder::Start()
+{
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "chip8-%Y%m%d-%H%M%S", std::localtime(&now));
+    return Start(std::string(name) + (format == CLIP_GIF ? ".gif" : ".png"));
+}
+
+bool ClipRecorder::Start(const std::string &clipFilename)
+{
+    if (recording)
+    {
+        return false;
+    }
+    Join();
+    file = fopen(clipFilename.c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not create %s\n", clipFilename.c_str());
+        return false;
+    }
+    filename = clipFilename;
+    queue.resize(CLIP_QUEUE_FRAMES);
+    head = 0;
+    count = 0;
+    stopping = false;
+    dropped = 0;
+    tick = 0;
+    recording = true;
+    worker = std::thread(&ClipRecorder::WorkerLoop, this);
+    printf("Recording to %s\n", filename.c_str());
+    return true;
+}
+
+void ClipRecorder::Stop()
+{
+    if (!recording)
+    {
+        return;
+    }
+    recording = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+}
+
+bool ClipRecorder::isRecording() const
+{
+    return recording;
+}
+
+const std::string &ClipRecorder::getFilename() const
+{
+    return filename;
+}
+
+void ClipRecorder::Submit(const uint64_t *video)
+{
+    if (!recording)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == queue.size())
+        {
+            dropped++;
+        }
+        else
+        {
+            QueuedFrame &queued = queue[(head + count) % queue.size()];
+            queued.tick = tick;
+            memcpy(queued.video, video, sizeof(queued.video));
+            count++;
+        }
+        tick++;
+    }
+    changed.notify_all();
+}
+
+void ClipRecorder::Join()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void ClipRecorder::WorkerLoop()
+{
+    Begin();
+    QueuedFrame queued;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        changed.wait(lock, [this] { return count || stopping; });
+        if (!count)
+        {
+            break;
+        }
+        queued = queue[head];
+        head = (head + 1) % queue.size();
+        count--;
+        lock.unlock();
+        Frame(queued);
+        lock.lock();
+    }
+    uint64_t endTick = tick;
+    uint64_t droppedFrames = dropped;
+    lock.unlock();
+
+    if (havePending)
+    {
+        uint64_t minimum = format == CLIP_GIF ? 2 : 1; // two ticks always round to at least 2 cs
+        WriteFrame(std::max(endTick, pendingTick + minimum) - pendingTick);
+    }
+    Finish();
+    long size = ftell(file);
+    bool failed = ferror(file) != 0;
+    failed |= fclose(file) != 0;
+    file = nullptr;
+    if (failed)
+    {
+        fprintf(stderr, "Recording %s is incomplete: write failed\n", filename.c_str());
+        return;
+    }
+    printf("Recorded %llu frames (%u images, %ld KB) to %s", static_cast<unsigned long long>(endTick), frames,
+           size / 1024, filename.c_str());
+    if (droppedFrames)
+    {
+        printf(", %llu frames dropped", static_cast<unsigned long long>(droppedFrames));
+    }
+    printf("\n");
+}
+
+void ClipRecorder::Begin()
+{
+    memset(written, 0, sizeof(written));
+    havePending = false;
+    first = true;
+    frames = 0;
+    sequence = 0;
+    encoded.clear();
+    uint32_t width = VIDEO_WIDTH * scale;
+    uint32_t height = VIDEO_HEIGHT * scale;
+    if (format == CLIP_GIF)
+    {
+        static const uint8_t loop[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E',
+                                       '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
+        const char *signature = "GIF89a";
+        encoded.insert(encoded.end(), signature, signature + 6);
+        AppendLittleEndian16(encoded, width);
+        AppendLittleEndian16(encoded, height);
+        encoded.push_back(0x80); // global colour table of 2 entries
+        encoded.push_back(0);    // background colour
+        encoded.push_back(0);    // square pixels
+        encoded.insert(encoded.end(), palette, palette + sizeof(palette));
+        encoded.insert(encoded.end(), loop, loop + sizeof(loop)); // loop forever
+    }
+    else
+    {
+        BeginPng(encoded, width, height, 3);
+        AppendPngChunk(encoded, "PLTE", palette, sizeof(palette));
+        frameCountAt = static_cast<long>(encoded.size());
+        std::vector<uint8_t> control;
+        AppendBigEndian(control, 0); // frame count, patched by Finish
+        AppendBigEndian(control, 0); // loop forever
+        AppendPngChunk(encoded, "acTL", control.data(), control.size());
+    }
+    fwrite(encoded.data(), 1, encoded.size(), file);
+}
+
+void ClipRecorder::Frame(const QueuedFrame &queued)
+{
+    if (!havePending)
+    {
+        memcpy(pending, queued.video, sizeof(pending));
+        pendingTick = queued.tick;
+        havePending = true;
+        return;
+    }
+    if (memcmp(pending, queued.video, sizeof(pending)) == 0)
+    {
+        return; // the pending frame is shown for longer
+    }
+    if (format == CLIP_GIF && TicksToCentiseconds(queued.tick) - TicksToCentiseconds(pendingTick) < GIF_MIN_DELAY_CS)
+    {
+        // Too short for a GIF delay: this frame replaces the pending one and inherits its start
+        memcpy(pending, queued.video, sizeof(pending));
+        return;
+    }
+    WriteFrame(queued.tick - pendingTick);
+    memcpy(pending, queued.video, sizeof(pending));
+    pendingTick = queued.tick;
+}
+
+void ClipRecorder::Finish()
+{
+    if (format == CLIP_GIF)
+    {
+        fputc(0x3B, file); // trailer
+        return;
+    }
+    encoded.clear();
+    AppendPngChunk(encoded, "IEND", nullptr, 0);
+    fwrite(encoded.data(), 1, encoded.size(), file);
+
+    encoded.clear();
+    std::vector<uint8_t> control;
+    AppendBigEndian(control, frames);
+    AppendBigEndian(control, 0);
+    AppendPngChunk(encoded, "acTL", control.data(), control.size());
+    fseek(file, frameCountAt, SEEK_SET);
+    fwrite(encoded.data(), 1, encoded.size(), file);
+    fseek(file, 0, SEEK_END);
+}
+
+ClipRecorder::Rect ClipRecorder::ChangedRect() const
+{
+    if (first)
+    {
+        return Rect{0, 0, VIDEO_WIDTH, VIDEO_HEIGHT};
+    }
+    unsigned int left = VIDEO_WIDTH, right = 0, top = VIDEO_HEIGHT, bottom = 0;
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint64_t diff = written[y] ^ pending[y];
+        if (diff)
+        {
+            top = std::min(top, y);
+            bottom = y;
+            left = std::min(left, static_cast<unsigned int>(__builtin_clzll(diff)));
+            right = std::max(right, VIDEO_WIDTH - 1 - static_cast<unsigned int>(__builtin_ctzll(diff)));
+        }
+    }
+    if (top == VIDEO_HEIGHT)
+    {
+        // Back to what is already shown after merged frames; a one-pixel frame carries the delay
+        return Rect{0, 0, 1, 1};
+    }
+    return Rect{left, top, right - left + 1, bottom - top + 1};
+}
+
+void ClipRecorder::ScaleRect(const Rect &rect, std::vector<uint8_t> &out) const
+{
+    size_t width = rect.width * scale;
+    out.resize(width * rect.height * scale);
+    uint8_t *line = out.data();
+    for (unsigned int y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        for (unsigned int x = 0; x < rect.width; ++x)
+        {
+            uint8_t index = (pending[y] >> (VIDEO_WIDTH - 1 - rect.x - x)) & 1u;
+            memset(line + x * scale, index, scale);
+        }
+        for (unsigned int copy = 1; copy < scale; ++copy)
+        {
+            memcpy(line + copy * width, line, width);
+        }
+        line += width * scale;
+    }
+}
+
+void ClipRecorder::WriteFrame(uint64_t durationTicks)
+{
+    Rect rect = ChangedRect();
+    ScaleRect(rect, indices);
+    encoded.clear();
+    if (format == CLIP_GIF)
+    {
+        WriteGifFrame(rect, durationTicks);
+    }
+    else
+    {
+        WriteApngFrame(rect, durationTicks);
+    }
+    fwrite(encoded.data(), 1, encoded.size(), file);
+    memcpy(written, pending, sizeof(written));
+    first = false;
+    frames++;
+}
+
+void ClipRecorder::WriteGifFrame(const Rect &rect, uint64_t durationTicks)
+{
+    uint64_t delay = TicksToCentiseconds(pendingTick + durationTicks) - TicksToCentiseconds(pendingTick);
+    delay = std::min<uint64_t>(std::max(delay, GIF_MIN_DELAY_CS), 0xFFFF);
+    encoded.push_back(0x21); // graphic control extension
+    encoded.push_back(0xF9);
+    encoded.push_back(4);
+    encoded.push_back(1 << 2); // keep this frame under the next one
+    AppendLittleEndian16(encoded, static_cast<uint32_t>(delay));
+    encoded.push_back(0);
+    encoded.push_back(0);
+
+    encoded.push_back(0x2C); // image descriptor
+    AppendLittleEndian16(encoded, rect.x * scale);
+    AppendLittleEndian16(encoded, rect.y * scale);
+    AppendLittleEndian16(encoded, rect.width * scale);
+    AppendLittleEndian16(encoded, rect.height * scale);
+    encoded.push_back(0); // global colour table, not interlaced
+    GifLzw(indices.data(), indices.size(), encoded);
+}
+
+void ClipRecorder::WriteApngFrame(const Rect &rect, uint64_t durationTicks)
+{
+    std::vector<uint8_t> control;
+    AppendBigEndian(control, sequence++);
+    AppendBigEndian(control, rect.width * scale);
+    AppendBigEndian(control, rect.height * scale);
+    AppendBigEndian(control, rect.x * scale);
+    AppendBigEndian(control, rect.y * scale);
+    AppendBigEndian16(control, static_cast<uint32_t>(std::min<uint64_t>(durationTicks, 0xFFFF)));
+    AppendBigEndian16(control, CLIP_TICKS_PER_SECOND);
+    control.push_back(0); // APNG_DISPOSE_OP_NONE
+    control.push_back(0); // APNG_BLEND_OP_SOURCE
+    AppendPngChunk(encoded, "fcTL", control.data(), control.size());
+
+    std::vector<uint8_t> scanlines, data;
+    FilterRows(indices.data(), rect.width * scale, rect.height * scale, scanlines);
+    if (first)
+    {
+        // The first frame is also the default image that viewers without APNG support show
+        DeflateRuns(scanlines.data(), scanlines.size(), data);
+        AppendPngChunk(encoded, "IDAT", data.data(), data.size());
+        return;
+    }
+    AppendBigEndian(data, sequence++);
+    DeflateRuns(scanlines.data(), scanlines.size(), data);
+    AppendPngChunk(encoded, "fdAT", data.data(), data.size());
+}
@@ -1,46 +1,1352 @@
 #include "Emulator.hpp"
+#include "Terminal.hpp"
+#include "Trace.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 
-int Emulator::emulate(int argc, char **argv)
+static uint16_t KeypadMask(const uint8_t *keys)
+{
+	uint16_t mask = 0;
+	for (unsigned int key = 0; key < 16; key++)
+	{
+		mask |= (keys[key] ? 1u : 0u) << key;
+	}
+	return mask;
+}
+
+// The cycle count of one frame at this delay, fixed so netplay peers and batch runs step identically
+static unsigned int FixedCycles(int cycleDelay)
+{
+	return std::max(1, static_cast<int>(FRAME_MS / cycleDelay + 0.5f));
+}
+
+// "<fault> at <address> in frame <n>", shared by the single-machine modes and the wall's instances
+static void PrintFault(Chip8 &chip8, GuestFault fault, uint32_t frame, uint32_t unchangedFrames)
+{
+	char address[8];
+	std::snprintf(address, sizeof(address), "%03X", fault == FAULT_STALLED ? chip8.getPC() : chip8.getFaultPC());
+	std::cerr << GuestFaultName(fault) << " at " << address << " in frame " << frame << " (counted from 1, as frame dumps are)";
+	if (fault == FAULT_STALLED)
+	{
+		std::cerr << " (display unchanged for " << unchangedFrames << " frames)";
+	}
+}
+
+static void PrintUsage(const char *program)
 {
-	if (argc != 3)
+	std::cerr << "Usage: " << program << " <Delay> <ROM> [options]\n"
+			  << "       " << program << " --bench <ROM> [options]      (1 ms delay)\n"
+			  << "  --latency-log <file>        write input-to-photon latency histograms on exit\n"
+			  << "  --seed <n>                  seed the random number generator\n"
+			  << "  --record <movie>            record input to a movie file\n"
+			  << "  --keyframe-interval <n>     frames between movie keyframes (default 600)\n"
+			  << "  --play <movie>              play input back from a movie file\n"
+			  << "  --seek <frame>              start movie playback at a frame\n"
+			  << "  --headless                  replay --play at full speed without a window and verify it, or\n"
+			  << "                              without --play run --frames frames with no input; stops on a guest fault\n"
+			  << "  --renderer <sdl|gl>         draw with SDL_Renderer and the debug panels (default), or OpenGL 3.3 with the display only\n"
+			  << "  --present <vsync|adaptive|immediate>  when frames are presented (default vsync)\n"
+			  << "  --terminal                  draw in the terminal with Unicode half blocks and read keys from stdin (for SSH)\n"
+			  << "  --post-scale <n>            draw the display on the CPU at n times its size (default: fill the screen)\n"
+			  << "  --phosphor <percent>        keep this much of an unlit pixel's brightness each frame, for less flicker\n"
+			  << "  --scanlines <percent>       darken every pixel row's bottom third to this brightness\n"
+			  << "  --post-threads <n>          threads drawing the post-processed display (default: one per core)\n"
+			  << "  --wall <n>                  run n copies of the ROM (seeds seed, seed + 1, ...) tiled in one window\n"
+			  << "  --wall-threads <n>          threads expanding the wall's tiles (default: one per core)\n"
+			  << "  --run-ahead <n>             show the frame n frames ahead to hide the game's input lag\n"
+			  << "  --netplay <port> <host:port> play two-player over UDP from a local port to a peer\n"
+			  << "  --player <1|2>              netplay side: 1 = left keys (1/Q in Pong), 2 = right keys (4/R)\n"
+			  << "  --net-delay <ms>            delay outgoing netplay packets\n"
+			  << "  --net-loss <percent>        drop outgoing netplay packets\n"
+			  << "  --netplay-test <frames>     run two rollback peers over loopback with scripted input and check they agree\n"
+			  << "  --speed <x|uncapped>        emulation speed as a multiple of normal (default 1)\n"
+			  << "  --ff-speed <x|uncapped>     speed while Tab is held (default uncapped)\n"
+			  << "  --frameskip <n|auto>        present every nth frame, or auto: at most once per host frame (default 1;\n"
+			  << "                              uncapped speed always presents as auto)\n"
+			  << "  --cpu <scalar|sse2|avx2|avx512>  cap the instruction set of the pixel kernels (default: the best the CPU has)\n"
+			  << "  --background-throttle       without focus, lower the thread priority and present at most 10 frames/s\n"
+			  << "  --bench                     run uncapped on SDL's offscreen driver and report per-phase timing\n"
+			  << "  --frames <n>                frames to run with --bench or a --headless run without a movie (default 3600)\n"
+			  << "  --metrics <file>            rewrite performance metrics in Prometheus text format every second\n"
+			  << "  --trace <file>              write main-loop phase timings as Chrome trace events (Perfetto, about:tracing)\n"
+			  << "  --exec-trace <file>         record every executed instruction to a binary trace (compare with chip8-tracediff)\n"
+			  << "  --exec-trace-compress       delta-compress the --exec-trace file\n"
+			  << "  --flight-recorder <file>    where the last instructions are dumped on a guest fault or crash (default chip8-flight.bin)\n"
+			  << "  --pc-range <low>-<high>     fault when an instruction is fetched outside these hex addresses\n"
+			  << "  --watchdog-frames <n>       with --headless or --wall, stop once the display has not changed for n frames\n"
+			  << "  --png <prefix>              with --headless, write <prefix>-<frame>.png stills\n"
+			  << "  --png-every <n>             write a still every n frames (default 60)\n"
+			  << "  --png-frames <n,n,...>      write stills of exactly these frames\n"
+			  << "  --y4m <file|->              with --headless, write every frame as a YUV4MPEG2 stream (- for stdout)\n"
+			  << "  --dump-scale <n>            integer upscale of dumped frames (default 4)\n"
+			  << "  --dump-queue <n>            frames buffered for the encoder thread (default 64)\n"
+			  << "  --dump-drop                 drop frames when the encoder falls behind instead of waiting\n"
+			  << "  --frame-stream <file>       record every frame to a compact delta-encoded stream (read with chip8-frames)\n"
+			  << "  --clip-format <gif|apng>    format of the clips F9 records (default gif)\n"
+			  << "  --clip-scale <n>            integer upscale of recorded clips (default 4)\n";
+}
+
+static EmulatorOptions ParseOptions(int argc, char **argv)
+{
+	if (argc < 3)
 	{
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+		PrintUsage(argv[0]);
 		std::exit(EXIT_FAILURE);
 	}
+	EmulatorOptions options;
+	// "--bench <ROM>" stands in for "1 <ROM> --bench"
+	options.benchmark = std::string(argv[1]) == "--bench";
+	options.cycleDelay = options.benchmark ? 1 : std::max(1, std::stoi(argv[1])); // ms per instruction; 0 would divide by zero
+	options.romFilename = argv[2];
+	options.pngOptions.format = DUMP_PNG;
+	options.y4mOptions.format = DUMP_Y4M;
+	for (int i = 3; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--latency-log" && hasValue)
+		{
+			options.latencyLog = argv[++i];
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			options.seeded = true;
+			options.seed = std::stoul(argv[++i]);
+		}
+		else if (arg == "--record" && hasValue)
+		{
+			options.recordFilename = argv[++i];
+		}
+		else if (arg == "--keyframe-interval" && hasValue)
+		{
+			options.keyframeInterval = std::stoul(argv[++i]);
+		}
+		else if (arg == "--play" && hasValue)
+		{
+			options.playFilename = argv[++i];
+		}
+		else if (arg == "--seek" && hasValue)
+		{
+			options.seekFrame = std::stoul(argv[++i]);
+		}
+		else if (arg == "--headless")
+		{
+			options.headless = true;
+		}
+		else if (arg == "--terminal")
+		{
+			options.terminal = true;
+		}
+		else if (arg == "--wall" && hasValue)
+		{
+			options.wallInstances = std::stoul(argv[++i]);
+			if (options.wallInstances == 0 || options.wallInstances > WALL_MAX_INSTANCES)
+			{
+				std::cerr << "--wall takes 1 to " << WALL_MAX_INSTANCES << " instances\n";
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		else if (arg == "--wall-threads" && hasValue)
+		{
+			options.wallThreads = std::stoul(argv[++i]);
+		}
+		else if (arg == "--renderer" && hasValue)
+		{
+			std::string value = argv[++i];
+			if (value != "sdl" && value != "gl")
+			{
+				std::cerr << "--renderer must be sdl or gl\n";
+				std::exit(EXIT_FAILURE);
+			}
+			options.renderBackend = value == "gl" ? RENDER_GL : RENDER_SDL;
+		}
+		else if (arg == "--present" && hasValue)
+		{
+			std::string value = argv[++i];
+			if (value != "vsync" && value != "adaptive" && value != "immediate")
+			{
+				std::cerr << "--present must be vsync, adaptive or immediate\n";
+				std::exit(EXIT_FAILURE);
+			}
+			options.presentMode = value == "vsync" ? PRESENT_VSYNC : (value == "adaptive" ? PRESENT_ADAPTIVE : PRESENT_IMMEDIATE);
+		}
+		else if (arg == "--post-scale" && hasValue)
+		{
+			options.postProcess = true;
+			options.postOptions.scale = std::stoul(argv[++i]);
+		}
+		else if (arg == "--phosphor" && hasValue)
+		{
+			options.postProcess = true;
+			options.postOptions.phosphor = std::stoul(argv[++i]);
+		}
+		else if (arg == "--scanlines" && hasValue)
+		{
+			options.postProcess = true;
+			options.postOptions.scanlines = true;
+			options.postOptions.scanlineLevel = std::stoul(argv[++i]);
+		}
+		else if (arg == "--post-threads" && hasValue)
+		{
+			options.postOptions.threads = std::stoul(argv[++i]);
+		}
+		else if (arg == "--run-ahead" && hasValue)
+		{
+			options.runAheadFrames = std::stoi(argv[++i]);
+		}
+		else if (arg == "--netplay" && i + 2 < argc)
+		{
+			options.netplayPort = static_cast<uint16_t>(std::stoi(argv[++i]));
+			options.netplayPeer = argv[++i];
+		}
+		else if (arg == "--player" && hasValue)
+		{
+			options.player = std::stoi(argv[++i]) == 2 ? 2 : 1;
+		}
+		else if (arg == "--net-delay" && hasValue)
+		{
+			options.conditions.delayMs = std::stof(argv[++i]);
+		}
+		else if (arg == "--net-loss" && hasValue)
+		{
+			options.conditions.lossPercent = std::stof(argv[++i]);
+		}
+		else if (arg == "--netplay-test" && hasValue)
+		{
+			options.netplayTestFrames = std::stoul(argv[++i]);
+		}
+		else if ((arg == "--speed" || arg == "--ff-speed") && hasValue)
+		{
+			std::string value = argv[++i];
+			(arg == "--speed" ? options.emulationSpeed : options.fastForwardSpeed) = value == "uncapped" ? 0.0f : std::stof(value);
+		}
+		else if (arg == "--metrics" && hasValue)
+		{
+			options.metricsFilename = argv[++i];
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			options.traceFilename = argv[++i];
+		}
+		else if (arg == "--exec-trace" && hasValue)
+		{
+			options.execTraceFilename = argv[++i];
+		}
+		else if (arg == "--exec-trace-compress")
+		{
+			options.execTraceCompress = true;
+		}
+		else if (arg == "--flight-recorder" && hasValue)
+		{
+			options.flightFilename = argv[++i];
+		}
+		else if (arg == "--pc-range" && hasValue)
+		{
+			std::string value = argv[++i];
+			size_t dash = value.find('-');
+			options.pcLow = static_cast<uint16_t>(std::stoul(value.substr(0, dash), nullptr, 16));
+			options.pcHigh = static_cast<uint16_t>(dash == std::string::npos ? options.pcLow : std::stoul(value.substr(dash + 1), nullptr, 16));
+		}
+		else if (arg == "--watchdog-frames" && hasValue)
+		{
+			options.watchdogFrames = std::stoul(argv[++i]);
+		}
+		else if (arg == "--png" && hasValue)
+		{
+			options.pngOptions.path = argv[++i];
+		}
+		else if (arg == "--png-every" && hasValue)
+		{
+			options.pngOptions.pngEvery = std::stoul(argv[++i]);
+		}
+		else if (arg == "--png-frames" && hasValue)
+		{
+			std::string list = argv[++i];
+			for (size_t start = 0; start < list.size();)
+			{
+				size_t comma = std::min(list.find(',', start), list.size());
+				options.pngOptions.pngFrames.push_back(std::stoul(list.substr(start, comma - start)));
+				start = comma + 1;
+			}
+		}
+		else if (arg == "--y4m" && hasValue)
+		{
+			options.y4mOptions.path = argv[++i];
+		}
+		else if (arg == "--dump-scale" && hasValue)
+		{
+			options.pngOptions.scale = options.y4mOptions.scale = std::max(1, std::stoi(argv[++i]));
+		}
+		else if (arg == "--dump-queue" && hasValue)
+		{
+			options.pngOptions.queueFrames = options.y4mOptions.queueFrames = std::max(1, std::stoi(argv[++i]));
+		}
+		else if (arg == "--dump-drop")
+		{
+			options.pngOptions.dropWhenFull = options.y4mOptions.dropWhenFull = true;
+		}
+		else if (arg == "--frame-stream" && hasValue)
+		{
+			options.frameStreamFilename = argv[++i];
+		}
+		else if (arg == "--clip-format" && hasValue)
+		{
+			std::string value = argv[++i];
+			if (value != "gif" && value != "apng")
+			{
+				std::cerr << "--clip-format must be gif or apng\n";
+				std::exit(EXIT_FAILURE);
+			}
+			options.clipFormat = value == "gif" ? CLIP_GIF : CLIP_APNG;
+		}
+		else if (arg == "--clip-scale" && hasValue)
+		{
+			options.clipScale = std::max(1, std::stoi(argv[++i]));
+		}
+		else if (arg == "--cpu" && hasValue)
+		{
+			std::string value = argv[++i];
+			int level = 0;
+			while (level < CPU_LEVEL_COUNT && value != CpuLevelName(static_cast<CpuLevel>(level)))
+			{
+				level++;
+			}
+			if (level == CPU_LEVEL_COUNT)
+			{
+				std::cerr << "--cpu must be scalar, sse2, avx2 or avx512\n";
+				std::exit(EXIT_FAILURE);
+			}
+			options.cpuLevel = static_cast<CpuLevel>(level);
+			if (!GetPixelKernels(options.cpuLevel))
+			{
+				std::cerr << "--cpu " << value << " is not supported here (best: " << CpuLevelName(DetectCpuLevel()) << ")\n";
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		else if (arg == "--background-throttle")
+		{
+			options.backgroundThrottle = true;
+		}
+		else if (arg == "--bench")
+		{
+			options.benchmark = true;
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			options.benchFrames = std::max(1ul, std::stoul(argv[++i]));
+		}
+		else if (arg == "--frameskip" && hasValue)
+		{
+			std::string value = argv[++i];
+			options.frameSkip = value == "auto" ? 0 : std::max(1, std::stoi(value));
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << arg << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	return options;
+}
+
+// Combinations that cannot work, rejected before anything is loaded so a bad command line never flashes a window
+static void CheckOptions(const EmulatorOptions &options)
+{
+	if ((!options.pngOptions.path.empty() || !options.y4mOptions.path.empty()) && !options.headless)
+	{
+		std::cerr << "--png and --y4m need --headless\n";
+		std::exit(EXIT_FAILURE);
+	}
+	if (options.execTraceFilename && options.netplayPort)
+	{
+		std::cerr << "--exec-trace cannot be combined with --netplay: rollbacks re-execute frames\n";
+		std::exit(EXIT_FAILURE);
+	}
+	if (options.postProcess && (options.headless || options.wallInstances || options.terminal))
+	{
+		std::cerr << "--post-scale, --phosphor and --scanlines need the emulator window, not --headless, --wall or --terminal\n";
+		std::exit(EXIT_FAILURE);
+	}
+	if (options.headless || options.netplayTestFrames)
+	{
+		return;
+	}
+	if (options.wallInstances)
+	{
+		if (options.playFilename || options.recordFilename || options.netplayPort || options.runAheadFrames ||
+			options.benchmark || options.terminal || options.execTraceFilename || options.frameStreamFilename)
+		{
+			std::cerr << "--wall cannot be combined with movies, netplay, run-ahead, --bench, --terminal, --exec-trace or --frame-stream\n";
+			std::exit(EXIT_FAILURE);
+		}
+		return;
+	}
+	if (options.terminal)
+	{
+		if (options.playFilename || options.recordFilename || options.netplayPort || options.runAheadFrames || options.benchmark)
+		{
+			std::cerr << "--terminal cannot be combined with movies, netplay, run-ahead or --bench\n";
+			std::exit(EXIT_FAILURE);
+		}
+		return;
+	}
+	if (options.netplayPort &&
+		(options.playFilename || options.recordFilename || options.runAheadFrames || options.emulationSpeed != 1.0f ||
+		 options.benchmark || options.netplayPeer.rfind(':') == std::string::npos))
+	{
+		std::cerr << "--netplay needs <host:port> and cannot be combined with movies, run-ahead, --speed or --bench\n";
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+int Emulator::emulate(int argc, char **argv)
+{
+	launchTime = std::chrono::high_resolution_clock::now();
+	options = ParseOptions(argc, argv);
+	CheckOptions(options);
+	if (options.cpuLevel != CPU_LEVEL_COUNT)
+	{
+		UsePixelKernels(options.cpuLevel);
+	}
+	runAheadFrames = options.runAheadFrames;
+	watchdog.setStallFrames(options.watchdogFrames);
+	clip.setFormat(options.clipFormat);
+	clip.setScale(options.clipScale);
 
-	char const *romFilename = argv[2];
-	Graphics platform("CHIP-8 Emulator");
 	Chip8 chip8;
-	chip8.LoadROM(romFilename);
-	platform.setCycleDelay(std::stoi(argv[1]));
+	flightRecorder.setDumpFile(options.flightFilename);
+	flightRecorder.InstallSignalHandlers();
+	chip8.setFlightRecorder(&flightRecorder);
+	chip8.setPCRange(options.pcLow, options.pcHigh);
+
+	bool windowed = !options.headless && !options.wallInstances && !options.terminal && !options.netplayTestFrames;
+	std::optional<Graphics> window;
+	EarlyStart early;
+	if (windowed)
+	{
+		startWindow(chip8, window, early);
+	}
+	else
+	{
+		early.loaded = loadROM(chip8);
+	}
+	if (!early.loaded)
+	{
+		std::cerr << "Could not load ROM " << options.romFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+	unsigned int fixedCycles = FixedCycles(options.cycleDelay);
+	if (options.netplayTestFrames)
+	{
+		return runNetplayTest(options.romFilename, chip8.getSeed(), options.netplayTestFrames, fixedCycles, options.conditions);
+	}
+
+	MoviePlayer movie;
+	bool playing = options.playFilename != nullptr;
+	if (playing)
+	{
+		startMovie(chip8, movie);
+	}
+	// Opened once a movie has seeded and positioned the machine, so the trace starts where execution does
+	ExecTraceWriter execTrace;
+	if (options.execTraceFilename)
+	{
+		if (!execTrace.Open(options.execTraceFilename, chip8.getRomHash(), chip8.getSeed(), options.execTraceCompress))
+		{
+			std::cerr << "Could not create execution trace " << options.execTraceFilename << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		chip8.setExecTrace(&execTrace);
+	}
+	if (options.frameStreamFilename && !frameStream.Open(options.frameStreamFilename, chip8.getRomHash()))
+	{
+		std::cerr << "Could not create frame stream " << options.frameStreamFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
 
-	int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
+	if (options.headless)
+	{
+		openFrameDumps();
+		// A fixed cycle count per frame, so batch runs are reproducible
+		return playing ? replayHeadless(chip8, movie) : runHeadless(chip8, options.benchFrames, fixedCycles);
+	}
+	if (options.wallInstances)
+	{
+		return runWall(options.romFilename, chip8.getSeed(), options.wallInstances, options.wallThreads, fixedCycles,
+					   options.renderBackend, options.presentMode);
+	}
+	if (options.terminal)
+	{
+		return runTerminal(chip8, options.cycleDelay, options.romFilename);
+	}
+	return runWindowed(chip8, *window, early, movie, playing, execTrace);
+}
+
+double Emulator::sinceLaunch() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - launchTime).count();
+}
+
+bool Emulator::loadROM(Chip8 &chip8)
+{
+	if (!chip8.LoadROM(options.romFilename))
+	{
+		return false;
+	}
+	if (options.seeded)
+	{
+		chip8.Seed(options.seed);
+	}
+	else if (options.netplayPort || options.netplayTestFrames)
+	{
+		chip8.Seed(NETPLAY_DEFAULT_SEED);
+	}
+	else if (options.benchmark)
+	{
+		chip8.Seed(1); // comparable runs
+	}
+	return true;
+}
+
+void Emulator::startWindow(Chip8 &chip8, std::optional<Graphics> &window, EarlyStart &early)
+{
+	// Creating the window and renderer is most of startup, so the ROM is read on a loader thread meanwhile.
+	// A session with nothing to keep in step with (no movie, netplay, trace or --bench) also starts running
+	// the guest there, headless, and runWindowed picks it up once the window exists.
+	bool headStart = !options.playFilename && !options.recordFilename && !options.netplayPort && !options.benchmark &&
+					 !options.execTraceFilename && !options.frameStreamFilename && options.emulationSpeed > 0.0f;
+	std::thread loader([&, headStart]()
+	{
+		early.loaded = loadROM(chip8);
+		early.romLoadedMs = sinceLaunch();
+		if (early.loaded && headStart)
+		{
+			runEarly(chip8, options.cycleDelay, options.emulationSpeed, early);
+		}
+	});
+	window.emplace("CHIP-8 Emulator", options.benchmark, options.renderBackend, options.presentMode);
+	if (options.postProcess)
+	{
+		window->OpenPostProcess(options.postOptions);
+	}
+	early.windowMs = sinceLaunch();
+	{
+		std::lock_guard<std::mutex> lock(early.mutex);
+		early.stop = true;
+	}
+	early.wake.notify_one();
+	loader.join();
+}
+
+void Emulator::startMovie(Chip8 &chip8, MoviePlayer &movie)
+{
+	if (!movie.Open(options.playFilename))
+	{
+		std::exit(EXIT_FAILURE);
+	}
+	if (movie.getHeader().romHash != chip8.getRomHash())
+	{
+		std::cerr << "Movie " << options.playFilename << " was recorded with a different ROM\n";
+		std::exit(EXIT_FAILURE);
+	}
+	if (movie.getHeader().quirks != QUIRKS_DEFAULT)
+	{
+		std::cerr << "Movie " << options.playFilename << " needs quirk profile " << movie.getHeader().quirks << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+	movie.Start(chip8);
+	if (options.seekFrame && !movie.Seek(chip8, options.seekFrame))
+	{
+		std::cerr << "Cannot seek to frame " << options.seekFrame << " of " << movie.getFrameCount() << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+void Emulator::openFrameDumps()
+{
+	for (auto dump : {std::make_pair(&pngDumper, &options.pngOptions), std::make_pair(&y4mDumper, &options.y4mOptions)})
+	{
+		if (!dump.second->path.empty() && !dump.first->Open(*dump.second))
+		{
+			std::cerr << "Could not create " << dump.second->path << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+	if (options.y4mOptions.path == "-")
+	{
+		std::cout.rdbuf(std::cerr.rdbuf()); // stdout carries the video; messages go to stderr
+	}
+}
+
+int Emulator::runWindowed(Chip8 &chip8, Graphics &platform, EarlyStart &early, MoviePlayer &movie, bool playing,
+						  ExecTraceWriter &execTrace)
+{
+	MovieRecorder recorder;
+	if (options.recordFilename && !recorder.Open(options.recordFilename, chip8, options.keyframeInterval))
+	{
+		std::cerr << "Could not create movie " << options.recordFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	RollbackSession netplay;
+	bool netplaying = options.netplayPort != 0;
+	unsigned int netplayCycles = FixedCycles(options.cycleDelay);
+	if (netplaying)
+	{
+		size_t colon = options.netplayPeer.rfind(':');
+		uint16_t peerPort = static_cast<uint16_t>(std::stoi(options.netplayPeer.substr(colon + 1)));
+		if (!netplay.Start(chip8, options.player, options.netplayPort, options.netplayPeer.substr(0, colon).c_str(), peerPort, netplayCycles, options.conditions))
+		{
+			std::exit(EXIT_FAILURE);
+		}
+	}
+	uint8_t localKeys[16]{};
+
+	platform.setCycleDelay(options.cycleDelay);
+	platform.setPausable(!netplaying && !options.benchmark);
+	float emulationSpeed = options.benchmark ? 0.0f : options.emulationSpeed;
+
+	LatencyTracker latency;
+	platform.setLatencyTracker(&latency);
+	platform.setClipRecorder(&clip);
+	Telemetry telemetry;
+	if (options.metricsFilename)
+	{
+		telemetry.setMetricsFile(options.metricsFilename);
+	}
+	telemetry.FrameEmulated(early.instructions, early.frames);
+
+	uint64_t aheadVideo[VIDEO_HEIGHT];
+	auto startTime = std::chrono::high_resolution_clock::now();
+	auto lastTime = startTime;
+	auto lastPresentTime = startTime;
+	float pendingCycles = early.pendingCycles;
+	float behindMs = early.behindMs; // emulated time owed to the wall clock
+	double firstInstructionMs = early.firstInstructionMs;
+	double firstFrameMs = 0.0;
+	unsigned int lastCycles = 0;
+	unsigned int framesSinceRender = 0;
+	bool videoDirty = true; // the texture is stale; uploads are skipped while the guest leaves the screen alone
 	bool quit = false;
+	bool faultReported = false;
+	bool throttled = false; // --background-throttle is in effect
+
+	if (options.traceFilename)
+	{
+		Trace::Start();
+		Trace::SetThreadName("main");
+	}
+
+	BenchStats bench;
+	bench.frames = early.frames;
+	auto lapTime = startTime;
+	uint64_t cpuStartNs = ProcessCpuNs();
+	// Charges the time since the previous lap to a phase; only --bench reads the clock this often
+	auto lap = [&](BenchPhase phase)
+	{
+		if (options.benchmark)
+		{
+			auto now = std::chrono::high_resolution_clock::now();
+			bench.phaseNs[phase] += std::chrono::duration<double, std::nano>(now - lapTime).count();
+			lapTime = now;
+		}
+	};
+
+	// One emulated frame: FRAME_MS of guest time, as many instructions as the cycle delay allows. False when
+	// netplay stalled and nothing ran, so the frame is still owed.
+	auto emulateFrame = [&](double nowMs)
+	{
+		TRACE_SCOPE("EmulateFrame");
+		pendingCycles = std::min(pendingCycles + FRAME_MS / platform.getCycleDelay(), MAX_PENDING_CYCLES);
+		unsigned int cycles = static_cast<unsigned int>(pendingCycles);
+		pendingCycles -= cycles;
+		if (firstInstructionMs == 0.0)
+		{
+			firstInstructionMs = sinceLaunch();
+		}
+		if (playing && !movie.NextFrame(chip8, cycles))
+		{
+			playing = false;
+			std::cout << "Movie finished after " << movie.getFrame() << " frames"
+					  << (movie.getMismatches() || !movie.VerifyEnd(chip8) ? " (frames differ from recording)" : "") << "\n";
+		}
+		if (netplaying)
+		{
+			TRACE_SCOPE("AdvanceFrame");
+			if (!netplay.AdvanceFrame(chip8, KeypadMask(localKeys), nowMs))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			recorder.RecordFrame(chip8, cycles);
+			TRACE_SCOPE("RunFrame");
+			chip8.RunFrame(cycles);
+		}
+		if (clip.isRecording())
+		{
+			clip.Submit(chip8.video);
+		}
+		if (frameStream.isOpen())
+		{
+			frameStream.Frame(chip8.video);
+		}
+		// Faults are contained, so the interactive emulator reports the first one and keeps going
+		if (chip8.getFault() != FAULT_NONE)
+		{
+			if (!faultReported)
+			{
+				reportFault(chip8, bench.frames + 1);
+				faultReported = true;
+			}
+			chip8.clearFault();
+		}
+		lastCycles = cycles;
+		bench.frames++;
+		framesSinceRender++;
+		telemetry.FrameEmulated(netplaying ? netplayCycles : cycles);
+		videoDirty |= chip8.videoChanged;
+		// Only read the clock while a key press is being followed
+		if (latency.isTracking())
+		{
+			uint64_t now = SDL_GetTicksNS();
+			// A read from an earlier frame came before any draw in this one; a read in this frame only counts
+			// when a draw followed it, so a frame that drew and then polled still waits for the next change
+			if (chip8.videoChanged)
+			{
+				latency.VideoChanged(0xFFFFu, now);
+			}
+			latency.KeypadPolled(chip8.keypadPolled, now);
+			latency.VideoChanged(chip8.polledBeforeDraw, now);
+		}
+		chip8.keypadPolled = 0;
+		chip8.polledBeforeDraw = 0;
+		chip8.videoChanged = false;
+		return true;
+	};
+
+	auto render = [&](float speed)
+	{
+		TRACE_SCOPE("Render");
+		// Run-ahead shows a speculative frame, so its output can change even when the real one did not
+		if (runAheadFrames > 0)
+		{
+			TRACE_SCOPE("RunAhead");
+			runAhead(chip8, lastCycles, aheadVideo);
+			platform.UpdateVideo(aheadVideo);
+		}
+		else if (videoDirty)
+		{
+			platform.UpdateVideo(chip8.video);
+		}
+		else
+		{
+			platform.UpdateVideo(nullptr);
+			telemetry.UploadSkipped();
+		}
+		videoDirty = false;
+		lap(BENCH_UPLOAD);
+		platform.DrawDebugBordrer();
+		platform.DisplaySpeed(speed, static_cast<float>(telemetry.getSnapshot().emulatedFps));
+		platform.DisplayRecording();
+		platform.DisplayTelemetry(telemetry.getSnapshot());
+		platform.DisplayLatency(latency);
+		if (runAheadStats.frames)
+		{
+			float n = static_cast<float>(runAheadStats.frames);
+			float save = runAheadStats.saveUs / n, ahead = runAheadStats.aheadUs / n, restore = runAheadStats.restoreUs / n;
+			platform.DisplayRunAhead(runAheadFrames, save, ahead, restore, (save + ahead + restore) / (FRAME_MS * 10.0f));
+		}
+		if (netplaying)
+		{
+			platform.DisplayNetplay(netplay.getStats());
+		}
+		platform.DisplayRegisters(chip8.getRegisters());
+		platform.DisplayStack(chip8.getStack());
+		platform.DisplayPC(chip8.getPC());
+		platform.DisplaySP(chip8.getSP());
+		platform.DisplayCycleDelay();
+		platform.DisplayMemory(chip8.getMemory());
+		platform.DistplayInstructions(chip8.getInstruction());
+		lap(BENCH_PANELS);
+		platform.EndDraw();
+		if (latency.isTracking())
+		{
+			latency.Presented(SDL_GetTicksNS());
+		}
+		telemetry.Presented(SDL_GetTicksNS());
+		lap(BENCH_PRESENT);
+		framesSinceRender = 0;
+		if (firstFrameMs == 0.0)
+		{
+			firstFrameMs = sinceLaunch();
+			reportStartup(early, firstInstructionMs, firstFrameMs);
+			telemetry.setStartup(firstInstructionMs, firstFrameMs);
+		}
+	};
 
 	while (!quit)
 	{
-		
-		quit = platform.ProcessInput(chip8.keypad);
+
+		// With netplay the session owns the keypad; local keys are merged in per frame
+		quit = platform.ProcessInput(netplaying ? localKeys : chip8.keypad);
+		lap(BENCH_INPUT);
+		if (options.backgroundThrottle && throttled != (!platform.hasFocus() || !platform.isVisible()))
+		{
+			throttled = !throttled;
+			SDL_SetCurrentThreadPriority(throttled ? SDL_THREAD_PRIORITY_LOW : SDL_THREAD_PRIORITY_NORMAL);
+		}
+		if (platform.isPaused() && !quit)
+		{
+			// Nothing runs, so sleep in the event queue instead of polling it
+			if (platform.ConsumeRedraw() && platform.isVisible())
+			{
+				render(emulationSpeed);
+			}
+			platform.WaitForEvents(-1);
+			lastTime = std::chrono::high_resolution_clock::now(); // the guest is not owed the time spent paused
+			continue;
+		}
 		auto currentTime = std::chrono::high_resolution_clock::now();
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
-		int cycle = platform.getCycleDelay();
-		if (dt > cycle)
-		{
-			lastCycleTime = currentTime;
-			chip8.Cycle();
-			//Display
-			platform.Update(chip8.video, videoPitch);
-			platform.DrawDebugBordrer();
-			platform.DisplayRegisters(chip8.getRegisters());
-			platform.DisplayStack(chip8.getStack());
-			platform.DisplayPC(chip8.getPC());
-			platform.DisplaySP(chip8.getSP());
-			platform.DisplayCycleDelay();
-			platform.DisplayMemory(chip8.getMemory());
-			platform.DistplayInstructions(chip8.getInstruction());
-			platform.EndDraw();
+		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastTime).count();
+		lastTime = currentTime;
+		double nowMs = std::chrono::duration<double, std::milli>(currentTime - startTime).count();
+
+		float speed = netplaying ? 1.0f : (platform.isFastForward() ? options.fastForwardSpeed : emulationSpeed);
+		// Uncapped speed presents at most once per host frame whatever --frameskip says, or waiting for vsync after
+		// every emulated frame would hold it to the refresh rate. --bench presents offscreen and keeps --frameskip.
+		unsigned int frameSkip = speed > 0.0f || options.benchmark ? options.frameSkip : 0;
+		bool ran = false;
+		if (speed <= 0.0f)
+		{
+			// Uncapped: run frames back to back, returning to poll input every few milliseconds
+			auto batchEnd = currentTime + std::chrono::microseconds(static_cast<int>(UNCAPPED_BATCH_MS * 1000));
+			do
+			{
+				emulateFrame(nowMs);
+				currentTime = std::chrono::high_resolution_clock::now();
+			} while (currentTime < batchEnd && (frameSkip == 0 || framesSinceRender < frameSkip) &&
+					 !(options.benchmark && bench.frames >= options.benchFrames));
+			behindMs = 0.0f;
+			ran = true;
 		}
+		else
+		{
+			behindMs += dt * speed;
+			if (behindMs > MAX_BEHIND_MS * speed)
+			{
+				telemetry.FellBehind(behindMs - MAX_BEHIND_MS * speed);
+				behindMs = MAX_BEHIND_MS * speed;
+			}
+			while (behindMs >= FRAME_MS && emulateFrame(nowMs))
+			{
+				behindMs -= FRAME_MS;
+				ran = true;
+			}
+		}
+		lap(BENCH_EMULATE);
+
+		telemetry.Tick(SDL_GetTicksNS());
+
+		// Present every Nth emulated frame, or with frameskip auto at most once per host frame. Nothing is drawn
+		// while the window cannot be seen; --bench's offscreen window always is.
+		bool rendered = false;
+		if (ran && (options.benchmark || platform.isVisible()))
+		{
+			float sincePresent = std::chrono::duration<float, std::milli>(currentTime - lastPresentTime).count();
+			if ((frameSkip > 0 ? framesSinceRender >= frameSkip : sincePresent >= FRAME_MS) &&
+				(!throttled || sincePresent >= BACKGROUND_PRESENT_MS))
+			{
+				render(speed);
+				lastPresentTime = currentTime;
+				rendered = true;
+			}
+		}
+		// Without a present to block in, wait for the next frame (or an event) rather than spinning
+		if (!rendered && speed > 0.0f && !options.benchmark)
+		{
+			// At least a millisecond: a stalled netplay frame leaves a whole frame owed
+			platform.WaitForEvents(std::max(1, static_cast<int>(std::ceil((FRAME_MS - behindMs) / speed))));
+		}
+		if (options.benchmark && bench.frames >= options.benchFrames)
+		{
+			quit = true;
+		}
+	}
+	if (options.benchmark)
+	{
+		bench.wallNs = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - startTime).count();
+		bench.cpuNs = static_cast<double>(ProcessCpuNs() - cpuStartNs);
+		reportBenchmark(bench);
+	}
+
+	recorder.Close(chip8);
+	if (netplaying)
+	{
+		const NetplayStats &stats = netplay.getStats();
+		std::cout << "Netplay: " << stats.frame << " frames, " << stats.rollbacks << " rollbacks (max " << stats.maxRollbackFrames
+				  << " frames, " << stats.maxResimUs << " us), " << stats.stalls << " stalls, " << stats.hashChecks << " hash checks"
+				  << (stats.desynced ? ", DESYNC at frame " + std::to_string(stats.desyncFrame) : "") << "\n";
+	}
+	if (runAheadStats.frames)
+	{
+		double n = static_cast<double>(runAheadStats.frames);
+		double total = (runAheadStats.saveUs + runAheadStats.aheadUs + runAheadStats.restoreUs) / n;
+		std::cout << "Run-ahead " << runAheadFrames << ": save " << runAheadStats.saveUs / n << " us, run "
+				  << runAheadStats.aheadUs / n << " us, restore " << runAheadStats.restoreUs / n << " us per frame ("
+				  << total / (FRAME_MS * 10.0) << "% of a frame)\n";
+	}
+	closeFrameDumps();
+	if (options.execTraceFilename)
+	{
+		execTrace.Close();
+		std::cout << "Execution trace: " << execTrace.getSteps() << " steps written to " << options.execTraceFilename << "\n";
+	}
+	if (options.traceFilename && !Trace::Write(options.traceFilename))
+	{
+		std::cerr << "Could not write trace " << options.traceFilename << "\n";
+	}
+	if (options.latencyLog && !latency.Dump(options.latencyLog))
+	{
+		std::cerr << "Could not write latency log " << options.latencyLog << "\n";
 	}
 	return 0;
 }
+
+
+void Emulator::runEarly(Chip8 &chip8, int cycleDelay, float speed, EarlyStart &early)
+{
+	// The same pacing as the main loop, without input or a display: nothing can be pressed or shown yet
+	auto lastTime = std::chrono::high_resolution_clock::now();
+	std::unique_lock<std::mutex> lock(early.mutex);
+	while (!early.stop)
+	{
+		lock.unlock();
+		auto currentTime = std::chrono::high_resolution_clock::now();
+		early.behindMs += std::chrono::duration<float, std::milli>(currentTime - lastTime).count() * speed;
+		early.behindMs = std::min(early.behindMs, MAX_BEHIND_MS * speed);
+		lastTime = currentTime;
+		while (early.behindMs >= FRAME_MS)
+		{
+			early.behindMs -= FRAME_MS;
+			early.pendingCycles = std::min(early.pendingCycles + FRAME_MS / cycleDelay, MAX_PENDING_CYCLES);
+			unsigned int cycles = static_cast<unsigned int>(early.pendingCycles);
+			early.pendingCycles -= cycles;
+			if (early.frames == 0)
+			{
+				early.firstInstructionMs = std::chrono::duration<double, std::milli>(currentTime - launchTime).count();
+			}
+			chip8.RunFrame(cycles);
+			early.frames++;
+			early.instructions += cycles;
+		}
+		lock.lock();
+		early.wake.wait_for(lock, std::chrono::duration<float, std::milli>((FRAME_MS - early.behindMs) / speed),
+							[&early] { return early.stop; });
+	}
+}
+
+void Emulator::reportStartup(const EarlyStart &early, double firstInstructionMs, double firstFrameMs)
+{
+	std::printf("Startup: ROM loaded after %.1f ms, window after %.1f ms, first instruction after %.1f ms, "
+				"first frame after %.1f ms",
+				early.romLoadedMs, early.windowMs, firstInstructionMs, firstFrameMs);
+	if (early.frames)
+	{
+		std::printf(" (%u frames run before the window was ready)", early.frames);
+	}
+	std::printf("\n");
+}
+
+void Emulator::reportBenchmark(const BenchStats &stats)
+{
+	static const char *names[BENCH_PHASE_COUNT] = {"input", "emulate", "upload", "panels", "present"};
+	double emulatedSeconds = stats.frames * FRAME_MS / 1000.0;
+	std::printf("Benchmark: %u frames (%.1f emulated s) in %.3f s, %.1f frames/s\n", stats.frames, emulatedSeconds,
+				stats.wallNs / 1e9, stats.frames / (stats.wallNs / 1e9));
+	std::printf("CPU time: %.3f s, %.2f ms per emulated second\n", stats.cpuNs / 1e9, stats.cpuNs / 1e6 / emulatedSeconds);
+	std::printf("Pixel kernels: %s\n", CpuLevelName(pixelKernels->level));
+	std::printf("%-8s %12s %10s %7s\n", "phase", "total_ms", "us/frame", "share");
+	double timed = 0.0;
+	for (int phase = 0; phase < BENCH_PHASE_COUNT; phase++)
+	{
+		timed += stats.phaseNs[phase];
+	}
+	for (int phase = 0; phase < BENCH_PHASE_COUNT; phase++)
+	{
+		std::printf("%-8s %12.3f %10.3f %6.1f%%\n", names[phase], stats.phaseNs[phase] / 1e6,
+					stats.phaseNs[phase] / 1e3 / stats.frames, timed > 0 ? 100.0 * stats.phaseNs[phase] / timed : 0.0);
+	}
+}
+
+void Emulator::runAhead(Chip8 &chip8, unsigned int cycles, uint64_t *video)
+{
+	// Speculatively run ahead with the current input, show that frame, then rewind
+	auto start = std::chrono::high_resolution_clock::now();
+	chip8.SaveState(runAheadState);
+	auto saved = std::chrono::high_resolution_clock::now();
+	auto ran = saved;
+	{
+		// Speculative frames run again for real later, so they leave no trace, history, fault or flags behind
+		SpeculativeRun speculation(chip8);
+		for (int i = 0; i < runAheadFrames; i++)
+		{
+			chip8.RunFrame(cycles);
+		}
+		memcpy(video, chip8.video, sizeof(chip8.video));
+		ran = std::chrono::high_resolution_clock::now();
+		chip8.LoadState(runAheadState);
+	}
+	auto restored = std::chrono::high_resolution_clock::now();
+
+	runAheadStats.frames++;
+	runAheadStats.saveUs += std::chrono::duration<double, std::micro>(saved - start).count();
+	runAheadStats.aheadUs += std::chrono::duration<double, std::micro>(ran - saved).count();
+	runAheadStats.restoreUs += std::chrono::duration<double, std::micro>(restored - ran).count();
+}
+
+int Emulator::runHeadless(Chip8 &chip8, uint32_t frames, unsigned int cycles)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		GuestFault fault = chip8.RunFrame(cycles);
+		dumpFrame(chip8, frame + 1);
+		if (fault == FAULT_NONE)
+		{
+			fault = watchdog.Frame(chip8);
+		}
+		if (fault != FAULT_NONE)
+		{
+			closeFrameDumps();
+			reportFault(chip8, frame + 1);
+			return EXIT_GUEST_FAULT;
+		}
+	}
+	float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Ran " << frames << " frames in " << ms << " ms without a fault\n";
+	closeFrameDumps();
+	return EXIT_SUCCESS;
+}
+
+int Emulator::runTerminal(Chip8 &chip8, int cycleDelay, const char *title)
+{
+	Terminal screen;
+	if (!screen.Open(title))
+	{
+		std::cerr << "--terminal needs stdin and stdout to be a terminal\n";
+		return EXIT_FAILURE;
+	}
+	const auto frameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<float, std::milli>(FRAME_MS));
+	auto nextFrame = std::chrono::steady_clock::now();
+	float pendingCycles = 0.0f;
+	uint32_t frame = 0;
+	uint32_t faultFrame = 0;
+	while (!screen.ProcessInput(chip8.keypad))
+	{
+		pendingCycles = std::min(pendingCycles + FRAME_MS / cycleDelay, MAX_PENDING_CYCLES);
+		unsigned int cycles = static_cast<unsigned int>(pendingCycles);
+		pendingCycles -= cycles;
+		// The first fault stays latched so it can be reported once the screen is restored
+		if (chip8.RunFrame(cycles) != FAULT_NONE && !faultFrame)
+		{
+			faultFrame = frame + 1;
+		}
+		dumpFrame(chip8, ++frame);
+		screen.Update(chip8.video);
+
+		nextFrame += frameTime;
+		auto now = std::chrono::steady_clock::now();
+		if (now - nextFrame > std::chrono::milliseconds(static_cast<int>(MAX_BEHIND_MS)))
+		{
+			nextFrame = now; // after a stall, carry on from now rather than catching up
+		}
+		std::this_thread::sleep_until(nextFrame);
+	}
+	screen.Close();
+	std::cout << "Terminal: " << screen.getFrames() << " frames, "
+			  << (screen.getFrames() ? static_cast<double>(screen.getBytes()) / screen.getFrames() : 0.0) << " bytes per frame\n";
+	if (faultFrame)
+	{
+		reportFault(chip8, faultFrame);
+	}
+	closeFrameDumps();
+	return EXIT_SUCCESS;
+}
+
+int Emulator::runWall(const char *romFilename, uint32_t seed, unsigned int count, unsigned int threads, unsigned int cycles,
+					   RenderBackend backend, PresentMode present)
+{
+	std::vector<Chip8> machines(count);
+	std::vector<const uint64_t *> videos(count);
+	std::vector<bool> stopped(count);
+	// Each instance has its own stall count; the PC range is the same for all
+	std::vector<Watchdog> watchdogs(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		machines[i].LoadROM(romFilename);
+		machines[i].Seed(seed + i);
+		machines[i].setPCRange(options.pcLow, options.pcHigh);
+		watchdogs[i].setStallFrames(options.watchdogFrames);
+		videos[i] = machines[i].video;
+	}
+	Graphics platform("CHIP-8 Video Wall", false, backend, present);
+	platform.setPausable(false);
+	VideoWall wall;
+	wall.Open(count, platform.getWallFormat(), threads);
+	platform.OpenWall(wall);
+
+	const auto frameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<float, std::milli>(FRAME_MS));
+	auto nextFrame = std::chrono::steady_clock::now();
+	uint8_t keys[16]{};
+	uint32_t frame = 0;
+	unsigned int faulted = 0;
+	uint32_t composed = 0; // frames drawn: none are while the window is hidden
+	double composeMs = 0.0;
+	uint64_t uploadedRows = 0;
+	while (!platform.ProcessInput(keys))
+	{
+		{
+			TRACE_SCOPE("EmulateWall");
+			// Every instance gets the same keys; one that faults or stalls stops, so its tile keeps its last frame
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (stopped[i])
+				{
+					continue;
+				}
+				memcpy(machines[i].keypad, keys, sizeof(keys));
+				GuestFault fault = machines[i].RunFrame(cycles);
+				if (fault == FAULT_NONE)
+				{
+					fault = watchdogs[i].Frame(machines[i]);
+				}
+				if (fault != FAULT_NONE)
+				{
+					std::cerr << "Instance " << i << ": guest fault ";
+					PrintFault(machines[i], fault, frame + 1, watchdogs[i].getUnchangedFrames());
+					std::cerr << "\n";
+					stopped[i] = true;
+					faulted++;
+				}
+			}
+		}
+		// Compose compares with what it drew last, so skipping it while hidden loses nothing
+		if (platform.isVisible())
+		{
+			auto composeStart = std::chrono::high_resolution_clock::now();
+			{
+				TRACE_SCOPE("ComposeWall");
+				wall.Compose(videos.data());
+			}
+			composeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - composeStart).count();
+			platform.UpdateWall(wall);
+			uploadedRows += wall.getDirtyRows();
+			platform.DrawWall();
+			platform.EndDraw();
+			composed++;
+		}
+		frame++;
+
+		nextFrame += frameTime;
+		auto now = std::chrono::steady_clock::now();
+		if (now - nextFrame > std::chrono::milliseconds(static_cast<int>(MAX_BEHIND_MS)))
+		{
+			nextFrame = now;
+		}
+		std::this_thread::sleep_until(nextFrame);
+	}
+	double tiles = static_cast<double>(wall.getTilesDrawn() + wall.getTilesSkipped());
+	std::cout << "Video wall: " << count << " instances, " << frame << " frames, " << faulted << " faulted; "
+			  << (tiles > 0 ? 100.0 * wall.getTilesSkipped() / tiles : 0.0) << "% of tiles unchanged, "
+			  << (composed ? composeMs / composed : 0.0) << " ms composing on " << wall.getThreads() << " threads and "
+			  << (composed ? static_cast<double>(uploadedRows) / composed : 0.0) << " of " << wall.getHeight()
+			  << " atlas rows uploaded per frame\n";
+	return EXIT_SUCCESS;
+}
+
+void Emulator::dumpFrame(const Chip8 &chip8, uint32_t frame)
+{
+	if (frameStream.isOpen())
+	{
+		frameStream.Frame(chip8.video);
+	}
+	for (FrameDumper *dumper : {&pngDumper, &y4mDumper})
+	{
+		if (dumper->Wants(frame))
+		{
+			dumper->Submit(frame, chip8.video);
+		}
+	}
+}
+
+void Emulator::closeFrameDumps()
+{
+	if (frameStream.isOpen())
+	{
+		frameStream.Close();
+		uint32_t frames = frameStream.getFrames();
+		std::cout << "Frame stream: " << frames << " frames in " << frameStream.getBytes() / 1024 << " KB ("
+				  << (frames ? static_cast<double>(frameStream.getBytes()) / frames : 0.0) << " bytes per frame)\n";
+	}
+	for (FrameDumper *dumper : {&pngDumper, &y4mDumper})
+	{
+		if (!dumper->isOpen())
+		{
+			continue;
+		}
+		dumper->Close();
+		const FrameDumpStats &stats = dumper->getStats();
+		std::cout << "Dumped " << stats.written << " frames to " << dumper->getOptions().path << " (" << stats.bytes / 1024
+				  << " KB, " << (stats.written ? stats.encodeMs / stats.written : 0.0) << " ms each on the encoder thread";
+		if (stats.dropped || stats.waits)
+		{
+			std::cout << "; " << stats.dropped << " dropped, " << stats.waits << " waits for a full queue";
+		}
+		std::cout << ")\n";
+	}
+}
+
+void Emulator::reportFault(Chip8 &chip8, uint32_t frame)
+{
+	GuestFault fault = chip8.getFault() != FAULT_NONE ? chip8.getFault() : FAULT_STALLED;
+	std::cerr << "Guest fault: ";
+	PrintFault(chip8, fault, frame, watchdog.getUnchangedFrames());
+	if (flightRecorder.isDumped() || (fault == FAULT_STALLED && flightRecorder.DumpFault(fault)))
+	{
+		std::cerr << "; the last " << FLIGHT_RECORDER_ENTRIES << " instructions are in " << flightRecorder.getDumpFile();
+	}
+	std::cerr << "\n";
+}
+
+int Emulator::replayHeadless(Chip8 &chip8, MoviePlayer &movie)
+{
+	uint32_t firstFrame = movie.getFrame();
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int cycles;
+	GuestFault fault = FAULT_NONE;
+	while (fault == FAULT_NONE && movie.NextFrame(chip8, cycles))
+	{
+		fault = chip8.RunFrame(cycles);
+		dumpFrame(chip8, movie.getFrame());
+		if (fault == FAULT_NONE)
+		{
+			fault = watchdog.Frame(chip8);
+		}
+	}
+	if (fault != FAULT_NONE)
+	{
+		closeFrameDumps();
+		reportFault(chip8, movie.getFrame());
+		return EXIT_GUEST_FAULT;
+	}
+	float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	uint32_t frames = movie.getFrame() - firstFrame;
+	bool match = movie.getMismatches() == 0 && movie.VerifyEnd(chip8);
+	std::cout << "Replayed " << frames << " frames in " << ms << " ms (" << (ms > 0 ? frames * 1000.0f / ms : 0.0f)
+			  << " frames/s): " << (match ? "frames match the recording" : "frames DIFFER from the recording") << "\n";
+	if (movie.getMismatches())
+	{
+		std::cout << movie.getMismatches() << " keyframe checkpoints differ\n";
+	}
+	closeFrameDumps();
+	return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int Emulator::runNetplayTest(const char *romFilename, uint32_t seed, uint32_t frames, unsigned int cycles, NetConditions conditions)
+{
+	const uint16_t ports[2] = {47801, 47802};
+	Chip8 machines[2];
+	RollbackSession sessions[2];
+	std::mt19937 inputRng[2] = {std::mt19937(1), std::mt19937(2)};
+	uint16_t held[2] = {0, 0};
+	for (int peer = 0; peer < 2; peer++)
+	{
+		machines[peer].LoadROM(romFilename);
+		machines[peer].Seed(seed);
+		if (!sessions[peer].Start(machines[peer], peer + 1, ports[peer], "127.0.0.1", ports[1 - peer], cycles, conditions))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Time is simulated so delay and loss behave the same at any host speed
+	double nowMs = 0.0;
+	uint64_t ticks = 0;
+	const uint64_t maxTicks = frames * 20ull + 6000;
+	while (ticks++ < maxTicks)
+	{
+		bool done = true;
+		for (int peer = 0; peer < 2; peer++)
+		{
+			const NetplayStats &stats = sessions[peer].getStats();
+			if (stats.frame < frames)
+			{
+				// Scripted player: hold a random combination of its own keys for 1 - 30 frames
+				if (inputRng[peer]() % 30 == 0)
+				{
+					held[peer] = static_cast<uint16_t>(inputRng[peer]()) & sessions[peer].getLocalMask();
+				}
+				sessions[peer].AdvanceFrame(machines[peer], held[peer], nowMs);
+			}
+			else
+			{
+				sessions[peer].Poll(machines[peer], nowMs);
+			}
+			done = done && stats.frame == frames && stats.confirmedFrame + 1 == frames;
+		}
+		if (done)
+		{
+			break;
+		}
+		nowMs += FRAME_MS;
+		std::this_thread::sleep_for(std::chrono::microseconds(50)); // let loopback deliver
+	}
+
+	Chip8State states[2];
+	machines[0].SaveState(states[0]);
+	machines[1].SaveState(states[1]);
+	bool agree = Chip8::HashState(states[0]) == Chip8::HashState(states[1]);
+
+	// The target: a 10-frame resimulation must fit in one frame
+	Chip8 probe;
+	probe.LoadROM(romFilename);
+	probe.Seed(seed);
+	probe.RunFrame(cycles * 60);
+	Chip8State saved[10];
+	probe.SaveState(saved[0]);
+	auto start = std::chrono::high_resolution_clock::now();
+	probe.LoadState(saved[0]);
+	for (int frame = 0; frame < 10; frame++)
+	{
+		if (frame)
+		{
+			probe.SaveState(saved[frame]);
+		}
+		probe.RunFrame(cycles);
+	}
+	double resimUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+	bool ok = agree && resimUs <= FRAME_MS * 1000.0f;
+	for (int peer = 0; peer < 2; peer++)
+	{
+		const NetplayStats &stats = sessions[peer].getStats();
+		std::cout << "Peer " << peer + 1 << ": " << stats.frame << " frames, confirmed " << stats.confirmedFrame + 1 << ", "
+				  << stats.rollbacks << " rollbacks (max " << stats.maxRollbackFrames << " frames, " << stats.maxResimUs << " us), "
+				  << stats.stalls << " stalls, " << stats.hashChecks << " hash checks"
+				  << (stats.desynced ? ", DESYNC at frame " + std::to_string(stats.desyncFrame) : "")
+				  << (stats.incompatible ? ", incompatible peer" : "") << "\n";
+		ok = ok && !stats.desynced && !stats.incompatible && stats.frame == frames && stats.confirmedFrame + 1 == frames;
+	}
+	std::cout << "10-frame resimulation: " << resimUs << " us (frame budget " << FRAME_MS * 1000.0f << " us"
+			  << (resimUs > FRAME_MS * 1000.0f ? ", OVER BUDGET" : "") << ")\n"
+			  << (ok ? "Peers agree on every confirmed frame\n" : "Netplay test FAILED\n");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
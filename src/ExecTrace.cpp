@@ -0,0 +1,248 @@
+#include "ExecTrace.hpp"
+#include <algorithm>
+#include <cstring>
+
+static uint64_t Pack(const ExecRecord &record)
+{
+    uint64_t value;
+    memcpy(&value, &record, sizeof(value));
+    return value;
+}
+
+ExecTraceWriter::~ExecTraceWriter()
+{
+    Close();
+}
+
+bool ExecTraceWriter::Open(const char *filename, uint64_t romHash, uint32_t seed, bool compressBlocks)
+{
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    compress = compressBlocks;
+    uint16_t recordSize = sizeof(ExecRecord);
+    uint16_t flags = compress ? EXEC_TRACE_COMPRESSED : 0;
+    uint16_t reserved = 0;
+    fwrite("C8TR", 1, 4, file);
+    fwrite(&EXEC_TRACE_VERSION, sizeof(EXEC_TRACE_VERSION), 1, file);
+    fwrite(&recordSize, sizeof(recordSize), 1, file);
+    fwrite(&flags, sizeof(flags), 1, file);
+    fwrite(&reserved, sizeof(reserved), 1, file);
+    fwrite(&romHash, sizeof(romHash), 1, file);
+    fwrite(&seed, sizeof(seed), 1, file);
+
+    buffers[0].resize(EXEC_TRACE_BLOCK_RECORDS);
+    buffers[1].resize(EXEC_TRACE_BLOCK_RECORDS);
+    active = 0;
+    count = 0;
+    submitted = 0;
+    stopping = false;
+    failed = false;
+    writer = std::thread(&ExecTraceWriter::WriterLoop, this);
+    return true;
+}
+
+void ExecTraceWriter::Close()
+{
+    if (!file)
+    {
+        return;
+    }
+    if (count)
+    {
+        Submit();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+    if (fclose(file) != 0 || failed)
+    {
+        fprintf(stderr, "Execution trace is incomplete: write failed\n");
+    }
+    file = nullptr;
+}
+
+uint64_t ExecTraceWriter::getSteps() const
+{
+    return submitted + count;
+}
+
+void ExecTraceWriter::Submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !pending; });
+    pending = true;
+    pendingBuffer = active;
+    pendingCount = count;
+    lock.unlock();
+    changed.notify_all();
+
+    submitted += count;
+    active ^= 1;
+    count = 0;
+}
+
+void ExecTraceWriter::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        changed.wait(lock, [this] { return pending || stopping; });
+        if (!pending)
+        {
+            return;
+        }
+        const ExecRecord *records = buffers[pendingBuffer].data();
+        size_t size = pendingCount;
+        lock.unlock();
+        bool written = WriteBlock(records, size);
+        lock.lock();
+        failed |= !written;
+        pending = false;
+        changed.notify_all();
+    }
+}
+
+bool ExecTraceWriter::WriteBlock(const ExecRecord *records, size_t size)
+{
+    if (!compress)
+    {
+        return fwrite(records, sizeof(ExecRecord), size, file) == size;
+    }
+    packed.resize(size * (sizeof(ExecRecord) + 1));
+    uint8_t *out = packed.data();
+    uint64_t previous = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint64_t value = Pack(records[i]);
+        uint64_t delta = value ^ previous;
+        previous = value;
+        uint8_t *mask = out++;
+        *mask = 0;
+        for (unsigned int byte = 0; byte < 8; ++byte, delta >>= 8)
+        {
+            if (delta & 0xFF)
+            {
+                *mask |= 1u << byte;
+                *out++ = static_cast<uint8_t>(delta);
+            }
+        }
+    }
+    uint32_t header[2] = {static_cast<uint32_t>(size), static_cast<uint32_t>(out - packed.data())};
+    return fwrite(header, sizeof(header), 1, file) == 1 && fwrite(packed.data(), 1, header[1], file) == header[1];
+}
+
+ExecTraceReader::~ExecTraceReader()
+{
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+bool ExecTraceReader::Open(const char *filename)
+{
+    file = fopen(filename, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    char magic[4];
+    uint16_t version, recordSize, reserved;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "C8TR", 4) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 || version != EXEC_TRACE_VERSION ||
+        fread(&recordSize, sizeof(recordSize), 1, file) != 1 || recordSize != sizeof(ExecRecord) ||
+        fread(&flags, sizeof(flags), 1, file) != 1 || fread(&reserved, sizeof(reserved), 1, file) != 1 ||
+        fread(&romHash, sizeof(romHash), 1, file) != 1 || fread(&seed, sizeof(seed), 1, file) != 1)
+    {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+size_t ExecTraceReader::Read(ExecRecord *records, size_t max)
+{
+    if (!(flags & EXEC_TRACE_COMPRESSED))
+    {
+        size_t read = fread(records, sizeof(ExecRecord), max, file);
+        truncated |= read < max && !feof(file);
+        return read;
+    }
+    size_t read = 0;
+    while (read < max && (blockPosition < block.size() || ReadBlock()))
+    {
+        size_t take = std::min(max - read, block.size() - blockPosition);
+        memcpy(records + read, block.data() + blockPosition, take * sizeof(ExecRecord));
+        blockPosition += take;
+        read += take;
+    }
+    return read;
+}
+
+bool ExecTraceReader::ReadBlock()
+{
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1)
+    {
+        return false;
+    }
+    packed.resize(header[1]);
+    if (header[0] > EXEC_TRACE_BLOCK_RECORDS || fread(packed.data(), 1, header[1], file) != header[1])
+    {
+        truncated = true;
+        return false;
+    }
+    block.resize(header[0]);
+    blockPosition = 0;
+    const uint8_t *in = packed.data();
+    const uint8_t *end = in + packed.size();
+    uint64_t previous = 0;
+    for (ExecRecord &record : block)
+    {
+        if (in >= end)
+        {
+            truncated = true;
+            block.clear();
+            return false;
+        }
+        uint8_t mask = *in++;
+        uint64_t delta = 0;
+        for (unsigned int byte = 0; byte < 8; ++byte)
+        {
+            if (mask & (1u << byte))
+            {
+                delta |= static_cast<uint64_t>(in < end ? *in++ : 0) << (8 * byte);
+            }
+        }
+        previous ^= delta;
+        memcpy(&record, &previous, sizeof(record));
+    }
+    return true;
+}
+
+uint64_t ExecTraceReader::getRomHash() const
+{
+    return romHash;
+}
+
+uint32_t ExecTraceReader::getSeed() const
+{
+    return seed;
+}
+
+bool ExecTraceReader::isCompressed() const
+{
+    return flags & EXEC_TRACE_COMPRESSED;
+}
+
+bool ExecTraceReader::isTruncated() const
+{
+    return truncated;
+}
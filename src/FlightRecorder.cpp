@@ -0,0 +1,112 @@
+#include "FlightRecorder.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define OPEN_DUMP(name) _open(name, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define WRITE_DUMP(fd, data, size) _write(fd, data, static_cast<unsigned int>(size))
+#define CLOSE_DUMP _close
+#else
+#include <unistd.h>
+#define OPEN_DUMP(name) open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define WRITE_DUMP(fd, data, size) write(fd, data, size)
+#define CLOSE_DUMP close
+#endif
+
+static FlightRecorder *signalRecorder = nullptr;
+
+static const int fatalSignals[] = {
+    SIGSEGV, SIGILL, SIGFPE, SIGABRT,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+
+FlightRecorder::~FlightRecorder()
+{
+    if (signalRecorder == this)
+    {
+        signalRecorder = nullptr;
+    }
+}
+
+void FlightRecorder::setDumpFile(const char *filename)
+{
+    strncpy(dumpFile, filename, sizeof(dumpFile) - 1);
+}
+
+const char *FlightRecorder::getDumpFile() const
+{
+    return dumpFile;
+}
+
+bool FlightRecorder::DumpFault(uint8_t fault)
+{
+    if (dumped)
+    {
+        return true;
+    }
+    dumped = true;
+    return Dump(fault, 0);
+}
+
+bool FlightRecorder::isDumped() const
+{
+    return dumped;
+}
+
+uint64_t FlightRecorder::getSteps() const
+{
+    return steps;
+}
+
+void FlightRecorder::Rewind(uint64_t to)
+{
+    steps = std::min(steps, to);
+}
+
+void FlightRecorder::InstallSignalHandlers()
+{
+    signalRecorder = this;
+    for (int signal : fatalSignals)
+    {
+        std::signal(signal, &FlightRecorder::HandleSignal);
+    }
+}
+
+void FlightRecorder::HandleSignal(int signal)
+{
+    if (signalRecorder)
+    {
+        signalRecorder->Dump(0, static_cast<uint8_t>(signal));
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+bool FlightRecorder::Dump(uint8_t fault, uint8_t signal)
+{
+    if (!dumpFile[0])
+    {
+        return false;
+    }
+    int fd = OPEN_DUMP(dumpFile);
+    if (fd < 0)
+    {
+        return false;
+    }
+    uint32_t count = steps < FLIGHT_RECORDER_ENTRIES ? static_cast<uint32_t>(steps) : FLIGHT_RECORDER_ENTRIES;
+    FlightDumpHeader header{{'C', '8', 'F', 'R'}, FLIGHT_RECORDER_VERSION, fault, signal, count, 0, steps};
+    // Oldest first: the ring from the write position to its end, then from its start
+    uint32_t oldest = static_cast<uint32_t>((steps - count) & (FLIGHT_RECORDER_ENTRIES - 1));
+    uint32_t firstPart = count < FLIGHT_RECORDER_ENTRIES - oldest ? count : FLIGHT_RECORDER_ENTRIES - oldest;
+    bool written = WRITE_DUMP(fd, &header, sizeof(header)) == static_cast<int>(sizeof(header)) &&
+                   WRITE_DUMP(fd, entries + oldest, firstPart * sizeof(FlightEntry)) ==
+                       static_cast<int>(firstPart * sizeof(FlightEntry)) &&
+                   WRITE_DUMP(fd, entries, (count - firstPart) * sizeof(FlightEntry)) ==
+                       static_cast<int>((count - firstPart) * sizeof(FlightEntry));
+    return CLOSE_DUMP(fd) == 0 && written;
+}
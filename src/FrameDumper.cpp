@@ -0,0 +1,191 @@
+#include "FrameDumper.hpp"
+#include "Png.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+const uint8_t Y4M_NEUTRAL_CHROMA = 128;
+
+FrameDumper::~FrameDumper()
+{
+    Close();
+}
+
+bool FrameDumper::Open(const FrameDumpOptions &dumpOptions)
+{
+    options = dumpOptions;
+    options.scale = std::max(1u, options.scale);
+    options.queueFrames = std::max<size_t>(1, options.queueFrames);
+    std::sort(options.pngFrames.begin(), options.pngFrames.end());
+    width = VIDEO_WIDTH * options.scale;
+    height = VIDEO_HEIGHT * options.scale;
+    if (options.format == DUMP_Y4M)
+    {
+        if (options.path == "-")
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            stream = stdout;
+        }
+        else if (!(stream = fopen(options.path.c_str(), "wb")))
+        {
+            return false;
+        }
+        fprintf(stream, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n", width, height);
+    }
+    luma.resize(static_cast<size_t>(width) * height);
+    queue.resize(options.queueFrames);
+    head = 0;
+    count = 0;
+    stopping = false;
+    failed = false;
+    stats = FrameDumpStats();
+    open = true;
+    worker = std::thread(&FrameDumper::WorkerLoop, this);
+    return true;
+}
+
+bool FrameDumper::isOpen() const
+{
+    return open;
+}
+
+bool FrameDumper::Wants(uint32_t frame) const
+{
+    if (!open)
+    {
+        return false;
+    }
+    if (options.format == DUMP_Y4M)
+    {
+        return true;
+    }
+    if (!options.pngFrames.empty())
+    {
+        return std::binary_search(options.pngFrames.begin(), options.pngFrames.end(), frame);
+    }
+    return options.pngEvery && frame % options.pngEvery == 0;
+}
+
+void FrameDumper::Submit(uint32_t frame, const uint64_t *video)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (count == queue.size())
+    {
+        if (options.dropWhenFull)
+        {
+            stats.dropped++;
+            return;
+        }
+        stats.waits++;
+        changed.wait(lock, [this] { return count < queue.size(); });
+    }
+    QueuedFrame &queued = queue[(head + count) % queue.size()];
+    queued.frame = frame;
+    memcpy(queued.video, video, sizeof(queued.video));
+    count++;
+    lock.unlock();
+    changed.notify_all();
+}
+
+void FrameDumper::Close()
+{
+    if (!open)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    worker.join();
+    if (stream && stream != stdout)
+    {
+        failed |= fclose(stream) != 0;
+    }
+    else if (stream)
+    {
+        fflush(stream);
+    }
+    stream = nullptr;
+    open = false;
+    if (failed)
+    {
+        fprintf(stderr, "Frame dump to %s is incomplete: write failed\n", options.path.c_str());
+    }
+}
+
+const FrameDumpStats &FrameDumper::getStats() const
+{
+    return stats;
+}
+
+const FrameDumpOptions &FrameDumper::getOptions() const
+{
+    return options;
+}
+
+void FrameDumper::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        changed.wait(lock, [this] { return count || stopping; });
+        if (!count)
+        {
+            return;
+        }
+        // The slot stays reserved until the frame is written, so Submit cannot overwrite it
+        const QueuedFrame &queued = queue[head];
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        bool written = Write(queued, bytes);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lock.lock();
+        failed |= !written;
+        stats.written += written;
+        stats.encodeMs += ms;
+        stats.bytes += bytes;
+        head = (head + 1) % queue.size();
+        count--;
+        changed.notify_all();
+    }
+}
+
+bool FrameDumper::Write(const QueuedFrame &queued, uint64_t &bytes)
+{
+    ScaleVideoLuma(queued.video, options.scale, luma.data());
+    if (options.format == DUMP_Y4M)
+    {
+        static const char frameHeader[] = "FRAME\n";
+        // 4:2:0: two quarter-size chroma planes, grey; the dimensions are always even
+        size_t chroma = static_cast<size_t>(width / 2) * (height / 2) * 2;
+        encoded.assign(chroma, Y4M_NEUTRAL_CHROMA);
+        bool written = fwrite(frameHeader, 1, sizeof(frameHeader) - 1, stream) == sizeof(frameHeader) - 1 &&
+                       fwrite(luma.data(), 1, luma.size(), stream) == luma.size() &&
+                       fwrite(encoded.data(), 1, chroma, stream) == chroma;
+        bytes = sizeof(frameHeader) - 1 + luma.size() + chroma;
+        return written;
+    }
+
+    encoded.clear();
+    EncodePng(luma.data(), width, height, encoded);
+    char filename[32];
+    snprintf(filename, sizeof(filename), "-%06u.png", queued.frame);
+    FILE *file = fopen((options.path + filename).c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    bytes = encoded.size();
+    return fclose(file) == 0 && written;
+}
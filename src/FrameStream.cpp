@@ -0,0 +1,428 @@
+#include "FrameStream.hpp"
+#include <algorithm>
+#include <cstring>
+
+const uint8_t TOKEN_ZEROS_TO_END = 0x7F;
+const size_t MAX_ZERO_RUN = 0x7F;  // tokens 0x00-0x7E
+const size_t MAX_LITERAL_RUN = 0x80; // tokens 0x80-0xFF
+const size_t WRITE_BUFFER_BYTES = 1 << 16;
+
+// Column-major bytes: byte b * VIDEO_HEIGHT + y holds pixels 8b to 8b + 7 of row y, so the changes a
+// sprite makes moving up and down land in one run
+static void ToColumns(const uint64_t *rows, uint8_t *bytes)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int b = 0; b < sizeof(uint64_t); ++b)
+        {
+            bytes[b * VIDEO_HEIGHT + y] = static_cast<uint8_t>(rows[y] >> (56 - 8 * b));
+        }
+    }
+}
+
+static void FromColumns(const uint8_t *bytes, uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint64_t row = 0;
+        for (unsigned int b = 0; b < sizeof(uint64_t); ++b)
+        {
+            row = row << 8 | bytes[b * VIDEO_HEIGHT + y];
+        }
+        rows[y] = row;
+    }
+}
+
+FrameStreamWriter::~FrameStreamWriter()
+{
+    Close();
+}
+
+bool FrameStreamWriter::Open(const char *filename, uint64_t romHash, uint32_t interval)
+{
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, WRITE_BUFFER_BYTES);
+    keyframeInterval = std::max(1u, interval);
+    frames = 0;
+    repeats = 0;
+    position = 0;
+    failed = false;
+    index.clear();
+    FrameStreamHeader header{{'C', '8', 'F', 'S'}, FRAME_STREAM_VERSION, 0, keyframeInterval, 0, romHash};
+    Write(&header, sizeof(header));
+    return true;
+}
+
+void FrameStreamWriter::Frame(const uint64_t *video)
+{
+    if (frames % keyframeInterval == 0)
+    {
+        if (repeats)
+        {
+            WriteRecord(repeats, false);
+        }
+        index.push_back(FrameStreamKeyframe{frames, 0, position});
+        WriteRecord(0, true);
+        memcpy(previous, video, sizeof(previous));
+        WriteDelta(previous);
+    }
+    else
+    {
+        uint64_t delta[VIDEO_HEIGHT];
+        uint64_t any = 0;
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+        {
+            delta[y] = video[y] ^ previous[y];
+            any |= delta[y];
+        }
+        if (!any)
+        {
+            ++repeats;
+            ++frames;
+            return;
+        }
+        WriteRecord(repeats, true);
+        WriteDelta(delta);
+        memcpy(previous, video, sizeof(previous));
+    }
+    repeats = 0;
+    ++frames;
+}
+
+void FrameStreamWriter::Close()
+{
+    if (!file)
+    {
+        return;
+    }
+    if (repeats)
+    {
+        WriteRecord(repeats, false);
+        repeats = 0;
+    }
+    FrameStreamTrailer trailer{position, frames, static_cast<uint32_t>(index.size()), 0, {'C', '8', 'F', 'I'}};
+    Write(index.data(), index.size() * sizeof(FrameStreamKeyframe));
+    Write(&trailer, sizeof(trailer));
+    if (fclose(file) != 0 || failed)
+    {
+        fprintf(stderr, "Frame stream is incomplete: write failed\n");
+    }
+    file = nullptr;
+}
+
+bool FrameStreamWriter::isOpen() const
+{
+    return file != nullptr;
+}
+
+uint32_t FrameStreamWriter::getFrames() const
+{
+    return frames;
+}
+
+uint64_t FrameStreamWriter::getBytes() const
+{
+    return position;
+}
+
+void FrameStreamWriter::WriteRecord(uint64_t count, bool changed)
+{
+    uint8_t bytes[10];
+    size_t size = 0;
+    uint64_t value = count << 1 | (changed ? 1u : 0u);
+    do
+    {
+        bytes[size++] = static_cast<uint8_t>((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+        value >>= 7;
+    } while (value);
+    Write(bytes, size);
+}
+
+void FrameStreamWriter::WriteDelta(const uint64_t *rows)
+{
+    uint8_t delta[FRAME_STREAM_FRAME_BYTES];
+    ToColumns(rows, delta);
+    // Worst case: a token per 128 literal bytes, plus a zero run between each
+    uint8_t out[FRAME_STREAM_FRAME_BYTES + FRAME_STREAM_FRAME_BYTES / 2];
+    size_t size = 0;
+    size_t at = 0;
+    while (at < FRAME_STREAM_FRAME_BYTES)
+    {
+        size_t zeros = 0;
+        while (at + zeros < FRAME_STREAM_FRAME_BYTES && delta[at + zeros] == 0)
+        {
+            ++zeros;
+        }
+        if (at + zeros == FRAME_STREAM_FRAME_BYTES)
+        {
+            out[size++] = TOKEN_ZEROS_TO_END;
+            break;
+        }
+        at += zeros;
+        for (; zeros; zeros -= std::min(zeros, MAX_ZERO_RUN))
+        {
+            out[size++] = static_cast<uint8_t>(std::min(zeros, MAX_ZERO_RUN) - 1);
+        }
+        // A lone zero byte costs the same inside a literal run as a token of its own
+        size_t literal = 0;
+        while (at + literal < FRAME_STREAM_FRAME_BYTES && literal < MAX_LITERAL_RUN &&
+               (delta[at + literal] != 0 ||
+                (at + literal + 1 < FRAME_STREAM_FRAME_BYTES && delta[at + literal + 1] != 0)))
+        {
+            ++literal;
+        }
+        out[size++] = static_cast<uint8_t>(0x7F + literal);
+        memcpy(out + size, delta + at, literal);
+        size += literal;
+        at += literal;
+    }
+    Write(out, size);
+}
+
+void FrameStreamWriter::Write(const void *data, size_t size)
+{
+    failed |= fwrite(data, 1, size, file) != size;
+    position += size;
+}
+
+FrameStreamReader::~FrameStreamReader()
+{
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+bool FrameStreamReader::Open(const char *filename)
+{
+    file = fopen(filename, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    FrameStreamTrailer trailer{};
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "C8FS", 4) == 0 &&
+                 header.version == FRAME_STREAM_VERSION && header.keyframeInterval > 0 && fseek(file, 0, SEEK_END) == 0;
+    long fileSize = valid ? ftell(file) : -1;
+    valid = fileSize >= static_cast<long>(sizeof(header));
+    if (valid && fileSize >= static_cast<long>(sizeof(header) + sizeof(trailer)) &&
+        fseek(file, fileSize - static_cast<long>(sizeof(trailer)), SEEK_SET) == 0 &&
+        fread(&trailer, sizeof(trailer), 1, file) == 1 && memcmp(trailer.magic, "C8FI", 4) == 0 &&
+        trailer.indexOffset + uint64_t(trailer.keyframes) * sizeof(FrameStreamKeyframe) + sizeof(trailer) ==
+            static_cast<uint64_t>(fileSize))
+    {
+        index.resize(trailer.keyframes);
+        valid = fseek(file, static_cast<long>(trailer.indexOffset), SEEK_SET) == 0 &&
+                fread(index.data(), sizeof(FrameStreamKeyframe), index.size(), file) == index.size();
+        frames = trailer.frames;
+        dataEnd = trailer.indexOffset;
+    }
+    else if (valid)
+    {
+        recovered = true;
+        valid = Rebuild(static_cast<uint64_t>(fileSize));
+    }
+    if (!valid)
+    {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    bytes = static_cast<uint64_t>(fileSize);
+    return true;
+}
+
+bool FrameStreamReader::Rebuild(uint64_t fileSize)
+{
+    // Walk every record, noting where keyframes start, up to the last one that is complete
+    data.resize(fileSize - sizeof(header));
+    if (fseek(file, sizeof(header), SEEK_SET) != 0 || fread(data.data(), 1, data.size(), file) != data.size())
+    {
+        return false;
+    }
+    uint8_t scratch[FRAME_STREAM_FRAME_BYTES]{};
+    size_t record = 0;
+    uint64_t value;
+    for (size_t at = 0; ReadVarint(data, at, value) && value; record = at)
+    {
+        uint64_t repeats = value >> 1;
+        bool changed = value & 1;
+        bool keyframe = changed && (frames + repeats) % header.keyframeInterval == 0;
+        if ((keyframe ? repeats != 0 : index.empty()) || frames + repeats + changed > UINT32_MAX ||
+            (changed && !ApplyDelta(data, at, scratch)))
+        {
+            break;
+        }
+        if (keyframe)
+        {
+            index.push_back(FrameStreamKeyframe{frames, 0, sizeof(header) + record});
+        }
+        frames += static_cast<uint32_t>(repeats + changed);
+    }
+    dataEnd = sizeof(header) + record;
+    data.clear();
+    return true;
+}
+
+uint32_t FrameStreamReader::getFrameCount() const
+{
+    return frames;
+}
+
+uint32_t FrameStreamReader::getKeyframeInterval() const
+{
+    return header.keyframeInterval;
+}
+
+uint64_t FrameStreamReader::getRomHash() const
+{
+    return header.romHash;
+}
+
+uint64_t FrameStreamReader::getBytes() const
+{
+    return bytes;
+}
+
+bool FrameStreamReader::isRecovered() const
+{
+    return recovered;
+}
+
+bool FrameStreamReader::ReadFrame(uint32_t frame, uint64_t *video)
+{
+    if (frame >= frames)
+    {
+        return false;
+    }
+    auto after = std::upper_bound(index.begin(), index.end(), frame,
+                                  [](uint32_t value, const FrameStreamKeyframe &keyframe) { return value < keyframe.frame; });
+    if (after == index.begin())
+    {
+        return false;
+    }
+    size_t keyframe = static_cast<size_t>(after - index.begin()) - 1;
+    // Carry on from the last frame read when it is in the same segment and not past the one wanted
+    bool resume = segment == keyframe && nextFrame > index[keyframe].frame && nextFrame <= frame + 1;
+    if (!resume && !LoadSegment(keyframe))
+    {
+        return false;
+    }
+    while (nextFrame <= frame)
+    {
+        if (!Step())
+        {
+            segment = SIZE_MAX;
+            return false;
+        }
+    }
+    FromColumns(current, video);
+    return true;
+}
+
+bool FrameStreamReader::LoadSegment(size_t keyframe)
+{
+    uint64_t start = index[keyframe].offset;
+    uint64_t end = keyframe + 1 < index.size() ? index[keyframe + 1].offset : dataEnd;
+    segment = SIZE_MAX;
+    if (end < start)
+    {
+        return false;
+    }
+    data.resize(end - start);
+    if (fseek(file, static_cast<long>(start), SEEK_SET) != 0 || fread(data.data(), 1, data.size(), file) != data.size())
+    {
+        return false;
+    }
+    segment = keyframe;
+    position = 0;
+    nextFrame = index[keyframe].frame;
+    repeatsLeft = 0;
+    changedLeft = false;
+    return true;
+}
+
+bool FrameStreamReader::Step()
+{
+    if (!repeatsLeft && !changedLeft)
+    {
+        uint64_t value;
+        if (!ReadVarint(data, position, value) || !value)
+        {
+            return false;
+        }
+        repeatsLeft = value >> 1;
+        changedLeft = value & 1;
+    }
+    if (repeatsLeft)
+    {
+        --repeatsLeft;
+    }
+    else
+    {
+        changedLeft = false;
+        if (nextFrame % header.keyframeInterval == 0)
+        {
+            memset(current, 0, sizeof(current));
+        }
+        if (!ApplyDelta(data, position, current))
+        {
+            return false;
+        }
+    }
+    ++nextFrame;
+    return true;
+}
+
+bool FrameStreamReader::ReadVarint(const std::vector<uint8_t> &data, size_t &position, uint64_t &value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 64 && position < data.size(); shift += 7)
+    {
+        uint8_t byte = data[position++];
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameStreamReader::ApplyDelta(const std::vector<uint8_t> &data, size_t &position, uint8_t *frame)
+{
+    size_t at = 0;
+    while (at < FRAME_STREAM_FRAME_BYTES)
+    {
+        if (position >= data.size())
+        {
+            return false;
+        }
+        uint8_t token = data[position++];
+        if (token == TOKEN_ZEROS_TO_END)
+        {
+            return true;
+        }
+        if (token < TOKEN_ZEROS_TO_END)
+        {
+            at += token + 1u;
+            continue;
+        }
+        size_t literal = token - TOKEN_ZEROS_TO_END;
+        if (at + literal > FRAME_STREAM_FRAME_BYTES || position + literal > data.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < literal; ++i)
+        {
+            frame[at + i] ^= data[position + i];
+        }
+        position += literal;
+        at += literal;
+    }
+    return at == FRAME_STREAM_FRAME_BYTES;
+}
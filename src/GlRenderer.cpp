@@ -0,0 +1,305 @@
+#include "GlRenderer.hpp"
+#include "Video.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Not in the OpenGL 3.3 glad headers: GL 4.4 / ARB_buffer_storage, loaded at runtime
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void(APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+const GLuint64 FENCE_TIMEOUT_NS = 1000000000; // a GPU this far behind has hung
+
+// A triangle covering the viewport, generated from gl_VertexID so no vertex buffer is needed
+static const char *vertexShader = R"(#version 330 core
+out vec2 uv;
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = vec2(corner.x, 1.0 - corner.y);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char *fragmentShader = R"(#version 330 core
+in vec2 uv;
+out vec4 colour;
+uniform sampler2D screen;
+uniform vec3 on;
+uniform vec3 off;
+void main()
+{
+    colour = vec4(mix(off, on, texture(screen, uv).r), 1.0);
+}
+)";
+
+static GLuint CompileShader(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[512] = {};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf(stderr, "OpenGL shader did not compile: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static bool HasBufferStorage()
+{
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4))
+    {
+        return true;
+    }
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && std::string(name) == "GL_ARB_buffer_storage")
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+GlRenderer::~GlRenderer()
+{
+    Shutdown();
+}
+
+bool GlRenderer::Init(GLADloadproc getProcAddress, unsigned int textureWidth, unsigned int textureHeight)
+{
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (textureWidth > static_cast<unsigned int>(maxSize) || textureHeight > static_cast<unsigned int>(maxSize))
+    {
+        fprintf(stderr, "OpenGL textures are limited to %dx%d; %ux%u is too large\n", maxSize, maxSize, textureWidth, textureHeight);
+        return false;
+    }
+    width = textureWidth;
+    height = textureHeight;
+    slotBytes = static_cast<size_t>(width) * height;
+    program = CompileProgram();
+    if (!program)
+    {
+        return false;
+    }
+    onLocation = glGetUniformLocation(program, "on");
+    offLocation = glGetUniformLocation(program, "off");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "screen"), 0);
+    glGenVertexArrays(1, &vertexArray); // core profile draws need one bound, even with no attributes
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    auto bufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(getProcAddress("glBufferStorage"));
+    GLsizeiptr size = GL_UPLOAD_SLOTS * slotBytes;
+    persistent = bufferStorage && HasBufferStorage();
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        mapped = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+        persistent = mapped != nullptr;
+    }
+    if (!persistent)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    ready = glGetError() == GL_NO_ERROR;
+    setColours(PIXEL_ON, PIXEL_OFF);
+    return ready;
+}
+
+void GlRenderer::Shutdown()
+{
+    if (!program)
+    {
+        return;
+    }
+    for (GLsync &fence : fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (mapped)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &texture);
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteProgram(program);
+    program = 0;
+    ready = false;
+}
+
+void GlRenderer::Upload(const uint64_t *video)
+{
+    if (!ready || width != VIDEO_WIDTH || height != VIDEO_HEIGHT)
+    {
+        return;
+    }
+    uint8_t *target = BeginUpload();
+    if (target)
+    {
+        ScaleVideoLuma(video, 1, target);
+        EndUpload(0, VIDEO_HEIGHT);
+    }
+}
+
+void GlRenderer::UploadRows(const uint8_t *luma, size_t pitch, unsigned int top, unsigned int rows)
+{
+    if (!ready || rows == 0 || top + rows > height)
+    {
+        return;
+    }
+    uint8_t *target = BeginUpload();
+    if (target)
+    {
+        for (unsigned int row = 0; row < rows; ++row)
+        {
+            memcpy(target + static_cast<size_t>(row) * width, luma + row * pitch, width);
+        }
+        EndUpload(top, rows);
+    }
+}
+
+void GlRenderer::Draw(int framebufferWidth, int framebufferHeight, int x, int y, int width, int height)
+{
+    if (!ready)
+    {
+        return;
+    }
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glViewport(x, y, width, height);
+    glUseProgram(program);
+    glUniform3fv(onLocation, 1, on);
+    glUniform3fv(offLocation, 1, off);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void GlRenderer::setColours(uint32_t onColour, uint32_t offColour)
+{
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        on[channel] = ((onColour >> (24 - 8 * channel)) & 0xFF) / 255.0f;
+        off[channel] = ((offColour >> (24 - 8 * channel)) & 0xFF) / 255.0f;
+    }
+}
+
+bool GlRenderer::isPersistent() const
+{
+    return persistent;
+}
+
+uint64_t GlRenderer::getFenceWaits() const
+{
+    return fenceWaits;
+}
+
+unsigned int GlRenderer::getWidth() const
+{
+    return width;
+}
+
+unsigned int GlRenderer::getHeight() const
+{
+    return height;
+}
+
+GLuint GlRenderer::CompileProgram()
+{
+    GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexShader);
+    GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
+    GLuint linked = 0;
+    if (vertex && fragment)
+    {
+        linked = glCreateProgram();
+        glAttachShader(linked, vertex);
+        glAttachShader(linked, fragment);
+        glLinkProgram(linked);
+        GLint status = 0;
+        glGetProgramiv(linked, GL_LINK_STATUS, &status);
+        if (!status)
+        {
+            fprintf(stderr, "OpenGL program did not link\n");
+            glDeleteProgram(linked);
+            linked = 0;
+        }
+    }
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return linked;
+}
+
+uint8_t *GlRenderer::BeginUpload()
+{
+    slot = (slot + 1) % GL_UPLOAD_SLOTS;
+    if (fences[slot])
+    {
+        // Normally long signalled: the GPU read this slot GL_UPLOAD_SLOTS - 1 frames ago
+        if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            fenceWaits++;
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        }
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+    }
+    if (persistent)
+    {
+        return mapped + slot * slotBytes;
+    }
+    // The fence says the GPU is done with this slot, so there is nothing to synchronize with
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    uint8_t *target = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slot * slotBytes, slotBytes,
+                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return target;
+}
+
+void GlRenderer::EndUpload(unsigned int top, unsigned int rows)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    if (!persistent)
+    {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, top, width, rows, GL_RED, GL_UNSIGNED_BYTE, reinterpret_cast<const void *>(slot * slotBytes));
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
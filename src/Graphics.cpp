@@ -1,40 +1,117 @@
 #include "Graphics.hpp"
+#include "Trace.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
-Graphics::Graphics(const char *title)
+// CHIP-8 keypad   PC keyboard
+// 1 2 3 C         1 2 3 4
+// 4 5 6 D         Q W E R
+// 7 8 9 E         A S D F
+// A 0 B F         Z X C V
+static int KeypadIndex(SDL_Keycode key)
 {
+    switch (key)
+    {
+    case SDLK_X: return 0x0;
+    case SDLK_1: return 0x1;
+    case SDLK_2: return 0x2;
+    case SDLK_3: return 0x3;
+    case SDLK_Q: return 0x4;
+    case SDLK_W: return 0x5;
+    case SDLK_E: return 0x6;
+    case SDLK_A: return 0x7;
+    case SDLK_S: return 0x8;
+    case SDLK_D: return 0x9;
+    case SDLK_Z: return 0xA;
+    case SDLK_C: return 0xB;
+    case SDLK_4: return 0xC;
+    case SDLK_R: return 0xD;
+    case SDLK_F: return 0xE;
+    case SDLK_V: return 0xF;
+    }
+    return -1;
+}
+
+static void FitDisplay(int windowWidth, int windowHeight, int displayWidth, int displayHeight, SDL_Rect &rect)
+{
+    // Fit the window, in whole multiples of the display when it is at least that big
+    float scale = std::min(windowWidth / static_cast<float>(displayWidth), windowHeight / static_cast<float>(displayHeight));
+    scale = scale >= 1.0f ? std::floor(scale) : scale;
+    rect.w = static_cast<int>(displayWidth * scale);
+    rect.h = static_cast<int>(displayHeight * scale);
+    rect.x = (windowWidth - rect.w) / 2;
+    rect.y = (windowHeight - rect.h) / 2;
+}
+
+Graphics::Graphics(const char *title, bool offscreen, RenderBackend renderBackend, PresentMode present)
+    : title(title), backend(renderBackend)
+{
+    // Offscreen (--bench): no display needed, software rendering and no vsync so presents are not throttled
+    if (offscreen && !(SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen") && SDL_Init(SDL_INIT_VIDEO)))
+    {
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "dummy");
+    }
+
     // Initialize SDL
     SDL_Init(SDL_INIT_VIDEO);
 
     int panelWidth = 200;
     int panelHeight = 100; 
+    // Swap intervals, which are also SDL_SetRenderVSync's values; offscreen runs never wait for vsync
+    static const int swapIntervals[] = {1, -1, 0};
+    int swapInterval = offscreen ? 0 : swapIntervals[present];
 
-    window = SDL_CreateWindow(title, CHIP8_SCREEN_WIDTH + panelWidth, CHIP8_SCREEN_HEIGHT + panelHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-
-    if (!window)
+    if (backend == RENDER_GL)
     {
-        SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
-        exit(1);
+        // The display only, so the window has no room for panels
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+        window = SDL_CreateWindow(title, CHIP8_SCREEN_WIDTH, CHIP8_SCREEN_HEIGHT, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+        if (!window)
+        {
+            SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
+            exit(1);
+        }
+        auto getProcAddress = reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress);
+        gl_context = SDL_GL_CreateContext(window);
+        if (!gl_context || !gladLoadGLLoader(getProcAddress) || !gl.Init(getProcAddress))
+        {
+            SDL_Log("Failed to create an OpenGL 3.3 renderer: %s", SDL_GetError());
+            exit(1);
+        }
+        // Not every driver does adaptive vsync
+        if (!SDL_GL_SetSwapInterval(swapInterval) && swapInterval < 0)
+        {
+            SDL_GL_SetSwapInterval(1);
+        }
+        return;
     }
 
-    // Create OpenGL Context
-    gl_context = SDL_GL_CreateContext(window);
-    if (!gl_context)
+    // No SDL_WINDOW_OPENGL: SDL_CreateRenderer picks its driver (Direct3D, Metal, Vulkan, GL) and sets the
+    // window up for it
+    window = SDL_CreateWindow(title, CHIP8_SCREEN_WIDTH + panelWidth, CHIP8_SCREEN_HEIGHT + panelHeight, offscreen ? 0 : SDL_WINDOW_RESIZABLE);
+
+    if (!window)
     {
-        SDL_Log("Failed to create OpenGL context: %s", SDL_GetError());
+        SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
         exit(1);
     }
 
-    // Enable V-Sync
-    SDL_GL_SetSwapInterval(1);
-
     // Create SDL Renderer
-    renderer = SDL_CreateRenderer(window, nullptr);
+    renderer = SDL_CreateRenderer(window, offscreen ? "software" : nullptr);
     if (!renderer)
     {
         SDL_Log("Renderer could not be created! SDL_Error: %s", SDL_GetError());
         exit(1);
     }
+    if (!SDL_SetRenderVSync(renderer, swapInterval) && swapInterval < 0)
+    {
+        SDL_SetRenderVSync(renderer, 1);
+    }
     //Create SDL Texture
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
     if (!texture)
@@ -47,26 +124,83 @@ Graphics::Graphics(const char *title)
 
 Graphics::~Graphics()
 {
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
+    if (gl_context)
+    {
+        gl.Shutdown();
+        SDL_GL_DestroyContext(gl_context);
+    }
+    if (renderer)
+    {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+    }
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
 void Graphics::Update(const void *buffer, int pitch)
 {
-    if (!buffer || !texture)
+    TRACE_FUNCTION();
+    if (!texture)
     {
-        SDL_Log("Buffer or Texture is NULL!");
+        SDL_Log("Texture is NULL!");
         return;
     }
 
-    SDL_UpdateTexture(texture, NULL, buffer, pitch);
+    if (buffer)
+    {
+        SDL_UpdateTexture(texture, NULL, buffer, pitch);
+    }
     SDL_RenderClear(renderer);
+    overlayLine = 0;
+}
+
+void Graphics::UpdateVideo(const uint64_t *video)
+{
+    TRACE_FUNCTION();
+    if (post.isOpen())
+    {
+        if (video)
+        {
+            memcpy(postVideo, video, sizeof(postVideo));
+        }
+        {
+            TRACE_SCOPE("PostProcess");
+            post.Process(postVideo);
+        }
+        UploadRows(post.getPixels() + post.getDirtyTop() * post.getPitch(), post.getPitch(), post.getDirtyTop(),
+                   post.getDirtyRows(), static_cast<int>(post.getWidth()));
+        if (backend == RENDER_SDL)
+        {
+            Update(nullptr, 0);
+        }
+        overlayLine = 0;
+        return;
+    }
+    if (backend == RENDER_GL)
+    {
+        if (video)
+        {
+            gl.Upload(video);
+        }
+        overlayLine = 0;
+        return;
+    }
+    if (video)
+    {
+        TRACE_SCOPE("ExpandVideo");
+        ExpandVideo(video, pixels);
+    }
+    Update(video ? pixels : nullptr, sizeof(pixels[0]) * VIDEO_WIDTH);
 }
 
 void Graphics::DisplayRegisters(uint8_t *registers)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, CHIP8_SCREEN_WIDTH, 0, "registers");
     int registerTextHeight = 10;
@@ -83,6 +217,11 @@ void Graphics::DisplayRegisters(uint8_t *registers)
 
 void Graphics::DisplayStack(uint16_t *stack)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
 
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, CHIP8_SCREEN_WIDTH + 80, 0, "stack");
@@ -100,6 +239,11 @@ void Graphics::DisplayStack(uint16_t *stack)
 
 void Graphics::DisplayPC(uint16_t pc)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, CHIP8_SCREEN_WIDTH, 180, "Program Counter");
     char buffer[8];
@@ -109,6 +253,11 @@ void Graphics::DisplayPC(uint16_t pc)
 
 void Graphics::DisplaySP(uint8_t sp)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, CHIP8_SCREEN_WIDTH, 200, "Stack Pointer");
     char buffer[4];
@@ -118,6 +267,11 @@ void Graphics::DisplaySP(uint8_t sp)
 
 void Graphics::DisplayCycleDelay()
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, CHIP8_SCREEN_WIDTH, 220, "Cycle Delay");
     char buffer[4];
@@ -130,6 +284,11 @@ void Graphics::DisplayCycleDelay()
 
 void Graphics::DisplayMemory(uint8_t *memory)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE); /* white, full alpha */
     SDL_RenderDebugText(renderer, 0, CHIP8_SCREEN_HEIGHT, "Memory: Use up & down arrow keys to scroll through");
     for (int row = 0; row < (visibleRows / 2); row++)
@@ -152,6 +311,11 @@ void Graphics::DisplayMemory(uint8_t *memory)
 
 void Graphics::DistplayInstructions(std::string instruction)
 {
+    TRACE_FUNCTION();
+    if (!renderer)
+    {
+        return;
+    }
     SDL_RenderDebugText(renderer, PANEL_X + 500, CHIP8_SCREEN_HEIGHT, "Instructions");
     instructionQueue.push(instruction);
     const int queueSize = instructionQueue.size();
@@ -169,8 +333,143 @@ void Graphics::DistplayInstructions(std::string instruction)
     }
 }
 
+void Graphics::DrawOverlayLine(const char *text)
+{
+    // Overlay lines stack down from the top-left corner of the CHIP-8 screen, toggled with F1
+    if (!renderer)
+    {
+        return; // RENDER_GL has no text drawing
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    SDL_FRect background = {0.0f, overlayLine * 10.0f, 8.0f * strlen(text) + 4.0f, 10.0f};
+    SDL_RenderFillRect(renderer, &background);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 0, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugText(renderer, 2, overlayLine * 10.0f + 1, text);
+    overlayLine++;
+}
+
+void Graphics::DisplayLatency(const LatencyTracker &tracker)
+{
+    TRACE_FUNCTION();
+    if (!showOverlay)
+    {
+        return;
+    }
+    DrawOverlayLine("latency ms       n   p50   p99");
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        const LatencyHistogram &histogram = tracker.getHistogram(stage);
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%-14s%6llu%6.1f%6.1f", LatencyTracker::getStageName(stage),
+                 static_cast<unsigned long long>(histogram.getCount() % 1000000), histogram.Percentile(50),
+                 histogram.Percentile(99));
+        DrawOverlayLine(buffer);
+    }
+}
+
+void Graphics::DisplayRunAhead(int frames, float saveUs, float aheadUs, float restoreUs, float framePercent)
+{
+    TRACE_FUNCTION();
+    if (!showOverlay || frames == 0)
+    {
+        return;
+    }
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "run-ahead %d: %.1f%% of frame", frames, framePercent);
+    DrawOverlayLine(buffer);
+    snprintf(buffer, sizeof(buffer), " save %.1f run %.1f load %.1f us", saveUs, aheadUs, restoreUs);
+    DrawOverlayLine(buffer);
+}
+
+void Graphics::DisplayNetplay(const NetplayStats &stats)
+{
+    TRACE_FUNCTION();
+    // Desyncs are shown even with the overlay hidden
+    if (stats.desynced || stats.incompatible)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), stats.incompatible ? "NETPLAY: PEER RUNS ANOTHER ROM/SEED" : "NETPLAY DESYNC AT FRAME %u",
+                 stats.desyncFrame);
+        DrawOverlayLine(buffer);
+    }
+    if (!showOverlay)
+    {
+        return;
+    }
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "net frame %u ahead %u stalls %llu", stats.frame, stats.frame - 1 - stats.confirmedFrame,
+             static_cast<unsigned long long>(stats.stalls));
+    DrawOverlayLine(buffer);
+    snprintf(buffer, sizeof(buffer), "rollbacks %llu max %u f %.0f us", static_cast<unsigned long long>(stats.rollbacks),
+             stats.maxRollbackFrames, stats.maxResimUs);
+    DrawOverlayLine(buffer);
+}
+
+void Graphics::DisplaySpeed(float speed, float emulatedFps)
+{
+    TRACE_FUNCTION();
+    // Always shown when not running at normal speed
+    if (speed == 1.0f && !showOverlay)
+    {
+        return;
+    }
+    char buffer[64];
+    if (speed <= 0.0f)
+    {
+        snprintf(buffer, sizeof(buffer), "speed uncapped %.0f fps", emulatedFps);
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "speed %.2gx %.0f fps", speed, emulatedFps);
+    }
+    DrawOverlayLine(buffer);
+}
+
+void Graphics::DisplayRecording()
+{
+    // Always shown while recording; the overlay is drawn over the window, so it never ends up in the clip
+    if (!clip || !clip->isRecording())
+    {
+        return;
+    }
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "REC %s", clip->getFilename().c_str());
+    DrawOverlayLine(buffer);
+}
+
+void Graphics::DisplayTelemetry(const TelemetrySnapshot &snapshot)
+{
+    TRACE_FUNCTION();
+    if (!showOverlay)
+    {
+        return;
+    }
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "ips %.0f  cpu %.1f%%", snapshot.instructionsPerSecond, snapshot.cpuPercent);
+    DrawOverlayLine(buffer);
+    snprintf(buffer, sizeof(buffer), "fps emu %.1f host %.1f  x%.2f", snapshot.emulatedFps, snapshot.hostFps,
+             snapshot.realtimeRatio);
+    DrawOverlayLine(buffer);
+    snprintf(buffer, sizeof(buffer), "frame ms p50 %.2f p99 %.2f max %.1f", snapshot.frameP50Ms, snapshot.frameP99Ms,
+             snapshot.frameMaxMs);
+    DrawOverlayLine(buffer);
+    snprintf(buffer, sizeof(buffer), "uploads skipped %llu  behind %.0f ms",
+             static_cast<unsigned long long>(snapshot.uploadsSkipped), snapshot.behindMs);
+    DrawOverlayLine(buffer);
+}
+
 void Graphics::DrawDebugBordrer()
 {
+    TRACE_FUNCTION();
+    if (backend == RENDER_GL)
+    {
+        int width, height;
+        SDL_GetWindowSizeInPixels(window, &width, &height);
+        SDL_Rect screen;
+        FitDisplay(width, height, gl.getWidth(), gl.getHeight(), screen);
+        gl.Draw(width, height, screen.x, screen.y, screen.w, screen.h);
+        return;
+    }
     // Define Chip8 screen position
     SDL_FRect chip8ScreenRect = {0.0f, 0.0f, CHIP8_SCREEN_WIDTH, CHIP8_SCREEN_HEIGHT}; // Use floats for SDL_FRect
     SDL_RenderTexture(renderer, texture, NULL, &chip8ScreenRect);
@@ -190,13 +489,129 @@ void Graphics::DrawDebugBordrer()
 
 void Graphics::EndDraw()
 {
+    TRACE_FUNCTION();
+    if (backend == RENDER_GL)
+    {
+        SDL_GL_SwapWindow(window);
+        return;
+    }
     // Reset render color to prevent affecting other elements
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Reset to black (or your background color)
     SDL_RenderPresent(renderer);
 }
 
+WallFormat Graphics::getWallFormat() const
+{
+    return backend == RENDER_GL ? WALL_LUMA : WALL_RGBA;
+}
+
+void Graphics::OpenWall(const VideoWall &wall)
+{
+    wallWidth = static_cast<int>(wall.getWidth());
+    wallHeight = static_cast<int>(wall.getHeight());
+    CreateDisplayTexture(wallWidth, wallHeight, "video wall");
+    // The largest whole multiple of the atlas that fits the display, or the atlas shrunk to fit
+    SDL_Rect usable{0, 0, 1280, 720};
+    SDL_GetDisplayUsableBounds(SDL_GetDisplayForWindow(window), &usable);
+    SDL_Rect size;
+    FitDisplay(usable.w * 9 / 10, usable.h * 9 / 10, wallWidth, wallHeight, size);
+    SDL_SetWindowSize(window, size.w, size.h);
+}
+
+void Graphics::UpdateWall(const VideoWall &wall)
+{
+    TRACE_FUNCTION();
+    unsigned int top = wall.getDirtyTop();
+    UploadRows(wall.getPixels() + top * wall.getPitch(), wall.getPitch(), top, wall.getDirtyRows(), wallWidth);
+}
+
+void Graphics::DrawWall()
+{
+    TRACE_FUNCTION();
+    int width, height;
+    SDL_Rect screen;
+    if (backend == RENDER_GL)
+    {
+        SDL_GetWindowSizeInPixels(window, &width, &height);
+        FitDisplay(width, height, wallWidth, wallHeight, screen);
+        gl.Draw(width, height, screen.x, screen.y, screen.w, screen.h);
+        return;
+    }
+    SDL_GetCurrentRenderOutputSize(renderer, &width, &height);
+    FitDisplay(width, height, wallWidth, wallHeight, screen);
+    SDL_FRect target{static_cast<float>(screen.x), static_cast<float>(screen.y), static_cast<float>(screen.w),
+                     static_cast<float>(screen.h)};
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, texture, nullptr, &target);
+}
+
+void Graphics::OpenPostProcess(const PostOptions &options)
+{
+    PostOptions chosen = options;
+    SDL_Rect usable{0, 0, 1280, 720};
+    SDL_GetDisplayUsableBounds(SDL_GetDisplayForWindow(window), &usable);
+    if (chosen.scale == 0)
+    {
+        // The OpenGL window shows only the display, so it can grow to most of the screen
+        int fit = std::min(usable.w * 9 / 10 / static_cast<int>(VIDEO_WIDTH), usable.h * 9 / 10 / static_cast<int>(VIDEO_HEIGHT));
+        chosen.scale = backend == RENDER_GL ? std::max(1, fit) : static_cast<int>(CHIP8_SCREEN_WIDTH) / VIDEO_WIDTH;
+    }
+    if (!post.Open(chosen, backend == RENDER_GL ? POST_LUMA : POST_RGBA))
+    {
+        SDL_Log("Post-processing needs a scale of 1 to %u and percentages of 0 to 100", POST_MAX_SCALE);
+        exit(1);
+    }
+    int width = static_cast<int>(post.getWidth()), height = static_cast<int>(post.getHeight());
+    CreateDisplayTexture(width, height, "post-processing");
+    if (backend == RENDER_GL)
+    {
+        SDL_Rect size;
+        FitDisplay(usable.w * 9 / 10, usable.h * 9 / 10, width, height, size);
+        SDL_SetWindowSize(window, size.w, size.h);
+    }
+}
+
+void Graphics::CreateDisplayTexture(int width, int height, const char *what)
+{
+    if (backend == RENDER_GL)
+    {
+        gl.Shutdown();
+        if (!gl.Init(reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress), width, height))
+        {
+            SDL_Log("Failed to create a %dx%d %s texture", width, height, what);
+            exit(1);
+        }
+        return;
+    }
+    SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!texture)
+    {
+        SDL_Log("Failed to create a %dx%d %s texture: %s", width, height, what, SDL_GetError());
+        exit(1);
+    }
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+}
+
+void Graphics::UploadRows(const uint8_t *pixels, size_t pitch, unsigned int top, unsigned int rows, int width)
+{
+    if (rows == 0)
+    {
+        return;
+    }
+    if (backend == RENDER_GL)
+    {
+        gl.UploadRows(pixels, pitch, top, rows);
+        return;
+    }
+    SDL_Rect rect{0, static_cast<int>(top), width, static_cast<int>(rows)};
+    SDL_UpdateTexture(texture, &rect, pixels, static_cast<int>(pitch));
+}
+
 bool Graphics::ProcessInput(uint8_t *keys)
 {
+    TRACE_FUNCTION();
     bool quit = false;
     SDL_Event event;
     while (SDL_PollEvent(&event))
@@ -247,211 +662,140 @@ bool Graphics::ProcessInput(uint8_t *keys)
             }
             break;
 
-            case SDLK_X:
+            case SDLK_F1:
             {
-                keys[0] = 1;
+                showOverlay = !showOverlay;
             }
             break;
 
-            case SDLK_1:
+            case SDLK_TAB:
             {
-                keys[1] = 1;
+                fastForward = true;
             }
             break;
 
-            case SDLK_2:
+            case SDLK_P:
+            case SDLK_PAUSE:
             {
-                keys[2] = 1;
-            }
-            break;
-
-            case SDLK_3:
-            {
-                keys[3] = 1;
-            }
-            break;
-
-            case SDLK_Q:
-            {
-                keys[4] = 1;
-            }
-            break;
-
-            case SDLK_W:
-            {
-                keys[5] = 1;
-            }
-            break;
-
-            case SDLK_E:
-            {
-                keys[6] = 1;
-            }
-            break;
-
-            case SDLK_A:
-            {
-                keys[7] = 1;
-            }
-            break;
-
-            case SDLK_S:
-            {
-                keys[8] = 1;
-            }
-            break;
-
-            case SDLK_D:
-            {
-                keys[9] = 1;
-            }
-            break;
-
-            case SDLK_Z:
-            {
-                keys[0xA] = 1;
+                if (pausable && !event.key.repeat)
+                {
+                    paused = !paused;
+                    SDL_SetWindowTitle(window, (paused ? title + " (paused)" : title).c_str());
+                }
             }
             break;
 
-            case SDLK_C:
+            case SDLK_F9:
             {
-                keys[0xB] = 1;
+                if (clip && !event.key.repeat)
+                {
+                    if (clip->isRecording())
+                    {
+                        clip->Stop();
+                    }
+                    else
+                    {
+                        clip->Start();
+                    }
+                }
             }
             break;
 
-            case SDLK_4:
+            default:
             {
-                keys[0xC] = 1;
+                int pad = KeypadIndex(event.key.key);
+                if (pad >= 0)
+                {
+                    keys[pad] = 1;
+                    if (latency && !event.key.repeat)
+                    {
+                        latency->KeyPressed(pad, event.key.timestamp);
+                    }
+                }
             }
             break;
-
-            case SDLK_R:
-            {
-                keys[0xD] = 1;
             }
-            break;
+        }
+        break;
 
-            case SDLK_F:
-            {
-                keys[0xE] = 1;
-            }
-            break;
+        case SDL_EVENT_WINDOW_SHOWN:
+        case SDL_EVENT_WINDOW_HIDDEN:
+        case SDL_EVENT_WINDOW_MINIMIZED:
+        case SDL_EVENT_WINDOW_RESTORED:
+        case SDL_EVENT_WINDOW_OCCLUDED:
+        case SDL_EVENT_WINDOW_EXPOSED:
+        {
+            // The flags already reflect the event, and cover states reached through several of them
+            visible = !(SDL_GetWindowFlags(window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED | SDL_WINDOW_OCCLUDED));
+            redraw |= event.type == SDL_EVENT_WINDOW_EXPOSED;
+        }
+        break;
 
-            case SDLK_V:
-            {
-                keys[0xF] = 1;
-            }
-            break;
-            }
+        case SDL_EVENT_WINDOW_FOCUS_GAINED:
+        case SDL_EVENT_WINDOW_FOCUS_LOST:
+        {
+            focused = event.type == SDL_EVENT_WINDOW_FOCUS_GAINED;
         }
         break;
 
         case SDL_EVENT_KEY_UP:
         {
-            switch (event.key.key)
-            {
-            case SDLK_X:
-            {
-                keys[0] = 0;
-            }
-            break;
-
-            case SDLK_1:
-            {
-                keys[1] = 0;
-            }
-            break;
-
-            case SDLK_2:
-            {
-                keys[2] = 0;
-            }
-            break;
-
-            case SDLK_3:
-            {
-                keys[3] = 0;
-            }
-            break;
-
-            case SDLK_Q:
-            {
-                keys[4] = 0;
-            }
-            break;
-
-            case SDLK_W:
-            {
-                keys[5] = 0;
-            }
-            break;
-
-            case SDLK_E:
-            {
-                keys[6] = 0;
-            }
-            break;
-
-            case SDLK_A:
+            if (event.key.key == SDLK_TAB)
             {
-                keys[7] = 0;
+                fastForward = false;
             }
-            break;
-
-            case SDLK_S:
+            int pad = KeypadIndex(event.key.key);
+            if (pad >= 0)
             {
-                keys[8] = 0;
+                keys[pad] = 0;
             }
-            break;
-
-            case SDLK_D:
-            {
-                keys[9] = 0;
-            }
-            break;
+        }
+        break;
+        }
+    }
 
-            case SDLK_Z:
-            {
-                keys[0xA] = 0;
-            }
-            break;
+    return quit;
+}
 
-            case SDLK_C:
-            {
-                keys[0xB] = 0;
-            }
-            break;
+void Graphics::WaitForEvents(int timeoutMs)
+{
+    TRACE_FUNCTION();
+    // A null event leaves it queued for ProcessInput
+    if (timeoutMs < 0)
+    {
+        SDL_WaitEvent(nullptr);
+    }
+    else if (timeoutMs > 0)
+    {
+        SDL_WaitEventTimeout(nullptr, timeoutMs);
+    }
+}
 
-            case SDLK_4:
-            {
-                keys[0xC] = 0;
-            }
-            break;
+bool Graphics::isVisible() const
+{
+    return visible;
+}
 
-            case SDLK_R:
-            {
-                keys[0xD] = 0;
-            }
-            break;
+bool Graphics::hasFocus() const
+{
+    return focused;
+}
 
-            case SDLK_F:
-            {
-                keys[0xE] = 0;
-            }
-            break;
+bool Graphics::isPaused() const
+{
+    return paused;
+}
 
-            case SDLK_V:
-            {
-                keys[0xF] = 0;
-            }
-            break;
-            }
-        }
-        break;
-        }
-    }
+void Graphics::setPausable(bool canPause)
+{
+    pausable = canPause;
+}
 
-    return quit;
+bool Graphics::ConsumeRedraw()
+{
+    bool exposed = redraw;
+    redraw = false;
+    return exposed;
 }
 
 int Graphics::getCycleDelay()
@@ -463,3 +807,18 @@ void Graphics::setCycleDelay(int delay)
 {
     cycleDelay = delay;
 }
+
+void Graphics::setLatencyTracker(LatencyTracker *tracker)
+{
+    latency = tracker;
+}
+
+void Graphics::setClipRecorder(ClipRecorder *recorder)
+{
+    clip = recorder;
+}
+
+bool Graphics::isFastForward()
+{
+    return fastForward;
+}
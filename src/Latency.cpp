@@ -0,0 +1,185 @@
+#include "Latency.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void LatencyHistogram::Add(uint64_t ns)
+{
+    uint64_t bucket = ns / (LATENCY_BUCKET_US * 1000ull);
+    if (bucket >= LATENCY_BUCKETS)
+    {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+    buckets[bucket]++;
+    count++;
+    totalNs += ns;
+    if (ns > maxNs)
+    {
+        maxNs = ns;
+    }
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return count;
+}
+
+double LatencyHistogram::getMeanMs() const
+{
+    return count ? totalNs / 1e6 / count : 0.0;
+}
+
+double LatencyHistogram::getMaxMs() const
+{
+    return maxNs / 1e6;
+}
+
+double LatencyHistogram::Percentile(double p) const
+{
+    if (count == 0)
+    {
+        return 0.0;
+    }
+    // nearest-rank percentile
+    uint64_t target = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+    target = std::max<uint64_t>(target, 1);
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+        {
+            return std::min((i + 1) * LATENCY_BUCKET_US / 1000.0, getMaxMs());
+        }
+    }
+    return getMaxMs();
+}
+
+const uint64_t *LatencyHistogram::getBuckets() const
+{
+    return buckets;
+}
+
+void LatencyTracker::KeyPressed(uint8_t key, uint64_t timestampNs)
+{
+    // Only one press is followed at a time; a new one replaces a press the game ignored
+    if (phase != IDLE && !Expired(timestampNs))
+    {
+        return;
+    }
+    phase = WAIT_POLL;
+    trackedKey = key;
+    keyTime = timestampNs;
+}
+
+void LatencyTracker::KeypadPolled(uint16_t keysRead, uint64_t nowNs)
+{
+    if (Expired(nowNs) || phase != WAIT_POLL || !(keysRead & (1u << trackedKey)))
+    {
+        return;
+    }
+    pollTime = nowNs;
+    histograms[LATENCY_INPUT_TO_POLL].Add(pollTime - keyTime);
+    phase = WAIT_FRAME;
+}
+
+void LatencyTracker::VideoChanged(uint16_t keysReadBefore, uint64_t nowNs)
+{
+    if (Expired(nowNs) || phase != WAIT_FRAME || !(keysReadBefore & (1u << trackedKey)))
+    {
+        return;
+    }
+    frameTime = nowNs;
+    histograms[LATENCY_POLL_TO_FRAME].Add(frameTime - pollTime);
+    phase = WAIT_PRESENT;
+}
+
+void LatencyTracker::Presented(uint64_t nowNs)
+{
+    if (Expired(nowNs) || phase != WAIT_PRESENT)
+    {
+        return;
+    }
+    histograms[LATENCY_FRAME_TO_PRESENT].Add(nowNs - frameTime);
+    histograms[LATENCY_INPUT_TO_PRESENT].Add(nowNs - keyTime);
+    phase = IDLE;
+}
+
+bool LatencyTracker::isTracking() const
+{
+    return phase != IDLE;
+}
+
+uint64_t LatencyTracker::getDropped() const
+{
+    return dropped;
+}
+
+bool LatencyTracker::Expired(uint64_t nowNs)
+{
+    // nowNs before keyTime would wrap; treat it as not yet timed out
+    if (phase == IDLE || nowNs < keyTime || nowNs - keyTime < LATENCY_TIMEOUT_NS)
+    {
+        return false;
+    }
+    phase = IDLE;
+    dropped++;
+    return true;
+}
+
+const LatencyHistogram &LatencyTracker::getHistogram(int stage) const
+{
+    return histograms[stage];
+}
+
+const char *LatencyTracker::getStageName(int stage)
+{
+    switch (stage)
+    {
+    case LATENCY_INPUT_TO_POLL:
+        return "input->poll";
+    case LATENCY_POLL_TO_FRAME:
+        return "poll->frame";
+    case LATENCY_FRAME_TO_PRESENT:
+        return "frame->present";
+    case LATENCY_INPUT_TO_PRESENT:
+        return "input->present";
+    }
+    return "?";
+}
+
+bool LatencyTracker::Dump(const char *filename) const
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        return false;
+    }
+    // Summary first, then the raw non-empty buckets so runs can be re-plotted
+    fprintf(file, "# stage count mean_ms p50_ms p90_ms p99_ms max_ms\n");
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        const LatencyHistogram &histogram = histograms[stage];
+        fprintf(file, "%s %llu %.3f %.3f %.3f %.3f %.3f\n", getStageName(stage),
+                static_cast<unsigned long long>(histogram.getCount()), histogram.getMeanMs(),
+                histogram.Percentile(50), histogram.Percentile(90), histogram.Percentile(99),
+                histogram.getMaxMs());
+    }
+    fprintf(file, "# dropped %llu presses with no change on screen within %llu ms\n",
+            static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(LATENCY_TIMEOUT_NS / 1000000));
+    fprintf(file, "\n# stage bucket_start_ms count\n");
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        const uint64_t *buckets = histograms[stage].getBuckets();
+        for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            if (buckets[i])
+            {
+                fprintf(file, "%s %.2f %llu\n", getStageName(stage), i * LATENCY_BUCKET_US / 1000.0,
+                        static_cast<unsigned long long>(buckets[i]));
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
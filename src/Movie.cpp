@@ -0,0 +1,303 @@
+#include "Movie.hpp"
+#include <cstring>
+#include <iostream>
+
+static void WriteBytes(std::ofstream &file, const void *data, size_t size)
+{
+    file.write(static_cast<const char *>(data), size);
+}
+
+static void WriteVarint(std::ofstream &file, uint32_t value)
+{
+    while (value >= 0x80u)
+    {
+        file.put(static_cast<char>((value & 0x7Fu) | 0x80u));
+        value >>= 7;
+    }
+    file.put(static_cast<char>(value));
+}
+
+static bool ReadBytes(std::ifstream &file, void *data, size_t size)
+{
+    return static_cast<bool>(file.read(static_cast<char *>(data), size));
+}
+
+static bool ReadVarint(std::ifstream &file, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        int byte = file.get();
+        if (byte == EOF)
+        {
+            return false;
+        }
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+MovieRecorder::~MovieRecorder()
+{
+    if (file.is_open())
+    {
+        FlushRun();
+        file.close();
+    }
+}
+
+bool MovieRecorder::Open(const char *filename, const Chip8 &chip8, uint32_t interval)
+{
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    keyframeInterval = interval ? interval : MOVIE_DEFAULT_KEYFRAME_INTERVAL;
+    frame = 0;
+    runLength = 0;
+
+    uint64_t romHash = chip8.getRomHash();
+    uint32_t seed = chip8.getSeed();
+    uint32_t stateSize = sizeof(Chip8State);
+    file.write("C8MV", 4);
+    WriteBytes(file, &MOVIE_VERSION, sizeof(MOVIE_VERSION));
+    WriteBytes(file, &QUIRKS_DEFAULT, sizeof(QUIRKS_DEFAULT));
+    WriteBytes(file, &romHash, sizeof(romHash));
+    WriteBytes(file, &seed, sizeof(seed));
+    WriteBytes(file, &keyframeInterval, sizeof(keyframeInterval));
+    WriteBytes(file, &stateSize, sizeof(stateSize));
+    return static_cast<bool>(file);
+}
+
+void MovieRecorder::RecordFrame(const Chip8 &chip8, unsigned int cycles)
+{
+    // Past MOVIE_MAX_FRAMES the player would reject the movie, so the recording ends there
+    if (!file.is_open() || frame >= MOVIE_MAX_FRAMES)
+    {
+        return;
+    }
+    if (frame % keyframeInterval == 0)
+    {
+        FlushRun();
+        // Written as raw bytes, so the padding between fields is zeroed too; {} does not promise that
+        Chip8State state;
+        memset(&state, 0, sizeof(state));
+        chip8.SaveState(state);
+        uint64_t videoHash = chip8.HashVideo();
+        file.put('K');
+        WriteVarint(file, frame);
+        WriteBytes(file, &videoHash, sizeof(videoHash));
+        WriteBytes(file, &state, sizeof(state));
+    }
+
+    MovieInput input{chip8.getKeypadMask(), static_cast<uint16_t>(cycles)};
+    if (runLength && (input.keys != run.keys || input.cycles != run.cycles))
+    {
+        FlushRun();
+    }
+    run = input;
+    runLength++;
+    frame++;
+}
+
+void MovieRecorder::FlushRun()
+{
+    if (runLength == 0)
+    {
+        return;
+    }
+    file.put('I');
+    WriteVarint(file, runLength);
+    WriteBytes(file, &run.keys, sizeof(run.keys));
+    WriteVarint(file, run.cycles);
+    runLength = 0;
+}
+
+void MovieRecorder::Close(const Chip8 &chip8)
+{
+    if (!file.is_open())
+    {
+        return;
+    }
+    FlushRun();
+    uint64_t videoHash = chip8.HashVideo();
+    file.put('E');
+    WriteVarint(file, frame);
+    WriteBytes(file, &videoHash, sizeof(videoHash));
+    file.close();
+}
+
+bool MovieRecorder::isRecording() const
+{
+    return file.is_open();
+}
+
+bool MoviePlayer::Open(const char *filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not open movie " << filename << "\n";
+        return false;
+    }
+
+    char magic[4];
+    uint16_t version;
+    uint32_t stateSize;
+    if (!ReadBytes(file, magic, sizeof(magic)) || memcmp(magic, "C8MV", 4) != 0 ||
+        !ReadBytes(file, &version, sizeof(version)) || version != MOVIE_VERSION ||
+        !ReadBytes(file, &header.quirks, sizeof(header.quirks)) ||
+        !ReadBytes(file, &header.romHash, sizeof(header.romHash)) ||
+        !ReadBytes(file, &header.seed, sizeof(header.seed)) ||
+        !ReadBytes(file, &header.keyframeInterval, sizeof(header.keyframeInterval)) ||
+        !ReadBytes(file, &stateSize, sizeof(stateSize)) || stateSize != sizeof(Chip8State))
+    {
+        std::cerr << "Unsupported movie " << filename << "\n";
+        return false;
+    }
+
+    inputs.clear();
+    keyframes.clear();
+    complete = false;
+    int tag;
+    while ((tag = file.get()) != EOF)
+    {
+        if (tag == 'I')
+        {
+            uint32_t length, cycles;
+            MovieInput input;
+            if (!ReadVarint(file, length) || !ReadBytes(file, &input.keys, sizeof(input.keys)) ||
+                !ReadVarint(file, cycles))
+            {
+                break;
+            }
+            // The run length comes from the file, so it is bounded before anything is allocated for it
+            if (length > MOVIE_MAX_FRAMES - inputs.size())
+            {
+                std::cerr << "Invalid movie " << filename << ": more than " << MOVIE_MAX_FRAMES << " frames\n";
+                return false;
+            }
+            input.cycles = static_cast<uint16_t>(cycles);
+            inputs.insert(inputs.end(), length, input);
+        }
+        else if (tag == 'K')
+        {
+            Keyframe keyframe;
+            if (!ReadVarint(file, keyframe.frame) || !ReadBytes(file, &keyframe.videoHash, sizeof(keyframe.videoHash)) ||
+                !ReadBytes(file, &keyframe.state, sizeof(keyframe.state)))
+            {
+                break;
+            }
+            keyframes.push_back(keyframe);
+        }
+        else if (tag == 'E')
+        {
+            uint32_t frameCount;
+            if (ReadVarint(file, frameCount) && ReadBytes(file, &finalVideoHash, sizeof(finalVideoHash)) &&
+                frameCount == inputs.size())
+            {
+                complete = true;
+                return true;
+            }
+            break;
+        }
+        else
+        {
+            break;
+        }
+    }
+    // A recording cut short by a crash is still playable up to the last complete record
+    std::cerr << "Movie " << filename << " is truncated, playing " << inputs.size() << " frames\n";
+    return true;
+}
+
+const MovieHeader &MoviePlayer::getHeader() const
+{
+    return header;
+}
+
+uint32_t MoviePlayer::getFrameCount() const
+{
+    return static_cast<uint32_t>(inputs.size());
+}
+
+uint32_t MoviePlayer::getFrame() const
+{
+    return frame;
+}
+
+uint32_t MoviePlayer::getMismatches() const
+{
+    return mismatches;
+}
+
+bool MoviePlayer::isFinished() const
+{
+    return frame >= inputs.size();
+}
+
+void MoviePlayer::Start(Chip8 &chip8)
+{
+    chip8.Seed(header.seed);
+    frame = 0;
+    nextKeyframe = 0;
+    mismatches = 0;
+}
+
+bool MoviePlayer::Seek(Chip8 &chip8, uint32_t target)
+{
+    if (target > inputs.size())
+    {
+        return false;
+    }
+    size_t best = keyframes.size();
+    for (size_t i = 0; i < keyframes.size() && keyframes[i].frame <= target; i++)
+    {
+        best = i;
+    }
+    if (best == keyframes.size())
+    {
+        return false;
+    }
+    chip8.LoadState(keyframes[best].state);
+    frame = keyframes[best].frame;
+    nextKeyframe = best;
+
+    unsigned int cycles;
+    while (frame < target && NextFrame(chip8, cycles))
+    {
+        chip8.RunFrame(cycles);
+    }
+    return true;
+}
+
+bool MoviePlayer::NextFrame(Chip8 &chip8, unsigned int &cycles)
+{
+    if (frame >= inputs.size())
+    {
+        return false;
+    }
+    // Keyframes double as checkpoints while playing straight through
+    while (nextKeyframe < keyframes.size() && keyframes[nextKeyframe].frame <= frame)
+    {
+        if (keyframes[nextKeyframe].frame == frame && keyframes[nextKeyframe].videoHash != chip8.HashVideo())
+        {
+            mismatches++;
+        }
+        nextKeyframe++;
+    }
+    chip8.setKeypadMask(inputs[frame].keys);
+    cycles = inputs[frame].cycles;
+    frame++;
+    return true;
+}
+
+bool MoviePlayer::VerifyEnd(const Chip8 &chip8) const
+{
+    return !complete || finalVideoHash == chip8.HashVideo();
+}
@@ -0,0 +1,391 @@
+#include "Netplay.hpp"
+#include <chrono>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define CLOSE_SOCKET closesocket
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CLOSE_SOCKET close
+#endif
+
+const uint32_t NETPLAY_MAGIC = 0x504E3843; // "C8NP"
+
+// Packet layout (little-endian):
+//   u32 magic, u64 ROM hash, u32 seed, u16 cycles per frame, u8 sender's player,
+//   i32 last frame of the receiver's input the sender has, i32 hashed frame, u64 state hash,
+//   u32 first input frame, u8 input count, u16 inputs[count]
+const size_t NETPLAY_HEADER_SIZE = 4 + 8 + 4 + 2 + 1 + 4 + 4 + 8 + 4 + 1;
+
+template <typename T>
+static void Put(std::vector<uint8_t> &packet, T value)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    packet.insert(packet.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static T Get(const uint8_t *&data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+UdpSocket::UdpSocket()
+{
+    handle = -1;
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+UdpSocket::~UdpSocket()
+{
+    if (handle != -1)
+    {
+        CLOSE_SOCKET(static_cast<int>(handle));
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool UdpSocket::Open(uint16_t localPort)
+{
+    int fd = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (fd < 0)
+    {
+        return false;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(localPort);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        CLOSE_SOCKET(fd);
+        return false;
+    }
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ioctlsocket(fd, FIONBIO, &nonBlocking);
+#else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    handle = fd;
+    return true;
+}
+
+bool UdpSocket::SetPeer(const char *host, uint16_t port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result)
+    {
+        return false;
+    }
+    sockaddr_in address;
+    memcpy(&address, result->ai_addr, sizeof(address));
+    address.sin_port = htons(port);
+    memcpy(peerAddress, &address, sizeof(address));
+    freeaddrinfo(result);
+    return true;
+}
+
+void UdpSocket::Send(const uint8_t *data, size_t size)
+{
+    sendto(static_cast<int>(handle), reinterpret_cast<const char *>(data), static_cast<int>(size), 0,
+           reinterpret_cast<const sockaddr *>(peerAddress), sizeof(sockaddr_in));
+}
+
+int UdpSocket::Receive(uint8_t *data, size_t capacity)
+{
+    int received = static_cast<int>(recv(static_cast<int>(handle), reinterpret_cast<char *>(data), static_cast<int>(capacity), 0));
+    return received > 0 ? received : -1;
+}
+
+bool RollbackSession::Start(const Chip8 &chip8, int localPlayer, uint16_t localPort, const char *peerHost, uint16_t peerPort,
+                            unsigned int cycles, NetConditions injected)
+{
+    if (!socket.Open(localPort) || !socket.SetPeer(peerHost, peerPort))
+    {
+        std::cerr << "Could not open UDP port " << localPort << " to " << peerHost << ":" << peerPort << "\n";
+        return false;
+    }
+    conditions = injected;
+    romHash = chip8.getRomHash();
+    seed = chip8.getSeed();
+    cyclesPerFrame = static_cast<uint16_t>(cycles);
+    player = static_cast<uint8_t>(localPlayer);
+    localMask = localPlayer == 1 ? PLAYER_ONE_KEYS : PLAYER_TWO_KEYS;
+    for (unsigned int i = 0; i < NETPLAY_RING; i++)
+    {
+        slots[i].frame = UINT32_MAX;
+        remoteFrames[i] = -1;
+        localHashFrames[i] = -1;
+    }
+    return true;
+}
+
+void RollbackSession::Poll(Chip8 &chip8, double nowMs)
+{
+    Receive(nowMs);
+    if (rollbackFrame >= 0)
+    {
+        Resimulate(chip8);
+    }
+    UpdateConfirmed(chip8);
+    Send(nowMs);
+}
+
+bool RollbackSession::AdvanceFrame(Chip8 &chip8, uint16_t keys, double nowMs)
+{
+    Receive(nowMs);
+    if (rollbackFrame >= 0)
+    {
+        Resimulate(chip8);
+    }
+    UpdateConfirmed(chip8);
+
+    // Never run further ahead than the saved frames can roll back
+    if (static_cast<int64_t>(frame) > remoteConfirmed + static_cast<int64_t>(NETPLAY_MAX_ROLLBACK))
+    {
+        stats.stalls++;
+        Send(nowMs);
+        return false;
+    }
+
+    FrameSlot &slot = slots[frame % NETPLAY_RING];
+    slot.frame = frame;
+    slot.local = keys & localMask;
+    slot.remote = PredictRemote(frame);
+    chip8.SaveState(slot.state);
+    chip8.SaveLatches(slot.latches);
+    RunSlot(chip8, slot);
+    frame++;
+    stats.frame = frame;
+
+    UpdateConfirmed(chip8);
+    Send(nowMs);
+    return true;
+}
+
+const NetplayStats &RollbackSession::getStats() const
+{
+    return stats;
+}
+
+uint16_t RollbackSession::getLocalMask() const
+{
+    return localMask;
+}
+
+void RollbackSession::RunSlot(Chip8 &chip8, const FrameSlot &slot)
+{
+    chip8.setKeypadMask(slot.local | slot.remote);
+    chip8.RunFrame(cyclesPerFrame);
+}
+
+uint16_t RollbackSession::PredictRemote(uint32_t target) const
+{
+    if (remoteFrames[target % NETPLAY_RING] == target)
+    {
+        return remoteInputs[target % NETPLAY_RING];
+    }
+    // Players hold keys for many frames, so the last known input is the best guess
+    if (remoteConfirmed >= 0)
+    {
+        return remoteInputs[remoteConfirmed % NETPLAY_RING];
+    }
+    return 0;
+}
+
+void RollbackSession::Receive(double nowMs)
+{
+    Flush(nowMs);
+    uint8_t packet[NETPLAY_HEADER_SIZE + 2 * 255];
+    int size;
+    while ((size = socket.Receive(packet, sizeof(packet))) >= static_cast<int>(NETPLAY_HEADER_SIZE))
+    {
+        const uint8_t *data = packet;
+        if (Get<uint32_t>(data) != NETPLAY_MAGIC)
+        {
+            continue;
+        }
+        uint64_t peerRom = Get<uint64_t>(data);
+        uint32_t peerSeed = Get<uint32_t>(data);
+        uint16_t peerCycles = Get<uint16_t>(data);
+        uint8_t peerPlayer = Get<uint8_t>(data);
+        if (peerRom != romHash || peerSeed != seed || peerCycles != cyclesPerFrame || peerPlayer == player)
+        {
+            stats.incompatible = true;
+            continue;
+        }
+        peerAck = std::max<int64_t>(peerAck, Get<int32_t>(data));
+        int32_t hashFrame = Get<int32_t>(data);
+        uint64_t hash = Get<uint64_t>(data);
+        uint32_t first = Get<uint32_t>(data);
+        uint8_t count = Get<uint8_t>(data);
+        if (size < static_cast<int>(NETPLAY_HEADER_SIZE + 2 * count))
+        {
+            continue;
+        }
+
+        for (uint32_t input = first; input < first + count; input++)
+        {
+            uint16_t keys = Get<uint16_t>(data) & ~localMask;
+            unsigned int ring = input % NETPLAY_RING;
+            if (static_cast<int64_t>(input) <= remoteConfirmed || remoteFrames[ring] == input)
+            {
+                continue;
+            }
+            if (input < frame && slots[ring].frame == input && slots[ring].remote != keys &&
+                (rollbackFrame < 0 || input < rollbackFrame))
+            {
+                rollbackFrame = input;
+            }
+            remoteInputs[ring] = keys;
+            remoteFrames[ring] = input;
+        }
+        while (remoteFrames[(remoteConfirmed + 1) % NETPLAY_RING] == remoteConfirmed + 1)
+        {
+            remoteConfirmed++;
+        }
+
+        if (hashFrame > remoteHashFrame)
+        {
+            remoteHashFrame = hashFrame;
+            remoteHash = hash;
+            CompareHash(hashFrame, hash);
+        }
+    }
+}
+
+void RollbackSession::Resimulate(Chip8 &chip8)
+{
+    // Rewind to the first mispredicted frame and replay every frame since in one burst
+    auto start = std::chrono::high_resolution_clock::now();
+    uint32_t first = static_cast<uint32_t>(rollbackFrame);
+    uint64_t shown[VIDEO_HEIGHT];
+    memcpy(shown, chip8.video, sizeof(shown));
+    // The latches go back too, as run-ahead's SpeculativeRun puts them back: a fault the mispredicted frames
+    // raised is dropped, and the flight recorder rewinds so the replay overwrites their instructions. Every
+    // frame runs cyclesPerFrame instructions, so it overwrites exactly those.
+    chip8.LoadState(slots[first % NETPLAY_RING].state);
+    chip8.LoadLatches(slots[first % NETPLAY_RING].latches);
+    for (uint32_t replay = first; replay < frame; replay++)
+    {
+        FrameSlot &slot = slots[replay % NETPLAY_RING];
+        if (replay != first)
+        {
+            chip8.SaveState(slot.state);
+            chip8.SaveLatches(slot.latches);
+        }
+        slot.remote = PredictRemote(replay);
+        RunSlot(chip8, slot);
+    }
+    // The mispredicted frames may have drawn what the replay did not
+    chip8.videoChanged |= memcmp(shown, chip8.video, sizeof(shown)) != 0;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+    stats.rollbacks++;
+    stats.maxRollbackFrames = std::max(stats.maxRollbackFrames, frame - first);
+    stats.lastResimUs = us;
+    stats.maxResimUs = std::max(stats.maxResimUs, us);
+    rollbackFrame = -1;
+}
+
+void RollbackSession::UpdateConfirmed(const Chip8 &chip8)
+{
+    // A frame is final once both players' input for it is known; hash the state it produced
+    int64_t last = std::min<int64_t>(remoteConfirmed, static_cast<int64_t>(frame) - 1);
+    while (hashedUpTo < last)
+    {
+        uint32_t confirmed = static_cast<uint32_t>(++hashedUpTo);
+        uint64_t hash;
+        if (confirmed + 1 == frame)
+        {
+            Chip8State state;
+            chip8.SaveState(state);
+            hash = Chip8::HashState(state);
+        }
+        else
+        {
+            hash = Chip8::HashState(slots[(confirmed + 1) % NETPLAY_RING].state);
+        }
+        localHashes[confirmed % NETPLAY_RING] = hash;
+        localHashFrames[confirmed % NETPLAY_RING] = confirmed;
+        stats.confirmedFrame = confirmed;
+        if (remoteHashFrame == confirmed)
+        {
+            CompareHash(confirmed, remoteHash);
+        }
+    }
+}
+
+void RollbackSession::CompareHash(uint32_t hashFrame, uint64_t hash)
+{
+    if (localHashFrames[hashFrame % NETPLAY_RING] != hashFrame)
+    {
+        return; // not confirmed locally yet, compared once it is
+    }
+    stats.hashChecks++;
+    if (localHashes[hashFrame % NETPLAY_RING] != hash && !stats.desynced)
+    {
+        stats.desynced = true;
+        stats.desyncFrame = hashFrame;
+    }
+}
+
+void RollbackSession::Send(double nowMs)
+{
+    // Resend every input the peer has not acknowledged, so a lost packet costs nothing
+    uint32_t first = static_cast<uint32_t>(std::max<int64_t>(peerAck + 1, static_cast<int64_t>(frame) - NETPLAY_MAX_INPUTS));
+    uint8_t count = static_cast<uint8_t>(frame - std::min(first, frame));
+
+    std::vector<uint8_t> packet;
+    packet.reserve(NETPLAY_HEADER_SIZE + 2 * count);
+    Put<uint32_t>(packet, NETPLAY_MAGIC);
+    Put<uint64_t>(packet, romHash);
+    Put<uint32_t>(packet, seed);
+    Put<uint16_t>(packet, cyclesPerFrame);
+    Put<uint8_t>(packet, player);
+    Put<int32_t>(packet, static_cast<int32_t>(remoteConfirmed));
+    Put<int32_t>(packet, static_cast<int32_t>(hashedUpTo));
+    Put<uint64_t>(packet, hashedUpTo >= 0 ? localHashes[hashedUpTo % NETPLAY_RING] : 0);
+    Put<uint32_t>(packet, first);
+    Put<uint8_t>(packet, count);
+    for (uint32_t input = first; input < first + count; input++)
+    {
+        Put<uint16_t>(packet, slots[input % NETPLAY_RING].local);
+    }
+
+    std::uniform_real_distribution<float> chance(0.0f, 100.0f);
+    if (chance(lossRng) < conditions.lossPercent)
+    {
+        return;
+    }
+    outgoing.emplace_back(nowMs + conditions.delayMs, std::move(packet));
+    Flush(nowMs);
+}
+
+void RollbackSession::Flush(double nowMs)
+{
+    while (!outgoing.empty() && outgoing.front().first <= nowMs)
+    {
+        socket.Send(outgoing.front().second.data(), outgoing.front().second.size());
+        outgoing.pop_front();
+    }
+}
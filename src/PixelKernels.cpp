@@ -0,0 +1,799 @@
+#include "PixelKernels.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+// GCC 12 reports the AVX-512 headers' deliberately undefined pass-through operands as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#define PIXEL_KERNELS_X86
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+const uint64_t BYTE_BROADCAST = 0x0101010101010101ull;
+const uint64_t BIT_OF_BYTE = 0x0102040810204080ull; // byte i in memory is 0x80 >> i: pixel i of an 8-pixel group
+const unsigned int MAX_SIMD_SCALE = 16;              // wider scales, and ones that are not powers of two, use the scalar loop
+
+// HashFrame: eight 64-bit lanes, one per row of each group of eight. Each row is XORed with a key word;
+// the lane adds the product of the result's two halves, and its neighbour the row itself (the XXH3
+// accumulate step, which SSE2 can do with _mm_mul_epu32). The lanes are then mixed into one value.
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+
+struct HashKey
+{
+    uint64_t words[VIDEO_HEIGHT];
+
+    constexpr HashKey() : words()
+    {
+        // splitmix64
+        uint64_t state = PRIME64_3;
+        for (unsigned int i = 0; i < VIDEO_HEIGHT; ++i)
+        {
+            state += 0x9E3779B97F4A7C15ull;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            words[i] = z ^ (z >> 31);
+        }
+    }
+};
+alignas(64) static constexpr HashKey hashKey{};
+alignas(64) static const uint64_t hashInit[8] = {PRIME64_1, PRIME64_2, PRIME64_3, ~PRIME64_1,
+                                                 ~PRIME64_2, ~PRIME64_3, PRIME64_1 ^ PRIME64_2, PRIME64_2 ^ PRIME64_3};
+
+static uint64_t Avalanche(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    return hash ^ (hash >> 32);
+}
+
+static uint64_t MergeLanes(const uint64_t *lanes)
+{
+    uint64_t hash = VIDEO_HEIGHT * sizeof(uint64_t) * PRIME64_1;
+    for (unsigned int lane = 0; lane < 8; ++lane)
+    {
+        hash = (hash ^ Avalanche(lanes[lane])) * PRIME64_1;
+    }
+    return Avalanche(hash);
+}
+
+// Scalar: the reference every other variant must match
+
+static void ClearVideoScalar(uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        rows[y] = 0;
+    }
+}
+
+static bool BlitSpriteScalar(uint64_t *rows, const uint8_t *sprite, unsigned int height, unsigned int x)
+{
+    uint64_t collision = 0;
+    for (unsigned int row = 0; row < height; ++row)
+    {
+        uint64_t bits = (static_cast<uint64_t>(sprite[row]) << 56) >> x;
+        collision |= rows[row] & bits;
+        rows[row] ^= bits;
+    }
+    return collision != 0;
+}
+
+static void ExpandVideoScalar(const uint64_t *rows, uint32_t *pixels)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint64_t row = rows[y];
+        for (unsigned int x = 0; x < VIDEO_WIDTH; ++x)
+        {
+            *pixels++ = ((row >> (VIDEO_WIDTH - 1 - x)) & 1u) ? PIXEL_ON : PIXEL_OFF;
+        }
+    }
+}
+
+static void ScaleVideoLumaScalar(const uint64_t *rows, unsigned int scale, uint8_t *luma)
+{
+    size_t width = VIDEO_WIDTH * scale;
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint8_t *line = luma;
+        uint64_t row = rows[y];
+        // Runs of equal pixels are filled at once; most rows are a few long runs
+        for (unsigned int x = 0; x < VIDEO_WIDTH;)
+        {
+            bool on = (row >> (VIDEO_WIDTH - 1 - x)) & 1u;
+            uint64_t rest = on ? ~row : row;
+            rest <<= x;
+            unsigned int run = rest ? static_cast<unsigned int>(__builtin_clzll(rest)) : VIDEO_WIDTH - x;
+            run = std::min(run, VIDEO_WIDTH - x);
+            memset(line + x * scale, on ? LUMA_ON : LUMA_OFF, run * scale);
+            x += run;
+        }
+        // The other scale - 1 lines are copies of the first
+        for (unsigned int copy = 1; copy < scale; ++copy)
+        {
+            memcpy(luma + copy * width, line, width);
+        }
+        luma += width * scale;
+    }
+}
+
+static uint64_t HashFrameScalar(const uint64_t *rows)
+{
+    uint64_t lanes[8];
+    memcpy(lanes, hashInit, sizeof(lanes));
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        uint64_t keyed = rows[y] ^ hashKey.words[y];
+        lanes[(y & 7) ^ 1] += rows[y];
+        lanes[y & 7] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+    }
+    return MergeLanes(lanes);
+}
+
+static void FadeLevelsScalar(const uint64_t *rows, uint8_t keep, uint8_t *levels)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, ++levels)
+        {
+            bool lit = (rows[y] >> (VIDEO_WIDTH - 1 - x)) & 1u;
+            unsigned int faded = (*levels * keep) >> 8;
+            *levels = lit ? LUMA_ON : (faded < PHOSPHOR_FLOOR ? LUMA_OFF : static_cast<uint8_t>(faded));
+        }
+    }
+}
+
+static void ScaleRowLumaScalar(const uint8_t *levels, unsigned int scale, uint8_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x)
+    {
+        memset(target + x * scale, levels[x], scale);
+    }
+}
+
+static void ScaleRowRgbaScalar(const uint8_t *levels, const uint32_t *palette, unsigned int scale, uint32_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x)
+    {
+        std::fill_n(target + x * scale, scale, palette[levels[x]]);
+    }
+}
+
+static bool ScaleHasSimdPath(unsigned int scale)
+{
+    return scale <= MAX_SIMD_SCALE && (scale & (scale - 1)) == 0;
+}
+
+// 8 pixels of a row as bytes, one 64-bit word per group, for the SIMD byte compares
+static uint64_t PixelGroup(uint64_t row, unsigned int group)
+{
+    return ((row >> (VIDEO_WIDTH - 8 - 8 * group)) & 0xFF) * BYTE_BROADCAST;
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+// SSE2: two rows or four pixels per instruction
+
+TARGET_SSE2 static inline __m128i Select(__m128i mask, __m128i on, __m128i off)
+{
+    return _mm_or_si128(_mm_and_si128(mask, on), _mm_andnot_si128(mask, off));
+}
+
+// Stores 16 luma pixels, each repeated `scale` times (a power of two up to MAX_SIMD_SCALE). Always inlined,
+// so the AVX variants get a VEX-encoded copy instead of calling SSE code with the upper halves in use.
+TARGET_SSE2 static inline __attribute__((always_inline)) void StoreScaled(uint8_t *out, __m128i pixels, unsigned int scale)
+{
+    __m128i parts[MAX_SIMD_SCALE] = {pixels};
+    unsigned int count = 1;
+    for (; count < scale; count *= 2)
+    {
+        // Each part doubles into two; from the back, so no part is overwritten before it is read
+        for (unsigned int i = count; i-- > 0;)
+        {
+            parts[2 * i + 1] = _mm_unpackhi_epi8(parts[i], parts[i]);
+            parts[2 * i] = _mm_unpacklo_epi8(parts[i], parts[i]);
+        }
+    }
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + i, parts[i]);
+    }
+}
+
+// Copies the first line of each scaled row to the other scale - 1
+static void CopyScaledLines(uint8_t *luma, unsigned int scale)
+{
+    size_t width = VIDEO_WIDTH * scale;
+    for (unsigned int copy = 1; copy < scale; ++copy)
+    {
+        memcpy(luma + copy * width, luma, width);
+    }
+}
+
+// Each pixel is stored as whole 16-byte vectors from where its run starts; the next pixel's run overwrites
+// what spills over, which leaves less than 16 bytes past the row
+TARGET_SSE2 static inline __attribute__((always_inline)) void FillRunsLuma(const uint8_t *levels, unsigned int scale,
+                                                                           uint8_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m128i level = _mm_set1_epi8(static_cast<char>(levels[x]));
+        for (unsigned int i = 0; i < scale; i += 16)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), level);
+        }
+    }
+}
+
+TARGET_SSE2 static inline __attribute__((always_inline)) void FillRunsRgba(const uint8_t *levels, const uint32_t *palette,
+                                                                           unsigned int scale, uint32_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m128i colour = _mm_set1_epi32(static_cast<int>(palette[levels[x]]));
+        for (unsigned int i = 0; i < scale; i += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), colour);
+        }
+    }
+}
+
+// 16 levels times keep / 256, with the ones that fall below PHOSPHOR_FLOOR cleared
+TARGET_SSE2 static inline __attribute__((always_inline)) __m128i Fade(__m128i old, __m128i keep, __m128i floor)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), keep), 8);
+    __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), keep), 8);
+    __m128i faded = _mm_packus_epi16(low, high);
+    return _mm_and_si128(faded, _mm_cmpeq_epi8(_mm_max_epu8(faded, floor), faded));
+}
+
+TARGET_SSE2 static void ClearVideoSse2(uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 2)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rows + y), _mm_setzero_si128());
+    }
+}
+
+TARGET_SSE2 static bool BlitSpriteSse2(uint64_t *rows, const uint8_t *sprite, unsigned int height, unsigned int x)
+{
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(x));
+    __m128i collision = _mm_setzero_si128();
+    unsigned int row = 0;
+    for (; row + 2 <= height; row += 2)
+    {
+        __m128i bits = _mm_set_epi64x(static_cast<long long>(static_cast<uint64_t>(sprite[row + 1]) << 56),
+                                      static_cast<long long>(static_cast<uint64_t>(sprite[row]) << 56));
+        bits = _mm_srl_epi64(bits, shift);
+        __m128i screen = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows + row));
+        collision = _mm_or_si128(collision, _mm_and_si128(screen, bits));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rows + row), _mm_xor_si128(screen, bits));
+    }
+    bool hit = _mm_movemask_epi8(_mm_cmpeq_epi8(collision, _mm_setzero_si128())) != 0xFFFF;
+    if (row < height && BlitSpriteScalar(rows + row, sprite + row, 1, x))
+    {
+        hit = true;
+    }
+    return hit;
+}
+
+TARGET_SSE2 static void ExpandVideoSse2(const uint64_t *rows, uint32_t *pixels)
+{
+    const __m128i on = _mm_set1_epi32(static_cast<int>(PIXEL_ON));
+    const __m128i off = _mm_set1_epi32(static_cast<int>(PIXEL_OFF));
+    const __m128i high = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+    const __m128i low = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; ++group, pixels += 8)
+        {
+            __m128i bits = _mm_set1_epi32(static_cast<int>((rows[y] >> (VIDEO_WIDTH - 8 - 8 * group)) & 0xFF));
+            __m128i first = _mm_cmpeq_epi32(_mm_and_si128(bits, high), high);
+            __m128i second = _mm_cmpeq_epi32(_mm_and_si128(bits, low), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels), Select(first, on, off));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 4), Select(second, on, off));
+        }
+    }
+}
+
+TARGET_SSE2 static void ScaleVideoLumaSse2(const uint64_t *rows, unsigned int scale, uint8_t *luma)
+{
+    if (!ScaleHasSimdPath(scale))
+    {
+        ScaleVideoLumaScalar(rows, scale, luma);
+        return;
+    }
+    const __m128i on = _mm_set1_epi8(static_cast<char>(LUMA_ON));
+    const __m128i off = _mm_set1_epi8(static_cast<char>(LUMA_OFF));
+    const __m128i mask = _mm_set1_epi64x(static_cast<long long>(BIT_OF_BYTE));
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y, luma += VIDEO_WIDTH * scale * scale)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; group += 2)
+        {
+            __m128i bytes = _mm_set_epi64x(static_cast<long long>(PixelGroup(rows[y], group + 1)),
+                                           static_cast<long long>(PixelGroup(rows[y], group)));
+            __m128i lit = _mm_cmpeq_epi8(_mm_and_si128(bytes, mask), mask);
+            StoreScaled(luma + group * 8 * scale, Select(lit, on, off), scale);
+        }
+        CopyScaledLines(luma, scale);
+    }
+}
+
+TARGET_SSE2 static uint64_t HashFrameSse2(const uint64_t *rows)
+{
+    __m128i lanes[4];
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        lanes[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(hashInit + 2 * i));
+    }
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 2)
+    {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows + y));
+        __m128i keyed = _mm_xor_si128(data, _mm_load_si128(reinterpret_cast<const __m128i *>(hashKey.words + y)));
+        __m128i &lane = lanes[(y & 7) / 2];
+        lane = _mm_add_epi64(lane, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+        lane = _mm_add_epi64(lane, _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32)));
+    }
+    uint64_t merged[8];
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(merged + 2 * i), lanes[i]);
+    }
+    return MergeLanes(merged);
+}
+
+TARGET_SSE2 static void FadeLevelsSse2(const uint64_t *rows, uint8_t keep, uint8_t *levels)
+{
+    const __m128i mask = _mm_set1_epi64x(static_cast<long long>(BIT_OF_BYTE));
+    const __m128i factor = _mm_set1_epi16(keep);
+    const __m128i floor = _mm_set1_epi8(static_cast<char>(PHOSPHOR_FLOOR));
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; group += 2, levels += 16)
+        {
+            __m128i bytes = _mm_set_epi64x(static_cast<long long>(PixelGroup(rows[y], group + 1)),
+                                           static_cast<long long>(PixelGroup(rows[y], group)));
+            __m128i lit = _mm_cmpeq_epi8(_mm_and_si128(bytes, mask), mask);
+            __m128i faded = Fade(_mm_loadu_si128(reinterpret_cast<const __m128i *>(levels)), factor, floor);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(levels), _mm_or_si128(faded, lit)); // lit bytes are LUMA_ON
+        }
+    }
+}
+
+TARGET_SSE2 static void ScaleRowLumaSse2(const uint8_t *levels, unsigned int scale, uint8_t *target)
+{
+    if (!ScaleHasSimdPath(scale))
+    {
+        FillRunsLuma(levels, scale, target);
+        return;
+    }
+    for (unsigned int x = 0; x < VIDEO_WIDTH; x += 16)
+    {
+        StoreScaled(target + x * scale, _mm_loadu_si128(reinterpret_cast<const __m128i *>(levels + x)), scale);
+    }
+}
+
+TARGET_SSE2 static void ScaleRowRgbaSse2(const uint8_t *levels, const uint32_t *palette, unsigned int scale, uint32_t *target)
+{
+    FillRunsRgba(levels, palette, scale, target);
+}
+
+// AVX2: four rows or eight pixels per instruction
+
+// FillRunsLuma and FillRunsRgba with 32-byte vectors, for runs at least that long
+TARGET_AVX2 static inline __attribute__((always_inline)) void FillRunsLuma256(const uint8_t *levels, unsigned int scale,
+                                                                              uint8_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m256i level = _mm256_set1_epi8(static_cast<char>(levels[x]));
+        for (unsigned int i = 0; i < scale; i += 32)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), level);
+        }
+    }
+}
+
+TARGET_AVX2 static inline __attribute__((always_inline)) void FillRunsRgba256(const uint8_t *levels, const uint32_t *palette,
+                                                                              unsigned int scale, uint32_t *target)
+{
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m256i colour = _mm256_set1_epi32(static_cast<int>(palette[levels[x]]));
+        for (unsigned int i = 0; i < scale; i += 8)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), colour);
+        }
+    }
+}
+
+TARGET_AVX2 static void ClearVideoAvx2(uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 4)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(rows + y), _mm256_setzero_si256());
+    }
+}
+
+TARGET_AVX2 static bool BlitSpriteAvx2(uint64_t *rows, const uint8_t *sprite, unsigned int height, unsigned int x)
+{
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(x));
+    const __m256i lane = _mm256_setr_epi64x(0, 1, 2, 3);
+    __m256i collision = _mm256_setzero_si256();
+    for (unsigned int row = 0; row < height; row += 4)
+    {
+        int32_t bytes;
+        memcpy(&bytes, sprite + row, sizeof(bytes));
+        __m256i bits = _mm256_srl_epi64(_mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes)), 56), shift);
+        // Rows past the sprite are neither read nor written
+        __m256i inside = _mm256_cmpgt_epi64(_mm256_set1_epi64x(height - row), lane);
+        long long *target = reinterpret_cast<long long *>(rows + row);
+        __m256i screen = _mm256_maskload_epi64(target, inside);
+        collision = _mm256_or_si256(collision, _mm256_and_si256(screen, bits));
+        _mm256_maskstore_epi64(target, inside, _mm256_xor_si256(screen, bits));
+    }
+    return !_mm256_testz_si256(collision, collision);
+}
+
+TARGET_AVX2 static void ExpandVideoAvx2(const uint64_t *rows, uint32_t *pixels)
+{
+    const __m256i on = _mm256_set1_epi32(static_cast<int>(PIXEL_ON));
+    const __m256i off = _mm256_set1_epi32(static_cast<int>(PIXEL_OFF));
+    const __m256i mask = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; ++group, pixels += 8)
+        {
+            __m256i bits = _mm256_set1_epi32(static_cast<int>((rows[y] >> (VIDEO_WIDTH - 8 - 8 * group)) & 0xFF));
+            __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels), _mm256_blendv_epi8(off, on, lit));
+        }
+    }
+}
+
+TARGET_AVX2 static void ScaleVideoLumaAvx2(const uint64_t *rows, unsigned int scale, uint8_t *luma)
+{
+    if (!ScaleHasSimdPath(scale))
+    {
+        ScaleVideoLumaScalar(rows, scale, luma);
+        return;
+    }
+    const __m256i on = _mm256_set1_epi8(static_cast<char>(LUMA_ON));
+    const __m256i off = _mm256_set1_epi8(static_cast<char>(LUMA_OFF));
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(BIT_OF_BYTE));
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y, luma += VIDEO_WIDTH * scale * scale)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; group += 4)
+        {
+            __m256i bytes = _mm256_setr_epi64x(
+                static_cast<long long>(PixelGroup(rows[y], group)), static_cast<long long>(PixelGroup(rows[y], group + 1)),
+                static_cast<long long>(PixelGroup(rows[y], group + 2)), static_cast<long long>(PixelGroup(rows[y], group + 3)));
+            __m256i lit = _mm256_blendv_epi8(off, on, _mm256_cmpeq_epi8(_mm256_and_si256(bytes, mask), mask));
+            uint8_t *out = luma + group * 8 * scale;
+            if (scale == 1)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), lit);
+                continue;
+            }
+            StoreScaled(out, _mm256_castsi256_si128(lit), scale);
+            StoreScaled(out + 16 * scale, _mm256_extracti128_si256(lit, 1), scale);
+        }
+        CopyScaledLines(luma, scale);
+    }
+}
+
+TARGET_AVX2 static uint64_t HashFrameAvx2(const uint64_t *rows)
+{
+    __m256i lanes[2] = {_mm256_load_si256(reinterpret_cast<const __m256i *>(hashInit)),
+                        _mm256_load_si256(reinterpret_cast<const __m256i *>(hashInit + 4))};
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 4)
+    {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows + y));
+        __m256i keyed = _mm256_xor_si256(data, _mm256_load_si256(reinterpret_cast<const __m256i *>(hashKey.words + y)));
+        __m256i &lane = lanes[(y & 7) / 4];
+        lane = _mm256_add_epi64(lane, _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+        lane = _mm256_add_epi64(lane, _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32)));
+    }
+    uint64_t merged[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(merged), lanes[0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(merged + 4), lanes[1]);
+    return MergeLanes(merged);
+}
+
+TARGET_AVX2 static void FadeLevelsAvx2(const uint64_t *rows, uint8_t keep, uint8_t *levels)
+{
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(BIT_OF_BYTE));
+    const __m256i factor = _mm256_set1_epi16(keep);
+    const __m256i floor = _mm256_set1_epi8(static_cast<char>(PHOSPHOR_FLOOR));
+    const __m256i zero = _mm256_setzero_si256();
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int group = 0; group < VIDEO_WIDTH / 8; group += 4, levels += 32)
+        {
+            __m256i bytes = _mm256_setr_epi64x(
+                static_cast<long long>(PixelGroup(rows[y], group)), static_cast<long long>(PixelGroup(rows[y], group + 1)),
+                static_cast<long long>(PixelGroup(rows[y], group + 2)), static_cast<long long>(PixelGroup(rows[y], group + 3)));
+            __m256i lit = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, mask), mask);
+            // Unpacking and packing both work within 128-bit lanes, so the bytes come back in order
+            __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(levels));
+            __m256i low = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(old, zero), factor), 8);
+            __m256i high = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(old, zero), factor), 8);
+            __m256i faded = _mm256_packus_epi16(low, high);
+            faded = _mm256_and_si256(faded, _mm256_cmpeq_epi8(_mm256_max_epu8(faded, floor), faded));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(levels), _mm256_or_si256(faded, lit));
+        }
+    }
+}
+
+TARGET_AVX2 static void ScaleRowLumaAvx2(const uint8_t *levels, unsigned int scale, uint8_t *target)
+{
+    if (ScaleHasSimdPath(scale))
+    {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; x += 16)
+        {
+            StoreScaled(target + x * scale, _mm_loadu_si128(reinterpret_cast<const __m128i *>(levels + x)), scale);
+        }
+        return;
+    }
+    if (scale < 32)
+    {
+        FillRunsLuma(levels, scale, target);
+        return;
+    }
+    FillRunsLuma256(levels, scale, target);
+}
+
+TARGET_AVX2 static void ScaleRowRgbaAvx2(const uint8_t *levels, const uint32_t *palette, unsigned int scale, uint32_t *target)
+{
+    if (scale < 8)
+    {
+        FillRunsRgba(levels, palette, scale, target);
+        return;
+    }
+    FillRunsRgba256(levels, palette, scale, target);
+}
+
+// AVX-512: eight rows or sixteen pixels per instruction, with masks for partial sprites
+
+TARGET_AVX512 static void ClearVideoAvx512(uint64_t *rows)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 8)
+    {
+        _mm512_storeu_si512(rows + y, _mm512_setzero_si512());
+    }
+}
+
+TARGET_AVX512 static bool BlitSpriteAvx512(uint64_t *rows, const uint8_t *sprite, unsigned int height, unsigned int x)
+{
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(x));
+    __mmask8 collision = 0;
+    for (unsigned int row = 0; row < height; row += 8)
+    {
+        __mmask8 inside = static_cast<__mmask8>(height - row >= 8 ? 0xFF : (1u << (height - row)) - 1);
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(sprite + row));
+        __m512i bits = _mm512_srl_epi64(_mm512_slli_epi64(_mm512_cvtepu8_epi64(bytes), 56), shift);
+        __m512i screen = _mm512_maskz_loadu_epi64(inside, rows + row);
+        collision |= _mm512_mask_test_epi64_mask(inside, screen, bits);
+        _mm512_mask_storeu_epi64(rows + row, inside, _mm512_xor_si512(screen, bits));
+    }
+    return collision != 0;
+}
+
+TARGET_AVX512 static void ExpandVideoAvx512(const uint64_t *rows, uint32_t *pixels)
+{
+    const __m512i on = _mm512_set1_epi32(static_cast<int>(PIXEL_ON));
+    const __m512i off = _mm512_set1_epi32(static_cast<int>(PIXEL_OFF));
+    const __m512i mask = _mm512_setr_epi32(0x8000, 0x4000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0100,
+                                           0x0080, 0x0040, 0x0020, 0x0010, 0x0008, 0x0004, 0x0002, 0x0001);
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        for (unsigned int quarter = 0; quarter < 4; ++quarter, pixels += 16)
+        {
+            __m512i bits = _mm512_set1_epi32(static_cast<int>((rows[y] >> (48 - 16 * quarter)) & 0xFFFF));
+            _mm512_storeu_si512(pixels, _mm512_mask_blend_epi32(_mm512_test_epi32_mask(bits, mask), off, on));
+        }
+    }
+}
+
+TARGET_AVX512 static void ScaleVideoLumaAvx512(const uint64_t *rows, unsigned int scale, uint8_t *luma)
+{
+    if (!ScaleHasSimdPath(scale))
+    {
+        ScaleVideoLumaScalar(rows, scale, luma);
+        return;
+    }
+    const __m512i on = _mm512_set1_epi8(static_cast<char>(LUMA_ON));
+    const __m512i off = _mm512_set1_epi8(static_cast<char>(LUMA_OFF));
+    const __m512i mask = _mm512_set1_epi64(static_cast<long long>(BIT_OF_BYTE));
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y, luma += VIDEO_WIDTH * scale * scale)
+    {
+        uint64_t row = rows[y];
+        __m512i bytes = _mm512_setr_epi64(
+            static_cast<long long>(PixelGroup(row, 0)), static_cast<long long>(PixelGroup(row, 1)),
+            static_cast<long long>(PixelGroup(row, 2)), static_cast<long long>(PixelGroup(row, 3)),
+            static_cast<long long>(PixelGroup(row, 4)), static_cast<long long>(PixelGroup(row, 5)),
+            static_cast<long long>(PixelGroup(row, 6)), static_cast<long long>(PixelGroup(row, 7)));
+        __m512i lit = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(bytes, mask), off, on);
+        if (scale == 1)
+        {
+            _mm512_storeu_si512(luma, lit);
+            continue;
+        }
+        StoreScaled(luma, _mm512_extracti32x4_epi32(lit, 0), scale);
+        StoreScaled(luma + 16 * scale, _mm512_extracti32x4_epi32(lit, 1), scale);
+        StoreScaled(luma + 32 * scale, _mm512_extracti32x4_epi32(lit, 2), scale);
+        StoreScaled(luma + 48 * scale, _mm512_extracti32x4_epi32(lit, 3), scale);
+        CopyScaledLines(luma, scale);
+    }
+}
+
+TARGET_AVX512 static uint64_t HashFrameAvx512(const uint64_t *rows)
+{
+    __m512i lanes = _mm512_load_si512(hashInit);
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += 8)
+    {
+        __m512i data = _mm512_loadu_si512(rows + y);
+        __m512i keyed = _mm512_xor_si512(data, _mm512_load_si512(hashKey.words + y));
+        lanes = _mm512_add_epi64(lanes, _mm512_shuffle_epi32(data, static_cast<_MM_PERM_ENUM>(_MM_SHUFFLE(1, 0, 3, 2))));
+        lanes = _mm512_add_epi64(lanes, _mm512_mul_epu32(keyed, _mm512_srli_epi64(keyed, 32)));
+    }
+    uint64_t merged[8];
+    _mm512_storeu_si512(merged, lanes);
+    return MergeLanes(merged);
+}
+
+TARGET_AVX512 static void FadeLevelsAvx512(const uint64_t *rows, uint8_t keep, uint8_t *levels)
+{
+    const __m512i mask = _mm512_set1_epi64(static_cast<long long>(BIT_OF_BYTE));
+    const __m512i factor = _mm512_set1_epi16(keep);
+    const __m512i floor = _mm512_set1_epi8(static_cast<char>(PHOSPHOR_FLOOR));
+    const __m512i on = _mm512_set1_epi8(static_cast<char>(LUMA_ON));
+    const __m512i zero = _mm512_setzero_si512();
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y, levels += VIDEO_WIDTH)
+    {
+        uint64_t row = rows[y];
+        __m512i bytes = _mm512_setr_epi64(
+            static_cast<long long>(PixelGroup(row, 0)), static_cast<long long>(PixelGroup(row, 1)),
+            static_cast<long long>(PixelGroup(row, 2)), static_cast<long long>(PixelGroup(row, 3)),
+            static_cast<long long>(PixelGroup(row, 4)), static_cast<long long>(PixelGroup(row, 5)),
+            static_cast<long long>(PixelGroup(row, 6)), static_cast<long long>(PixelGroup(row, 7)));
+        __m512i old = _mm512_loadu_si512(levels);
+        __m512i low = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(old, zero), factor), 8);
+        __m512i high = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(old, zero), factor), 8);
+        __m512i faded = _mm512_packus_epi16(low, high);
+        faded = _mm512_maskz_mov_epi8(_mm512_cmpge_epu8_mask(faded, floor), faded);
+        _mm512_storeu_si512(levels, _mm512_mask_blend_epi8(_mm512_test_epi8_mask(bytes, mask), faded, on));
+    }
+}
+
+TARGET_AVX512 static void ScaleRowLumaAvx512(const uint8_t *levels, unsigned int scale, uint8_t *target)
+{
+    if (ScaleHasSimdPath(scale))
+    {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; x += 16)
+        {
+            StoreScaled(target + x * scale, _mm_loadu_si128(reinterpret_cast<const __m128i *>(levels + x)), scale);
+        }
+        return;
+    }
+    if (scale < 64)
+    {
+        scale < 32 ? FillRunsLuma(levels, scale, target) : FillRunsLuma256(levels, scale, target);
+        return;
+    }
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m512i level = _mm512_set1_epi8(static_cast<char>(levels[x]));
+        for (unsigned int i = 0; i < scale; i += 64)
+        {
+            _mm512_storeu_si512(target + i, level);
+        }
+    }
+}
+
+TARGET_AVX512 static void ScaleRowRgbaAvx512(const uint8_t *levels, const uint32_t *palette, unsigned int scale,
+                                             uint32_t *target)
+{
+    if (scale < 16)
+    {
+        scale < 8 ? FillRunsRgba(levels, palette, scale, target) : FillRunsRgba256(levels, palette, scale, target);
+        return;
+    }
+    for (unsigned int x = 0; x < VIDEO_WIDTH; ++x, target += scale)
+    {
+        __m512i colour = _mm512_set1_epi32(static_cast<int>(palette[levels[x]]));
+        for (unsigned int i = 0; i < scale; i += 16)
+        {
+            _mm512_storeu_si512(target + i, colour);
+        }
+    }
+}
+
+#endif // PIXEL_KERNELS_X86
+
+static constexpr PixelKernels scalarKernels = {CPU_SCALAR, ClearVideoScalar, BlitSpriteScalar, ExpandVideoScalar,
+                                               ScaleVideoLumaScalar, HashFrameScalar, FadeLevelsScalar, ScaleRowLumaScalar,
+                                               ScaleRowRgbaScalar};
+#ifdef PIXEL_KERNELS_X86
+static constexpr PixelKernels sse2Kernels = {CPU_SSE2, ClearVideoSse2, BlitSpriteSse2, ExpandVideoSse2,
+                                             ScaleVideoLumaSse2, HashFrameSse2, FadeLevelsSse2, ScaleRowLumaSse2,
+                                             ScaleRowRgbaSse2};
+static constexpr PixelKernels avx2Kernels = {CPU_AVX2, ClearVideoAvx2, BlitSpriteAvx2, ExpandVideoAvx2,
+                                             ScaleVideoLumaAvx2, HashFrameAvx2, FadeLevelsAvx2, ScaleRowLumaAvx2,
+                                             ScaleRowRgbaAvx2};
+static constexpr PixelKernels avx512Kernels = {CPU_AVX512, ClearVideoAvx512, BlitSpriteAvx512, ExpandVideoAvx512,
+                                               ScaleVideoLumaAvx512, HashFrameAvx512, FadeLevelsAvx512, ScaleRowLumaAvx512,
+                                               ScaleRowRgbaAvx512};
+#endif
+
+// Constant-initialized, so code running before the selection below still gets working (scalar) kernels
+const PixelKernels *pixelKernels = &scalarKernels;
+static const bool selected = UsePixelKernels(DetectCpuLevel());
+
+const char *CpuLevelName(CpuLevel level)
+{
+    static const char *names[CPU_LEVEL_COUNT] = {"scalar", "sse2", "avx2", "avx512"};
+    return level < CPU_LEVEL_COUNT ? names[level] : "unknown";
+}
+
+CpuLevel DetectCpuLevel()
+{
+#ifdef PIXEL_KERNELS_X86
+    // Also checks that the OS saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    {
+        return CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return CPU_SSE2;
+    }
+#endif
+    return CPU_SCALAR;
+}
+
+const PixelKernels *GetPixelKernels(CpuLevel level)
+{
+    if (level > DetectCpuLevel())
+    {
+        return nullptr;
+    }
+    switch (level)
+    {
+    case CPU_SCALAR: return &scalarKernels;
+#ifdef PIXEL_KERNELS_X86
+    case CPU_SSE2: return &sse2Kernels;
+    case CPU_AVX2: return &avx2Kernels;
+    case CPU_AVX512: return &avx512Kernels;
+#endif
+    default: return nullptr;
+    }
+}
+
+bool UsePixelKernels(CpuLevel level)
+{
+    const PixelKernels *kernels = GetPixelKernels(level);
+    if (!kernels)
+    {
+        return false;
+    }
+    pixelKernels = kernels;
+    return true;
+}
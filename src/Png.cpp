@@ -0,0 +1,211 @@
+#include "Png.hpp"
+#include <cstring>
+
+struct CrcTable
+{
+    uint32_t entries[256];
+    CrcTable()
+    {
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = c & 1u ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+static uint32_t Crc32(const uint8_t *data, size_t size)
+{
+    static const CrcTable table;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table.entries[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t Adler32(const uint8_t *data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while (size)
+    {
+        // 5552 bytes is the most that can be summed before b may overflow
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        for (; block; --block)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521u;
+        b %= 65521u;
+    }
+    return (b << 16) | a;
+}
+
+// Deflate emits bits least significant first; Huffman codes go in most significant bit first
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    void Bits(uint32_t value, unsigned int count)
+    {
+        buffer |= static_cast<uint64_t>(value) << used;
+        used += count;
+        while (used >= 8)
+        {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+    void Code(uint32_t code, unsigned int length)
+    {
+        uint32_t reversed = 0;
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            reversed = (reversed << 1) | ((code >> i) & 1u);
+        }
+        Bits(reversed, length);
+    }
+    void Flush()
+    {
+        if (used)
+        {
+            out.push_back(static_cast<uint8_t>(buffer));
+        }
+        buffer = 0;
+        used = 0;
+    }
+
+private:
+    std::vector<uint8_t> &out;
+    uint64_t buffer = 0;
+    unsigned int used = 0;
+};
+
+// Fixed Huffman literal/length alphabet (RFC 1951, 3.2.6)
+static void Symbol(BitWriter &bits, unsigned int symbol)
+{
+    if (symbol < 144)
+        bits.Code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bits.Code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bits.Code(symbol - 256, 7);
+    else
+        bits.Code(0xC0 + symbol - 280, 8);
+}
+
+static void Match(BitWriter &bits, unsigned int length)
+{
+    static const uint16_t base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    unsigned int code = 28;
+    while (base[code] > length)
+    {
+        --code;
+    }
+    Symbol(bits, 257 + code);
+    bits.Bits(length - base[code], extra[code]);
+    bits.Code(0, 5); // distance code 0: distance 1, the byte just written
+}
+
+void DeflateRuns(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    out.push_back(0x78); // deflate, 32 KB window
+    out.push_back(0x01); // fastest compression, no dictionary
+    BitWriter bits(out);
+    bits.Bits(1, 1); // final block
+    bits.Bits(1, 2); // fixed Huffman codes
+    for (size_t i = 0; i < size;)
+    {
+        size_t run = 0;
+        if (i > 0)
+        {
+            while (run < 258 && i + run < size && data[i + run] == data[i - 1])
+            {
+                ++run;
+            }
+        }
+        if (run >= 3)
+        {
+            Match(bits, static_cast<unsigned int>(run));
+            i += run;
+        }
+        else
+        {
+            Symbol(bits, data[i++]);
+        }
+    }
+    Symbol(bits, 256); // end of block
+    bits.Flush();
+    AppendBigEndian(out, Adler32(data, size));
+}
+
+void FilterRows(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t *row = pixels + static_cast<size_t>(y) * width;
+        if (y > 0 && memcmp(row, row - width, width) == 0)
+        {
+            out.push_back(2); // Up: every byte minus the one above, all zero
+            out.insert(out.end(), width, 0);
+        }
+        else
+        {
+            out.push_back(0); // None
+            out.insert(out.end(), row, row + width);
+        }
+    }
+}
+
+void AppendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void AppendPngChunk(std::vector<uint8_t> &png, const char *type, const uint8_t *data, size_t size)
+{
+    AppendBigEndian(png, static_cast<uint32_t>(size));
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    AppendBigEndian(png, Crc32(png.data() + start, png.size() - start));
+}
+
+void BeginPng(std::vector<uint8_t> &png, uint32_t width, uint32_t height, uint8_t colourType)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    png.insert(png.end(), signature, signature + 8);
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, width);
+    AppendBigEndian(header, height);
+    header.push_back(8);          // bit depth
+    header.push_back(colourType);
+    header.push_back(0);          // deflate
+    header.push_back(0);          // adaptive filtering
+    header.push_back(0);          // not interlaced
+    AppendPngChunk(png, "IHDR", header.data(), header.size());
+}
+
+void EncodePng(const uint8_t *luma, uint32_t width, uint32_t height, std::vector<uint8_t> &png)
+{
+    std::vector<uint8_t> scanlines, compressed;
+    FilterRows(luma, width, height, scanlines);
+    DeflateRuns(scanlines.data(), scanlines.size(), compressed);
+    BeginPng(png, width, height, 0);
+    AppendPngChunk(png, "IDAT", compressed.data(), compressed.size());
+    AppendPngChunk(png, "IEND", nullptr, 0);
+}
@@ -0,0 +1,261 @@
+#include "PostProcess.hpp"
+#include "PixelKernels.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Percent to a multiplier out of 256, short of 256 so a level always fades
+static uint8_t Fraction(unsigned int percent)
+{
+    return static_cast<uint8_t>(std::min(255u, percent * 256 / 100));
+}
+
+// off at level 0, on at LUMA_ON, and a mix of the two channel by channel in between
+static uint32_t Blend(uint32_t off, uint32_t on, unsigned int level)
+{
+    uint32_t colour = 0;
+    for (unsigned int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned int from = (off >> shift) & 0xFF, to = (on >> shift) & 0xFF;
+        colour |= ((from * (LUMA_ON - level) + to * level + LUMA_ON / 2) / LUMA_ON) << shift;
+    }
+    return colour;
+}
+
+PostProcessor::~PostProcessor()
+{
+    Close();
+}
+
+bool PostProcessor::Open(const PostOptions &postOptions, PostFormat pixelFormat, uint32_t onColour, uint32_t offColour)
+{
+    Close();
+    if (postOptions.scale == 0 || postOptions.scale > POST_MAX_SCALE || postOptions.phosphor > 100 ||
+        postOptions.scanlineLevel > 100)
+    {
+        return false;
+    }
+    options = postOptions;
+    format = pixelFormat;
+    width = VIDEO_WIDTH * options.scale;
+    height = VIDEO_HEIGHT * options.scale;
+    darkRows = options.scanlines && options.scale >= 2 ? std::max(1u, options.scale / 3) : 0;
+    keep = Fraction(options.phosphor);
+    scanlineKeep = Fraction(options.scanlineLevel);
+    size_t bytesPerPixel = format == POST_RGBA ? sizeof(uint32_t) : 1;
+    pitch = (width * bytesPerPixel + SCALE_ROW_SLACK + 63) / 64 * 64;
+    pixels.assign(pitch * height, 0);
+    for (unsigned int level = 0; level < 256; ++level)
+    {
+        palette[level] = Blend(offColour, onColour, level);
+    }
+    memset(levels, LUMA_OFF, sizeof(levels));
+    drawn = false;
+    dirtyTop = dirtyRows = 0;
+
+    unsigned int threads = options.threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, (height + POST_BAND_ROWS - 1) / POST_BAND_ROWS);
+    stopping = false;
+    batch = 0;
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(&PostProcessor::WorkerLoop, this);
+    }
+    return true;
+}
+
+void PostProcessor::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    pixels.clear();
+    width = height = 0;
+}
+
+bool PostProcessor::isOpen() const
+{
+    return !pixels.empty();
+}
+
+void PostProcessor::Process(const uint64_t *video)
+{
+    uint8_t previous[VIDEO_WIDTH * VIDEO_HEIGHT];
+    memcpy(previous, levels, sizeof(levels));
+    pixelKernels->fadeLevels(video, keep, levels);
+    unsigned int top = VIDEO_HEIGHT, bottom = 0;
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+    {
+        size_t row = y * VIDEO_WIDTH;
+        rowChanged[y] = !drawn || memcmp(previous + row, levels + row, VIDEO_WIDTH) != 0;
+        if (!rowChanged[y])
+        {
+            continue;
+        }
+        top = std::min(top, y);
+        bottom = y + 1;
+        for (unsigned int x = 0; x < VIDEO_WIDTH && darkRows; ++x)
+        {
+            darkLevels[row + x] = static_cast<uint8_t>((levels[row + x] * scanlineKeep) >> 8);
+        }
+    }
+    drawn = true;
+    if (bottom == 0)
+    {
+        dirtyTop = dirtyRows = 0;
+        return;
+    }
+    dirtyTop = top * options.scale;
+    dirtyRows = (bottom - top) * options.scale;
+    bands = (dirtyRows + POST_BAND_ROWS - 1) / POST_BAND_ROWS;
+
+    nextBand = 0;
+    // Waking the workers costs more than drawing a few rows here
+    if (dirtyRows < POST_INLINE_ROWS || workers.empty())
+    {
+        DrawBands();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy = static_cast<unsigned int>(workers.size());
+        batch++;
+    }
+    wake.notify_all();
+    DrawBands();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+}
+
+const uint8_t *PostProcessor::getPixels() const
+{
+    return pixels.data();
+}
+
+size_t PostProcessor::getPitch() const
+{
+    return pitch;
+}
+
+unsigned int PostProcessor::getWidth() const
+{
+    return width;
+}
+
+unsigned int PostProcessor::getHeight() const
+{
+    return height;
+}
+
+unsigned int PostProcessor::getScale() const
+{
+    return options.scale;
+}
+
+PostFormat PostProcessor::getFormat() const
+{
+    return format;
+}
+
+unsigned int PostProcessor::getDirtyTop() const
+{
+    return dirtyTop;
+}
+
+unsigned int PostProcessor::getDirtyRows() const
+{
+    return dirtyRows;
+}
+
+unsigned int PostProcessor::getThreads() const
+{
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void PostProcessor::WorkerLoop()
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || batch != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = batch;
+        }
+        DrawBands();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+        {
+            done.notify_one();
+        }
+    }
+}
+
+void PostProcessor::DrawBands()
+{
+    for (unsigned int band = nextBand++; band < bands; band = nextBand++)
+    {
+        DrawBand(band);
+    }
+}
+
+void PostProcessor::DrawBand(unsigned int band)
+{
+    unsigned int first = dirtyTop + band * POST_BAND_ROWS;
+    unsigned int end = std::min(first + POST_BAND_ROWS, dirtyTop + dirtyRows);
+    size_t rowBytes = width * (format == POST_RGBA ? sizeof(uint32_t) : 1);
+    // The first row of this band drawn for the current guest row, plain and as a scanline
+    const uint8_t *drawnRows[2] = {};
+    unsigned int drawnFor = VIDEO_HEIGHT;
+    for (unsigned int y = first; y < end; ++y)
+    {
+        unsigned int guestRow = y / options.scale;
+        if (!rowChanged[guestRow])
+        {
+            continue;
+        }
+        if (guestRow != drawnFor)
+        {
+            drawnRows[0] = drawnRows[1] = nullptr;
+            drawnFor = guestRow;
+        }
+        bool dark = y % options.scale >= options.scale - darkRows;
+        uint8_t *target = pixels.data() + y * pitch;
+        if (drawnRows[dark])
+        {
+            memcpy(target, drawnRows[dark], rowBytes);
+        }
+        else
+        {
+            DrawRow(guestRow, dark, target);
+            drawnRows[dark] = target;
+        }
+    }
+}
+
+void PostProcessor::DrawRow(unsigned int guestRow, bool dark, uint8_t *target) const
+{
+    const uint8_t *row = (dark ? darkLevels : levels) + guestRow * VIDEO_WIDTH;
+    if (format == POST_RGBA)
+    {
+        pixelKernels->scaleRowRgba(row, palette, options.scale, reinterpret_cast<uint32_t *>(target));
+    }
+    else
+    {
+        pixelKernels->scaleRowLuma(row, options.scale, target);
+    }
+}
@@ -0,0 +1,217 @@
+#include "Profiler.hpp"
+
+#ifdef CHIP8_PROFILE
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+#include <vector>
+
+Profiler profiler;
+
+static const char *familyNames[FAMILY_COUNT] = {
+    "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk", "8xy0", "8xy1", "8xy2",
+    "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E",
+    "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33", "Fx55", "Fx65", "unknown"};
+
+Profiler::~Profiler()
+{
+    const char *filename = std::getenv("CHIP8_PROFILE_OUT");
+    filename = filename ? filename : "chip8-profile.txt";
+    if (!std::accumulate(familyCount, familyCount + FAMILY_COUNT, uint64_t{0}))
+    {
+        return;
+    }
+    std::string folded = filename;
+    if (folded.size() > 4 && folded.compare(folded.size() - 4, 4, ".txt") == 0)
+    {
+        folded.resize(folded.size() - 4);
+    }
+    folded += ".folded";
+    if (!Write(filename) || !WriteFolded(folded.c_str()))
+    {
+        fprintf(stderr, "Could not write profile %s\n", filename);
+    }
+}
+
+void Profiler::StackChanged(const uint8_t *memory, const uint16_t *stack, uint8_t sp)
+{
+    // Rebuilt from the guest's own return addresses: the 2nnn before each one names the callee
+    uint32_t node = 0;
+    for (unsigned int level = 0; level < sp && level < STACK_LEVELS; ++level)
+    {
+        uint16_t call = static_cast<uint16_t>(stack[level] - 2u) & 0xFFFu;
+        uint16_t instruction = (memory[call] << 8u) | memory[(call + 1u) & 0xFFFu];
+        node = Child(node, (instruction & 0xF000u) == 0x2000u ? instruction & 0x0FFFu : call);
+    }
+    currentStack = node;
+    stackDepth = sp;
+}
+
+uint32_t Profiler::Child(uint32_t parent, uint16_t address)
+{
+    for (uint32_t child : stacks[parent].children)
+    {
+        if (stacks[child].address == address)
+        {
+            return child;
+        }
+    }
+    if (stacks.size() >= PROFILE_MAX_STACKS)
+    {
+        return parent;
+    }
+    uint32_t child = static_cast<uint32_t>(stacks.size());
+    stacks.push_back(StackNode{address, parent, 0, {}});
+    stacks[parent].children.push_back(child);
+    return child;
+}
+
+// Mirrors the decoding in Chip8's dispatch tables, so unusual encodings land where they actually execute
+int Profiler::Family(uint16_t opcode)
+{
+    switch (opcode >> 12u)
+    {
+    case 0x0:
+        return (opcode & 0xFu) == 0x0 ? FAMILY_00E0 : (opcode & 0xFu) == 0xE ? FAMILY_00EE : FAMILY_NULL;
+    case 0x1: return FAMILY_1nnn;
+    case 0x2: return FAMILY_2nnn;
+    case 0x3: return FAMILY_3xkk;
+    case 0x4: return FAMILY_4xkk;
+    case 0x5: return FAMILY_5xy0;
+    case 0x6: return FAMILY_6xkk;
+    case 0x7: return FAMILY_7xkk;
+    case 0x8:
+        switch (opcode & 0xFu)
+        {
+        case 0x0: return FAMILY_8xy0;
+        case 0x1: return FAMILY_8xy1;
+        case 0x2: return FAMILY_8xy2;
+        case 0x3: return FAMILY_8xy3;
+        case 0x4: return FAMILY_8xy4;
+        case 0x5: return FAMILY_8xy5;
+        case 0x6: return FAMILY_8xy6;
+        case 0x7: return FAMILY_8xy7;
+        case 0xE: return FAMILY_8xyE;
+        }
+        return FAMILY_NULL;
+    case 0x9: return FAMILY_9xy0;
+    case 0xA: return FAMILY_Annn;
+    case 0xB: return FAMILY_Bnnn;
+    case 0xC: return FAMILY_Cxkk;
+    case 0xD: return FAMILY_Dxyn;
+    case 0xE:
+        return (opcode & 0xFu) == 0xE ? FAMILY_Ex9E : (opcode & 0xFu) == 0x1 ? FAMILY_ExA1 : FAMILY_NULL;
+    }
+    switch (opcode & 0xFFu)
+    {
+    case 0x07: return FAMILY_Fx07;
+    case 0x0A: return FAMILY_Fx0A;
+    case 0x15: return FAMILY_Fx15;
+    case 0x18: return FAMILY_Fx18;
+    case 0x1E: return FAMILY_Fx1E;
+    case 0x29: return FAMILY_Fx29;
+    case 0x33: return FAMILY_Fx33;
+    case 0x55: return FAMILY_Fx55;
+    case 0x65: return FAMILY_Fx65;
+    }
+    return FAMILY_NULL;
+}
+
+const char *Profiler::FamilyName(int family)
+{
+    return family >= 0 && family < FAMILY_COUNT ? familyNames[family] : "?";
+}
+
+bool Profiler::Write(const char *filename)
+{
+    EndBlock();
+    nextPC = MEMORY_SIZE;
+
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        return false;
+    }
+    uint64_t total = std::accumulate(familyCount, familyCount + FAMILY_COUNT, uint64_t{0});
+    uint64_t totalSamples = std::accumulate(samples, samples + FAMILY_COUNT, uint64_t{0});
+    auto share = [total](uint64_t count) { return total ? 100.0 * count / total : 0.0; };
+    fprintf(file, "# %llu instructions executed, %llu handler calls timed (1 in %u)\n",
+            static_cast<unsigned long long>(total), static_cast<unsigned long long>(totalSamples),
+            PROFILE_SAMPLE_INTERVAL);
+
+    std::vector<int> families(FAMILY_COUNT);
+    std::iota(families.begin(), families.end(), 0);
+    std::sort(families.begin(), families.end(), [this](int a, int b) { return familyCount[a] > familyCount[b]; });
+    fprintf(file, "\n## Opcode mix\n%-8s %14s %7s %10s\n", "family", "count", "share", "ns/call");
+    for (int family : families)
+    {
+        if (!familyCount[family])
+        {
+            break;
+        }
+        fprintf(file, "%-8s %14llu %6.2f%% %10.1f\n", familyNames[family],
+                static_cast<unsigned long long>(familyCount[family]), share(familyCount[family]),
+                samples[family] ? static_cast<double>(sampledNs[family]) / samples[family] : 0.0);
+    }
+
+    std::vector<uint16_t> addresses(MEMORY_SIZE);
+    std::iota(addresses.begin(), addresses.end(), 0);
+    std::sort(addresses.begin(), addresses.end(), [this](uint16_t a, uint16_t b) { return pcCount[a] > pcCount[b]; });
+    fprintf(file, "\n## Hottest addresses\n%-6s %-6s %-8s %14s %7s\n", "addr", "opcode", "family", "count", "share");
+    for (unsigned int i = 0; i < PROFILE_TOP && pcCount[addresses[i]]; ++i)
+    {
+        uint16_t pc = addresses[i];
+        fprintf(file, "%03X    %04X   %-8s %14llu %6.2f%%\n", pc, pcOpcode[pc], familyNames[Family(pcOpcode[pc])],
+                static_cast<unsigned long long>(pcCount[pc]), share(pcCount[pc]));
+    }
+
+    // Ranked by instructions executed inside the block, the natural unit for predecoding or compiling
+    std::vector<uint16_t> blocks(MEMORY_SIZE);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::sort(blocks.begin(), blocks.end(),
+              [this](uint16_t a, uint16_t b) { return blockInstructions[a] > blockInstructions[b]; });
+    fprintf(file, "\n## Hottest basic blocks\n%-9s %12s %14s %7s %s\n", "range", "entries", "instructions", "share",
+            "exit");
+    for (unsigned int i = 0; i < PROFILE_TOP && blockInstructions[blocks[i]]; ++i)
+    {
+        uint16_t start = blocks[i];
+        uint16_t end = blockEnd[start];
+        fprintf(file, "%03X-%03X   %12llu %14llu %6.2f%% %04X %s\n", start, end,
+                static_cast<unsigned long long>(blockEntries[start]),
+                static_cast<unsigned long long>(blockInstructions[start]), share(blockInstructions[start]),
+                pcOpcode[end], familyNames[Family(pcOpcode[end])]);
+    }
+    fclose(file);
+    return true;
+}
+
+bool Profiler::WriteFolded(const char *filename) const
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        return false;
+    }
+    for (uint32_t node = 0; node < stacks.size(); ++node)
+    {
+        if (!stacks[node].count)
+        {
+            continue;
+        }
+        std::string line;
+        for (uint32_t frame = node; frame != 0; frame = stacks[frame].parent)
+        {
+            char name[16];
+            snprintf(name, sizeof(name), ";sub_%03X", stacks[frame].address);
+            line.insert(0, name);
+        }
+        fprintf(file, "main%s %llu\n", line.c_str(), static_cast<unsigned long long>(stacks[node].count));
+    }
+    fclose(file);
+    return true;
+}
+
+#endif // CHIP8_PROFILE
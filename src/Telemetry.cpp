@@ -0,0 +1,155 @@
+#include "Telemetry.hpp"
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t ProcessCpuNs()
+{
+#ifdef _WIN32
+    FILETIME creation, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user))
+    {
+        return 0;
+    }
+    // FILETIMEs count 100 ns units
+    uint64_t kernelTicks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    uint64_t userTicks = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return (kernelTicks + userTicks) * 100;
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+void Telemetry::Presented(uint64_t nowNs)
+{
+    if (lastPresentNs)
+    {
+        frameTimes.Add(nowNs - lastPresentNs);
+    }
+    lastPresentNs = nowNs;
+    presentedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::Tick(uint64_t nowNs)
+{
+    if (!intervalStartNs)
+    {
+        intervalStartNs = nowNs;
+        intervalCpuNs = ProcessCpuNs();
+        return;
+    }
+    if (nowNs - intervalStartNs < TELEMETRY_INTERVAL_NS)
+    {
+        return;
+    }
+    double seconds = (nowNs - intervalStartNs) / 1e9;
+    uint64_t cpuNs = ProcessCpuNs();
+    uint64_t totalInstructions = instructions.load(std::memory_order_relaxed);
+    uint64_t totalEmulated = emulatedFrames.load(std::memory_order_relaxed);
+    uint64_t totalPresented = presentedFrames.load(std::memory_order_relaxed);
+
+    snapshot.instructionsPerSecond = (totalInstructions - intervalInstructions) / seconds;
+    snapshot.emulatedFps = (totalEmulated - intervalEmulated) / seconds;
+    snapshot.hostFps = (totalPresented - intervalPresented) / seconds;
+    snapshot.realtimeRatio = snapshot.emulatedFps / 60.0; // a CHIP-8 frame is 1/60 s of guest time
+    snapshot.frameP50Ms = frameTimes.Percentile(50);
+    snapshot.frameP99Ms = frameTimes.Percentile(99);
+    snapshot.frameMaxMs = frameTimes.getMaxMs();
+    snapshot.cpuPercent = 100.0 * (cpuNs - intervalCpuNs) / 1e9 / seconds;
+    snapshot.cpuSeconds = cpuNs / 1e9;
+    snapshot.instructions = totalInstructions;
+    snapshot.emulatedFrames = totalEmulated;
+    snapshot.presentedFrames = totalPresented;
+    snapshot.uploadsSkipped = uploadsSkipped.load(std::memory_order_relaxed);
+    snapshot.behindMs = behindUs.load(std::memory_order_relaxed) / 1000.0;
+
+    frameTimes = LatencyHistogram();
+    intervalStartNs = nowNs;
+    intervalCpuNs = cpuNs;
+    intervalInstructions = totalInstructions;
+    intervalEmulated = totalEmulated;
+    intervalPresented = totalPresented;
+
+    if (!metricsFile.empty() && !WriteMetrics())
+    {
+        fprintf(stderr, "Could not write metrics %s\n", metricsFile.c_str());
+        metricsFile.clear();
+    }
+}
+
+const TelemetrySnapshot &Telemetry::getSnapshot() const
+{
+    return snapshot;
+}
+
+void Telemetry::setMetricsFile(const char *filename)
+{
+    metricsFile = filename;
+}
+
+void Telemetry::setStartup(double firstInstructionMs, double firstFrameMs)
+{
+    startupInstructionMs = firstInstructionMs;
+    startupFrameMs = firstFrameMs;
+}
+
+bool Telemetry::WriteMetrics() const
+{
+    // Written beside the target and renamed over it so a scraper never reads half a file
+    std::string temporary = metricsFile + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+    auto metric = [file](const char *name, const char *type, const char *help, double value) {
+        fprintf(file, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+    };
+    metric("chip8_instructions_total", "counter", "Guest instructions executed.",
+           static_cast<double>(snapshot.instructions));
+    metric("chip8_instructions_per_second", "gauge", "Guest instructions executed per second.",
+           snapshot.instructionsPerSecond);
+    metric("chip8_emulated_frames_total", "counter", "Emulated 60 Hz frames.",
+           static_cast<double>(snapshot.emulatedFrames));
+    metric("chip8_emulated_fps", "gauge", "Emulated frames per second.", snapshot.emulatedFps);
+    metric("chip8_presented_frames_total", "counter", "Frames presented to the window.",
+           static_cast<double>(snapshot.presentedFrames));
+    metric("chip8_host_fps", "gauge", "Frames presented per second.", snapshot.hostFps);
+    metric("chip8_realtime_ratio", "gauge", "Emulated time per wall-clock time; below 1 the session is behind.",
+           snapshot.realtimeRatio);
+    metric("chip8_behind_seconds_total", "counter", "Emulated time dropped because the host could not catch up.",
+           snapshot.behindMs / 1000.0);
+    metric("chip8_texture_uploads_skipped_total", "counter", "Presents that reused the previous texture.",
+           static_cast<double>(snapshot.uploadsSkipped));
+    metric("chip8_cpu_seconds_total", "counter", "Process CPU time.", snapshot.cpuSeconds);
+    metric("chip8_cpu_usage_ratio", "gauge", "Process CPU time per wall-clock time over the last second.",
+           snapshot.cpuPercent / 100.0);
+    if (startupFrameMs > 0.0)
+    {
+        metric("chip8_startup_first_instruction_seconds", "gauge", "Time from launch to the first guest instruction.",
+               startupInstructionMs / 1000.0);
+        metric("chip8_startup_first_frame_seconds", "gauge", "Time from launch to the first presented frame.",
+               startupFrameMs / 1000.0);
+    }
+    fprintf(file, "# HELP chip8_frame_time_seconds Host time between presents over the last second.\n"
+                  "# TYPE chip8_frame_time_seconds summary\n");
+    fprintf(file, "chip8_frame_time_seconds{quantile=\"0.5\"} %.6f\n", snapshot.frameP50Ms / 1000.0);
+    fprintf(file, "chip8_frame_time_seconds{quantile=\"0.99\"} %.6f\n", snapshot.frameP99Ms / 1000.0);
+    fprintf(file, "chip8_frame_time_seconds{quantile=\"1\"} %.6f\n", snapshot.frameMaxMs / 1000.0);
+    if (fclose(file) != 0)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    std::remove(metricsFile.c_str()); // rename does not replace an existing file on Windows
+#endif
+    return std::rename(temporary.c_str(), metricsFile.c_str()) == 0;
+}
@@ -0,0 +1,223 @@
+#include "Terminal.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <conio.h>
+#include <io.h>
+#include <windows.h>
+#define IS_TERMINAL(file) _isatty(_fileno(file))
+#else
+#include <termios.h>
+#include <unistd.h>
+#define IS_TERMINAL(file) isatty(fileno(file))
+#endif
+
+// Cell glyphs indexed by (top pixel << 1 | bottom pixel): space, lower half, upper half, full block
+static const char *const glyphs[4] = {" ", "\xE2\x96\x84", "\xE2\x96\x80", "\xE2\x96\x88"};
+
+// Rewriting up to this many unchanged cells is shorter than an escape sequence moving past them
+const unsigned int MAX_CELLS_REWRITTEN = 2;
+
+#ifdef _WIN32
+static DWORD savedInputMode, savedOutputMode;
+static UINT savedCodePage;
+#else
+static termios savedMode;
+#endif
+
+// CHIP-8 keypad   PC keyboard
+// 1 2 3 C         1 2 3 4
+// 4 5 6 D         Q W E R
+// 7 8 9 E         A S D F
+// A 0 B F         Z X C V
+static int KeypadIndex(char key)
+{
+    static const char layout[] = "x123qweasdzc4rfv";
+    const char *found = key > 0 ? strchr(layout, std::tolower(key)) : nullptr;
+    return found ? static_cast<int>(found - layout) : -1;
+}
+
+Terminal::~Terminal()
+{
+    Close();
+}
+
+bool Terminal::Open(const char *title)
+{
+    if (!IS_TERMINAL(stdin) || !IS_TERMINAL(stdout))
+    {
+        return false;
+    }
+#ifdef _WIN32
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE), output = GetStdHandle(STD_OUTPUT_HANDLE);
+    GetConsoleMode(input, &savedInputMode);
+    GetConsoleMode(output, &savedOutputMode);
+    savedCodePage = GetConsoleOutputCP();
+    SetConsoleMode(input, savedInputMode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_PROCESSED_INPUT));
+    SetConsoleMode(output, savedOutputMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    SetConsoleOutputCP(CP_UTF8);
+#else
+    if (tcgetattr(STDIN_FILENO, &savedMode) != 0)
+    {
+        return false;
+    }
+    // No line buffering, echo or signal keys, and reads that return at once even when nothing was typed
+    termios raw = savedMode;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+#endif
+    open = true;
+    drawn = false;
+    // Alternate screen, hidden cursor, and the title under the display
+    out = "\x1b[?1049h\x1b[?25l\x1b[2J";
+    MoveTo(TERMINAL_ROWS, 0);
+    out += title;
+    out += "  (Esc quits)";
+    Flush();
+    return true;
+}
+
+void Terminal::Close()
+{
+    if (!open)
+    {
+        return;
+    }
+    out = "\x1b[?25h\x1b[?1049l";
+    Flush();
+#ifdef _WIN32
+    SetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), savedInputMode);
+    SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), savedOutputMode);
+    SetConsoleOutputCP(savedCodePage);
+#else
+    tcsetattr(STDIN_FILENO, TCSANOW, &savedMode);
+#endif
+    open = false;
+}
+
+bool Terminal::ProcessInput(uint8_t *keys)
+{
+    bool quit = false;
+    char input[64];
+    int size = 0;
+#ifdef _WIN32
+    while (size < static_cast<int>(sizeof(input)) && _kbhit())
+    {
+        int key = _getch();
+        if (key == 0 || key == 0xE0)
+        {
+            _getch(); // second half of a function or arrow key
+            continue;
+        }
+        input[size++] = static_cast<char>(key);
+    }
+#else
+    size = static_cast<int>(read(STDIN_FILENO, input, sizeof(input)));
+#endif
+    for (int i = 0; i < size; ++i)
+    {
+        if (input[i] == 0x03)
+        {
+            quit = true;
+        }
+        else if (input[i] == 0x1B)
+        {
+            // A lone Esc quits; Esc [ or Esc O starts the sequence an arrow or function key sends
+            if (i + 1 == size || (input[i + 1] != '[' && input[i + 1] != 'O'))
+            {
+                quit = true;
+                continue;
+            }
+            for (i += 2; i < size && !(input[i] >= 0x40 && input[i] <= 0x7E); ++i)
+            {
+            }
+        }
+        else
+        {
+            int pad = KeypadIndex(input[i]);
+            if (pad >= 0)
+            {
+                held[pad] = TERMINAL_KEY_HOLD_FRAMES;
+            }
+        }
+    }
+    for (unsigned int key = 0; key < 16; ++key)
+    {
+        keys[key] = held[key] ? 1 : 0;
+        if (held[key])
+        {
+            --held[key];
+        }
+    }
+    return quit;
+}
+
+void Terminal::Update(const uint64_t *video)
+{
+    out.clear();
+    for (unsigned int row = 0; row < TERMINAL_ROWS; ++row)
+    {
+        const uint64_t *pair = video + row * 2;
+        uint64_t changed = drawn ? (pair[0] ^ shown[row * 2]) | (pair[1] ^ shown[row * 2 + 1]) : ~0ull;
+        int cursor = -1; // column the cursor is on after the last cell written in this row
+        while (changed)
+        {
+            unsigned int x = static_cast<unsigned int>(__builtin_clzll(changed)); // most significant bit is x = 0
+            changed &= ~0ull >> x >> 1;
+            if (cursor < 0 || x - static_cast<unsigned int>(cursor) > MAX_CELLS_REWRITTEN)
+            {
+                MoveTo(row, x);
+            }
+            else
+            {
+                for (unsigned int column = static_cast<unsigned int>(cursor); column < x; ++column)
+                {
+                    Cell(video, row, column);
+                }
+            }
+            Cell(video, row, x);
+            cursor = static_cast<int>(x + 1);
+        }
+    }
+    memcpy(shown, video, sizeof(shown));
+    drawn = true;
+    frames++;
+    if (!out.empty())
+    {
+        Flush();
+    }
+}
+
+uint64_t Terminal::getFrames() const
+{
+    return frames;
+}
+
+uint64_t Terminal::getBytes() const
+{
+    return bytes;
+}
+
+void Terminal::MoveTo(unsigned int row, unsigned int column)
+{
+    char sequence[16];
+    int size = snprintf(sequence, sizeof(sequence), "\x1b[%u;%uH", row + 1, column + 1);
+    out.append(sequence, size);
+}
+
+void Terminal::Cell(const uint64_t *video, unsigned int row, unsigned int column)
+{
+    unsigned int shift = VIDEO_WIDTH - 1 - column;
+    out += glyphs[((video[row * 2] >> shift) & 1u) << 1 | ((video[row * 2 + 1] >> shift) & 1u)];
+}
+
+void Terminal::Flush()
+{
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    bytes += out.size();
+}
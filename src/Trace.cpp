@@ -0,0 +1,116 @@
+#include "Trace.hpp"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled{false};
+
+// Written only by its owning thread; count is published with release so Write sees whole events
+struct TraceBuffer
+{
+    uint32_t tid;
+    const char *threadName = nullptr;
+    std::atomic<size_t> count{0};
+    size_t dropped = 0;
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[TRACE_BUFFER_EVENTS]};
+};
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers; // kept after their threads exit so Write can still read them
+static uint64_t traceStartNs = 0;
+static thread_local TraceBuffer *threadBuffer = nullptr;
+
+static TraceBuffer *ThreadBuffer()
+{
+    if (!threadBuffer)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.emplace_back(new TraceBuffer);
+        threadBuffer = buffers.back().get();
+        threadBuffer->tid = static_cast<uint32_t>(buffers.size());
+    }
+    return threadBuffer;
+}
+
+// Names are identifiers and literals from this codebase, but escape anyway so the file always parses
+static void WriteString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; ++text)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            fputc('\\', file);
+        }
+        fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+void Trace::Start()
+{
+    traceStartNs = Now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::SetThreadName(const char *name)
+{
+    ThreadBuffer()->threadName = name;
+}
+
+void Trace::Record(const char *name, uint64_t startNs, uint64_t endNs)
+{
+    TraceBuffer *buffer = ThreadBuffer();
+    size_t count = buffer->count.load(std::memory_order_relaxed);
+    if (count >= TRACE_BUFFER_EVENTS)
+    {
+        buffer->dropped++;
+        return;
+    }
+    buffer->events[count] = TraceEvent{name, startNs, endNs};
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::Write(const char *filename)
+{
+    enabled.store(false, std::memory_order_relaxed);
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (const std::unique_ptr<TraceBuffer> &buffer : buffers)
+    {
+        if (buffer->threadName)
+        {
+            fprintf(file, "%s{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"name\": \"thread_name\", \"args\": {\"name\": ",
+                    first ? "" : ",\n", buffer->tid);
+            WriteString(file, buffer->threadName);
+            fprintf(file, "}}");
+            first = false;
+        }
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Complete ("X") events in microseconds, relative to Start
+            const TraceEvent &event = buffer->events[i];
+            fprintf(file, "%s{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"name\": ",
+                    first ? "" : ",\n", buffer->tid, (event.startNs - traceStartNs) / 1e3,
+                    (event.endNs - event.startNs) / 1e3);
+            WriteString(file, event.name);
+            fputc('}', file);
+            first = false;
+        }
+        if (buffer->dropped)
+        {
+            fprintf(stderr, "Trace buffer for thread %u was full, %zu events dropped\n", buffer->tid, buffer->dropped);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,12 @@
+#include "Video.hpp"
+#include "PixelKernels.hpp"
+
+void ExpandVideo(const uint64_t *rows, uint32_t *pixels)
+{
+    pixelKernels->expandVideo(rows, pixels);
+}
+
+void ScaleVideoLuma(const uint64_t *rows, unsigned int scale, uint8_t *luma)
+{
+    pixelKernels->scaleVideoLuma(rows, scale, luma);
+}
@@ -0,0 +1,246 @@
+#include "VideoWall.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const size_t TILE_BYTES = VIDEO_HEIGHT * sizeof(uint64_t);
+
+// Pixels for every value of 8 bits, so a row is eight table reads instead of 64 bit tests
+struct ExpandTables
+{
+    uint64_t luma[256];
+    uint32_t rgba[256][8];
+
+    ExpandTables()
+    {
+        for (unsigned int bits = 0; bits < 256; ++bits)
+        {
+            uint8_t bytes[8];
+            for (unsigned int x = 0; x < 8; ++x)
+            {
+                bool on = (bits >> (7 - x)) & 1u;
+                bytes[x] = on ? LUMA_ON : LUMA_OFF;
+                rgba[bits][x] = on ? PIXEL_ON : PIXEL_OFF;
+            }
+            memcpy(&luma[bits], bytes, sizeof(bytes));
+        }
+    }
+};
+static const ExpandTables tables;
+
+static void ExpandRows(const uint64_t *rows, uint8_t *target, size_t pitch, WallFormat format)
+{
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y, target += pitch)
+    {
+        uint64_t row = rows[y];
+        for (unsigned int byte = 0; byte < VIDEO_WIDTH / 8; ++byte)
+        {
+            unsigned int bits = static_cast<unsigned int>(row >> (VIDEO_WIDTH - 8 - 8 * byte)) & 0xFF;
+            if (format == WALL_RGBA)
+            {
+                memcpy(target + byte * sizeof(tables.rgba[0]), tables.rgba[bits], sizeof(tables.rgba[0]));
+            }
+            else
+            {
+                memcpy(target + byte * sizeof(tables.luma[0]), &tables.luma[bits], sizeof(tables.luma[0]));
+            }
+        }
+    }
+}
+
+VideoWall::~VideoWall()
+{
+    Close();
+}
+
+bool VideoWall::Open(unsigned int count, WallFormat pixelFormat, unsigned int threads)
+{
+    Close();
+    if (count == 0 || count > WALL_MAX_INSTANCES)
+    {
+        return false;
+    }
+    instances = count;
+    format = pixelFormat;
+    columns = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    unsigned int rows = (count + columns - 1) / columns;
+    width = columns * (VIDEO_WIDTH + WALL_GAP) - WALL_GAP;
+    height = rows * (VIDEO_HEIGHT + WALL_GAP) - WALL_GAP;
+    size_t bytesPerPixel = format == WALL_RGBA ? sizeof(uint32_t) : 1;
+    pitch = width * bytesPerPixel;
+    pixels.resize(pitch * height);
+    if (format == WALL_RGBA)
+    {
+        std::fill_n(reinterpret_cast<uint32_t *>(pixels.data()), static_cast<size_t>(width) * height, PIXEL_GAP);
+    }
+    else
+    {
+        std::fill(pixels.begin(), pixels.end(), LUMA_GAP);
+    }
+    shown.assign(static_cast<size_t>(count) * VIDEO_HEIGHT, 0);
+    drawn = false;
+    dirtyTop = dirtyRows = 0;
+    tilesDrawn = tilesSkipped = 0;
+
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, count);
+    stopping = false;
+    batch = 0;
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(&VideoWall::WorkerLoop, this);
+    }
+    return true;
+}
+
+void VideoWall::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    pixels.clear();
+    shown.clear();
+    instances = 0;
+}
+
+void VideoWall::Compose(const uint64_t *const *videos)
+{
+    changed.clear();
+    unsigned int top = height, bottom = 0;
+    for (unsigned int tile = 0; tile < instances; ++tile)
+    {
+        uint64_t *last = shown.data() + static_cast<size_t>(tile) * VIDEO_HEIGHT;
+        if (drawn && memcmp(last, videos[tile], TILE_BYTES) == 0)
+        {
+            continue;
+        }
+        memcpy(last, videos[tile], TILE_BYTES);
+        changed.push_back(tile);
+        unsigned int y = tile / columns * (VIDEO_HEIGHT + WALL_GAP);
+        top = std::min(top, y);
+        bottom = std::max(bottom, y + VIDEO_HEIGHT);
+    }
+    drawn = true;
+    dirtyTop = changed.empty() ? 0 : top;
+    dirtyRows = changed.empty() ? 0 : bottom - top;
+    tilesDrawn += changed.size();
+    tilesSkipped += instances - changed.size();
+
+    nextTile = 0;
+    // Waking the workers costs more than expanding a handful of tiles here
+    if (changed.size() < WALL_INLINE_TILES || workers.empty())
+    {
+        ExpandTiles();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy = static_cast<unsigned int>(workers.size());
+        batch++;
+    }
+    wake.notify_all();
+    ExpandTiles();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+}
+
+const uint8_t *VideoWall::getPixels() const
+{
+    return pixels.data();
+}
+
+size_t VideoWall::getPitch() const
+{
+    return pitch;
+}
+
+unsigned int VideoWall::getWidth() const
+{
+    return width;
+}
+
+unsigned int VideoWall::getHeight() const
+{
+    return height;
+}
+
+WallFormat VideoWall::getFormat() const
+{
+    return format;
+}
+
+unsigned int VideoWall::getDirtyTop() const
+{
+    return dirtyTop;
+}
+
+unsigned int VideoWall::getDirtyRows() const
+{
+    return dirtyRows;
+}
+
+uint64_t VideoWall::getTilesDrawn() const
+{
+    return tilesDrawn;
+}
+
+uint64_t VideoWall::getTilesSkipped() const
+{
+    return tilesSkipped;
+}
+
+unsigned int VideoWall::getThreads() const
+{
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void VideoWall::WorkerLoop()
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || batch != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = batch;
+        }
+        ExpandTiles();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+        {
+            done.notify_one();
+        }
+    }
+}
+
+void VideoWall::ExpandTiles()
+{
+    for (size_t next = nextTile++; next < changed.size(); next = nextTile++)
+    {
+        ExpandTile(changed[next]);
+    }
+}
+
+void VideoWall::ExpandTile(unsigned int tile)
+{
+    const uint64_t *rows = shown.data() + static_cast<size_t>(tile) * VIDEO_HEIGHT;
+    size_t x = tile % columns * (VIDEO_WIDTH + WALL_GAP);
+    size_t y = tile / columns * (VIDEO_HEIGHT + WALL_GAP);
+    size_t bytesPerPixel = format == WALL_RGBA ? sizeof(uint32_t) : 1;
+    ExpandRows(rows, pixels.data() + y * pitch + x * bytesPerPixel, pitch, format);
+}
@@ -0,0 +1,26 @@
+#include "Watchdog.hpp"
+#include "PixelKernels.hpp"
+
+void Watchdog::setStallFrames(uint32_t frames)
+{
+    stallFrames = frames;
+    unchangedFrames = 0;
+}
+
+GuestFault Watchdog::Frame(const Chip8 &chip8)
+{
+    if (!stallFrames)
+    {
+        return FAULT_NONE;
+    }
+    // Compares whole frames, so a sprite drawn and erased within one frame does not count as progress
+    uint64_t hash = HashFrame(chip8.video);
+    unchangedFrames = hash == lastVideoHash ? unchangedFrames + 1 : 0;
+    lastVideoHash = hash;
+    return unchangedFrames >= stallFrames ? FAULT_STALLED : FAULT_NONE;
+}
+
+uint32_t Watchdog::getUnchangedFrames() const
+{
+    return unchangedFrames;
+}
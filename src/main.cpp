@@ -4,5 +4,5 @@
 int main(int argc, char** argv)
 {
     Emulator chip8;
-    chip8.emulate(argc, argv);
+    return chip8.emulate(argc, argv);
 }
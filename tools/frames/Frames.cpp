@@ -0,0 +1,75 @@
+#include "FrameStream.hpp"
+#include "Png.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// chip8-frames <file.c8fs> [--png <frame> <out.png>] [--scale <n>]
+// Summarises a frame stream (chip8 --frame-stream) and writes any frame of it as a PNG still.
+
+const unsigned int DEFAULT_SCALE = 4;
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <file.c8fs> [--png <frame> <out.png>] [--scale <n>]\n", argv[0]);
+        return 2;
+    }
+    long pngFrame = -1;
+    const char *pngFilename = nullptr;
+    unsigned int scale = DEFAULT_SCALE;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--png") == 0 && i + 2 < argc)
+        {
+            pngFrame = strtol(argv[++i], nullptr, 10);
+            pngFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            scale = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    FrameStreamReader stream;
+    if (!stream.Open(argv[1]))
+    {
+        fprintf(stderr, "Could not read frame stream %s\n", argv[1]);
+        return 2;
+    }
+    uint32_t frames = stream.getFrameCount();
+    printf("%u frames (%.1f s), keyframe every %u, ROM hash %016llX\n", frames, frames / 60.0,
+           stream.getKeyframeInterval(), static_cast<unsigned long long>(stream.getRomHash()));
+    printf("%llu bytes, %.2f bytes per frame%s\n", static_cast<unsigned long long>(stream.getBytes()),
+           frames ? static_cast<double>(stream.getBytes()) / frames : 0.0,
+           stream.isRecovered() ? " (not closed; index rebuilt)" : "");
+
+    if (pngFilename)
+    {
+        uint64_t video[VIDEO_HEIGHT];
+        if (pngFrame < 0 || !stream.ReadFrame(static_cast<uint32_t>(pngFrame), video))
+        {
+            fprintf(stderr, "Could not decode frame %ld\n", pngFrame);
+            return 1;
+        }
+        std::vector<uint8_t> luma(VIDEO_WIDTH * scale * VIDEO_HEIGHT * scale), png;
+        ScaleVideoLuma(video, scale, luma.data());
+        EncodePng(luma.data(), VIDEO_WIDTH * scale, VIDEO_HEIGHT * scale, png);
+        FILE *file = fopen(pngFilename, "wb");
+        bool written = file && fwrite(png.data(), 1, png.size(), file) == png.size();
+        if (!file || fclose(file) != 0 || !written)
+        {
+            fprintf(stderr, "Could not write %s\n", pngFilename);
+            return 1;
+        }
+        printf("Frame %ld written to %s\n", pngFrame, pngFilename);
+    }
+    return 0;
+}
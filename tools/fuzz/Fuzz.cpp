@@ -0,0 +1,456 @@
+#include "Chip8.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// chip8-fuzz [--programs <n>] [--workers <n>] [--seed <n>] [--steps <n>] [--compare-every <n>]
+//            [--engine <name>] [--out <dir>] [--rom <file>]
+// Differential fuzzing: generates random and structured programs, runs each on the reference interpreter
+// (Chip8::Cycle, one instruction at a time) and on every alternative engine in lockstep, and compares the
+// full machine state and guest faults every --compare-every instructions. A program that makes an engine
+// diverge is minimized and written to --out as a .ch8 file; --rom with the printed --seed reproduces it.
+
+const uint32_t DEFAULT_PROGRAMS = 10000;
+const uint32_t DEFAULT_STEPS = 10000;        // instructions per program at most
+const uint32_t DEFAULT_COMPARE_EVERY = 64;
+const size_t MAX_PROGRAM_WORDS = 512;
+
+// An execution engine under test; run must execute exactly `steps` instructions
+struct Engine
+{
+    const char *name;
+    const char *description;
+    void (*run)(Chip8 &chip8, uint32_t steps);
+};
+
+static void RunFromSnapshot(Chip8 &chip8, uint32_t steps)
+{
+    Chip8State state{};
+    chip8.SaveState(state);
+    chip8.LoadState(state);
+    chip8.RunFrame(steps);
+}
+
+// Snapshots mid-batch, runs the rest on inverted keys and throws that away, then runs it again for real.
+// Any state LoadState fails to restore, or a fault or flag SpeculativeRun lets through, shows up as a divergence.
+static void RunRewound(Chip8 &chip8, uint32_t steps)
+{
+    uint32_t first = steps / 2;
+    chip8.RunFrame(first);
+    Chip8State state{};
+    chip8.SaveState(state);
+    {
+        SpeculativeRun speculation(chip8);
+        chip8.setKeypadMask(static_cast<uint16_t>(~chip8.getKeypadMask()));
+        chip8.RunFrame(steps - first + 1);
+        chip8.LoadState(state);
+    }
+    chip8.RunFrame(steps - first);
+}
+
+// New engines are added here; the reference is always Chip8::Cycle
+static const Engine engines[] = {
+    {"snapshot", "SaveState/LoadState round trip before every batch (run-ahead, rollback)", RunFromSnapshot},
+    {"rewind", "mid-batch snapshot, a discarded run on other keys, LoadState, then the real run", RunRewound},
+};
+
+struct FuzzOptions
+{
+    uint32_t programs = DEFAULT_PROGRAMS;
+    unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t seed = 1;
+    uint32_t steps = DEFAULT_STEPS;
+    uint32_t compareEvery = DEFAULT_COMPARE_EVERY;
+    std::string engine;
+    std::string out = ".";
+    const char *rom = nullptr;
+};
+
+static FuzzOptions options;
+
+struct Divergence
+{
+    uint64_t step;
+    std::string what;
+};
+
+struct Failure
+{
+    const Engine *engine;
+    uint32_t seed;
+    size_t originalSize;
+    std::vector<uint8_t> program;
+    Divergence divergence;
+};
+
+static bool SameState(Chip8 &reference, Chip8 &tested, std::string &what)
+{
+    Chip8State a{}, b{};
+    reference.SaveState(a);
+    tested.SaveState(b);
+    char text[96];
+    auto differs = [&](const char *name, unsigned int expected, unsigned int actual)
+    {
+        snprintf(text, sizeof(text), "%s is %X, reference has %X", name, actual, expected);
+        what = text;
+        return false;
+    };
+    for (unsigned int i = 0; i < MEMORY_SIZE; ++i)
+    {
+        if (a.memory[i] != b.memory[i])
+        {
+            snprintf(text, sizeof(text), "memory[%03X]", i);
+            return differs(std::string(text).c_str(), a.memory[i], b.memory[i]);
+        }
+    }
+    for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+    {
+        if (a.registers[i] != b.registers[i])
+        {
+            snprintf(text, sizeof(text), "V%X", i);
+            return differs(std::string(text).c_str(), a.registers[i], b.registers[i]);
+        }
+    }
+    for (unsigned int i = 0; i < STACK_LEVELS; ++i)
+    {
+        if (a.stack[i] != b.stack[i])
+        {
+            snprintf(text, sizeof(text), "stack[%u]", i);
+            return differs(std::string(text).c_str(), a.stack[i], b.stack[i]);
+        }
+    }
+    for (unsigned int row = 0; row < VIDEO_HEIGHT; ++row)
+    {
+        if (a.video[row] != b.video[row])
+        {
+            snprintf(text, sizeof(text), "video row %u is %016llX, reference has %016llX", row,
+                     static_cast<unsigned long long>(b.video[row]), static_cast<unsigned long long>(a.video[row]));
+            what = text;
+            return false;
+        }
+    }
+    if (a.index != b.index) return differs("I", a.index, b.index);
+    if (a.PC != b.PC) return differs("PC", a.PC, b.PC);
+    if (a.SP != b.SP) return differs("SP", a.SP, b.SP);
+    if (a.delay_timer != b.delay_timer) return differs("delay timer", a.delay_timer, b.delay_timer);
+    if (a.sound_timer != b.sound_timer) return differs("sound timer", a.sound_timer, b.sound_timer);
+    if (a.rngState != b.rngState) return differs("RNG state", a.rngState, b.rngState);
+    if (memcmp(a.keypad, b.keypad, sizeof(a.keypad)) != 0) return differs("keypad", 0, 0);
+    if (reference.getFault() != tested.getFault()) return differs("fault", reference.getFault(), tested.getFault());
+    if (reference.getFaultPC() != tested.getFaultPC()) return differs("fault PC", reference.getFaultPC(), tested.getFaultPC());
+    // Neither machine clears these, so they accumulate the same way
+    if (reference.videoChanged != tested.videoChanged) return differs("videoChanged", reference.videoChanged, tested.videoChanged);
+    if (reference.keypadPolled != tested.keypadPolled) return differs("keypadPolled", reference.keypadPolled, tested.keypadPolled);
+    if (reference.polledBeforeDraw != tested.polledBeforeDraw)
+        return differs("polledBeforeDraw", reference.polledBeforeDraw, tested.polledBeforeDraw);
+    return true;
+}
+
+// Runs the program on the reference and the engine; false with the first divergence if they disagree.
+// The keypad changes at every comparison point, from a sequence fixed by the seed.
+static bool Matches(const std::vector<uint8_t> &program, uint32_t seed, const Engine &engine, Divergence &divergence,
+                    uint64_t *executed = nullptr)
+{
+    Chip8 reference, tested;
+    reference.LoadProgram(program.data(), program.size());
+    tested.LoadProgram(program.data(), program.size());
+    reference.Seed(seed);
+    tested.Seed(seed);
+    std::mt19937 keys(seed);
+
+    uint64_t step = 0;
+    while (step < options.steps)
+    {
+        uint16_t mask = static_cast<uint16_t>(keys() & keys());
+        reference.setKeypadMask(mask);
+        tested.setKeypadMask(mask);
+
+        uint32_t batch = std::min<uint64_t>(options.compareEvery, options.steps - step);
+        for (uint32_t i = 0; i < batch; ++i)
+        {
+            reference.Cycle();
+        }
+        engine.run(tested, batch);
+        step += batch;
+        if (!SameState(reference, tested, divergence.what))
+        {
+            divergence.step = step;
+            return false;
+        }
+    }
+    if (executed)
+    {
+        *executed = step;
+    }
+    return true;
+}
+
+static void Emit(std::vector<uint8_t> &program, uint16_t opcode)
+{
+    program.push_back(static_cast<uint8_t>(opcode >> 8u));
+    program.push_back(static_cast<uint8_t>(opcode));
+}
+
+// Half the programs are raw random bytes; the rest are valid instructions whose jumps stay inside the
+// program and whose memory operands mostly point at the font, the program or free RAM
+static std::vector<uint8_t> Generate(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    auto below = [&](uint32_t n) { return static_cast<uint16_t>(rng() % n); };
+    size_t words = 8 + below(MAX_PROGRAM_WORDS - 8);
+    std::vector<uint8_t> program;
+    if (rng() & 1u)
+    {
+        for (size_t i = 0; i < words * 2; ++i)
+        {
+            program.push_back(static_cast<uint8_t>(rng()));
+        }
+        return program;
+    }
+
+    static const uint16_t opcodes8[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+    static const uint16_t opcodesF[] = {0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65};
+    for (size_t i = 0; i < words; ++i)
+    {
+        uint16_t x = below(16) << 8u;
+        uint16_t y = below(16) << 4u;
+        uint16_t kk = below(256);
+        uint16_t target = START_ADDRESS + 2 * below(static_cast<uint32_t>(words));
+        uint16_t address = below(4) == 0 ? FONTSET_START_ADDRESS + below(FONTSET_SIZE) : below(MEMORY_SIZE - 16);
+        switch (below(20))
+        {
+        case 0: Emit(program, below(8) ? 0x00E0 : 0x00EE); break;
+        case 1: Emit(program, 0x1000 | target); break;
+        case 2: Emit(program, 0x2000 | target); break;
+        case 3: Emit(program, 0x3000 | x | kk); break;
+        case 4: Emit(program, 0x4000 | x | kk); break;
+        case 5: Emit(program, 0x5000 | x | y); break;
+        case 6:
+        case 7: Emit(program, 0x6000 | x | kk); break;
+        case 8: Emit(program, 0x7000 | x | kk); break;
+        case 9:
+        case 10: Emit(program, 0x8000 | x | y | opcodes8[below(9)]); break;
+        case 11: Emit(program, 0x9000 | x | y); break;
+        case 12: Emit(program, 0xA000 | address); break;
+        case 13: Emit(program, 0xB000 | target); break;
+        case 14: Emit(program, 0xC000 | x | kk); break;
+        case 15:
+        case 16: Emit(program, 0xD000 | x | y | below(16)); break;
+        case 17: Emit(program, (below(2) ? 0xE09E : 0xE0A1) | (below(16) << 8u)); break;
+        default: Emit(program, 0xF000 | x | opcodesF[below(9)]); break;
+        }
+    }
+    return program;
+}
+
+// Delta debugging over instruction words: drops ever smaller runs of words while the engine still diverges,
+// then replaces each remaining word that does not matter with 8000 (V0 = V0) so the culprits stand out
+static std::vector<uint8_t> Minimize(std::vector<uint8_t> program, uint32_t seed, const Engine &engine)
+{
+    Divergence divergence;
+    for (size_t chunk = program.size() / 4 * 2; chunk >= 2; chunk /= 2)
+    {
+        chunk &= ~size_t{1};
+        for (size_t at = 0; at < program.size();)
+        {
+            std::vector<uint8_t> candidate(program.begin(), program.begin() + at);
+            candidate.insert(candidate.end(), program.begin() + std::min(at + chunk, program.size()), program.end());
+            if (!candidate.empty() && !Matches(candidate, seed, engine, divergence))
+            {
+                program.swap(candidate);
+            }
+            else
+            {
+                at += chunk;
+            }
+        }
+    }
+    for (size_t at = 0; at + 1 < program.size(); at += 2)
+    {
+        std::vector<uint8_t> candidate = program;
+        candidate[at] = 0x80;
+        candidate[at + 1] = 0x00;
+        if (candidate != program && !Matches(candidate, seed, engine, divergence))
+        {
+            program.swap(candidate);
+        }
+    }
+    return program;
+}
+
+static bool WriteProgram(const std::string &filename, const std::vector<uint8_t> &program)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool written = fwrite(program.data(), 1, program.size(), file) == program.size();
+    return fclose(file) == 0 && written;
+}
+
+static int ReplayRom(const std::vector<const Engine *> &selected)
+{
+    std::vector<uint8_t> program;
+    FILE *file = fopen(options.rom, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not read %s\n", options.rom);
+        return 2;
+    }
+    for (int c; (c = fgetc(file)) != EOF;)
+    {
+        program.push_back(static_cast<uint8_t>(c));
+    }
+    fclose(file);
+
+    int status = 0;
+    for (const Engine *engine : selected)
+    {
+        Divergence divergence;
+        uint64_t executed = 0;
+        if (Matches(program, options.seed, *engine, divergence, &executed))
+        {
+            printf("%-10s agrees for %llu steps\n", engine->name, static_cast<unsigned long long>(executed));
+        }
+        else
+        {
+            printf("%-10s diverges by step %llu: %s\n", engine->name,
+                   static_cast<unsigned long long>(divergence.step), divergence.what.c_str());
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--programs" && hasValue)
+        {
+            options.programs = std::stoul(argv[++i]);
+        }
+        else if (arg == "--workers" && hasValue)
+        {
+            options.workers = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--seed" && hasValue)
+        {
+            options.seed = std::stoul(argv[++i]);
+        }
+        else if (arg == "--steps" && hasValue)
+        {
+            options.steps = std::stoul(argv[++i]);
+        }
+        else if (arg == "--compare-every" && hasValue)
+        {
+            options.compareEvery = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (arg == "--engine" && hasValue)
+        {
+            options.engine = argv[++i];
+        }
+        else if (arg == "--out" && hasValue)
+        {
+            options.out = argv[++i];
+        }
+        else if (arg == "--rom" && hasValue)
+        {
+            options.rom = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "Usage: %s [--programs <n>] [--workers <n>] [--seed <n>] [--steps <n>] [--compare-every <n>]\n"
+                    "       [--engine <name>] [--out <dir>] [--rom <file>]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<const Engine *> selected;
+    for (const Engine &engine : engines)
+    {
+        if (options.engine.empty() || options.engine == engine.name)
+        {
+            selected.push_back(&engine);
+        }
+    }
+    if (selected.empty())
+    {
+        fprintf(stderr, "Unknown engine %s\n", options.engine.c_str());
+        return 2;
+    }
+    if (options.rom)
+    {
+        return ReplayRom(selected);
+    }
+
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint64_t> instructions{0};
+    std::mutex failuresMutex;
+    std::vector<Failure> failures;
+    auto start = std::chrono::steady_clock::now();
+    auto work = [&]()
+    {
+        for (uint32_t n; (n = next++) < options.programs;)
+        {
+            uint32_t seed = options.seed + n;
+            std::vector<uint8_t> program = Generate(seed);
+            for (const Engine *engine : selected)
+            {
+                Divergence divergence;
+                uint64_t executed = 0;
+                if (Matches(program, seed, *engine, divergence, &executed))
+                {
+                    instructions += executed;
+                    continue;
+                }
+                Failure failure{engine, seed, program.size(), Minimize(program, seed, *engine), {}};
+                Matches(failure.program, seed, *engine, failure.divergence);
+                std::lock_guard<std::mutex> lock(failuresMutex);
+                failures.push_back(failure);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < options.workers; ++i)
+    {
+        workers.emplace_back(work);
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Fuzzed %u programs (seeds %u-%u) on %zu engine(s) with %u workers in %.2f s: %llu instructions, %.1f M/s\n",
+           options.programs, options.seed, options.seed + options.programs - 1, selected.size(), options.workers, seconds,
+           static_cast<unsigned long long>(instructions.load()), instructions.load() / seconds / 1e6);
+    for (const Failure &failure : failures)
+    {
+        std::string filename = options.out + "/fuzz-" + failure.engine->name + "-" + std::to_string(failure.seed) + ".ch8";
+        printf("%s diverges from the reference (seed %u, %zu of %zu bytes after minimizing) by step %llu: %s\n",
+               failure.engine->name, failure.seed, failure.program.size(), failure.originalSize,
+               static_cast<unsigned long long>(failure.divergence.step), failure.divergence.what.c_str());
+        if (WriteProgram(filename, failure.program))
+        {
+            printf("    reproduce: %s --rom %s --seed %u --engine %s\n", argv[0], filename.c_str(), failure.seed,
+                   failure.engine->name);
+        }
+        else
+        {
+            fprintf(stderr, "Could not write %s\n", filename.c_str());
+        }
+    }
+    return failures.empty() ? 0 : 1;
+}
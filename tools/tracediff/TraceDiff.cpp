@@ -0,0 +1,101 @@
+#include "ExecTrace.hpp"
+#include <cstring>
+#include <vector>
+
+// chip8-tracediff <a.trace> <b.trace> [--context <n>]
+// Finds the first step where two execution traces (chip8 --exec-trace) differ. Chunks are compared with
+// memcmp and only the differing chunk is searched record by record, so traces of billions of steps take
+// about as long as reading them.
+
+const size_t CHUNK_RECORDS = 1u << 20;
+const size_t DEFAULT_CONTEXT = 8;
+
+static void PrintRecord(const char *label, uint64_t step, const ExecRecord &record)
+{
+    printf("%-3s %14llu  %03X  %04X  %03X  %02X  %02X\n", label, static_cast<unsigned long long>(step), record.pc,
+           record.opcode, record.index, record.vx, record.vf);
+}
+
+int main(int argc, char **argv)
+{
+    size_t context = DEFAULT_CONTEXT;
+    if (argc == 5 && strcmp(argv[3], "--context") == 0)
+    {
+        context = strtoul(argv[4], nullptr, 10);
+    }
+    else if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <a.trace> <b.trace> [--context <n>]\n", argv[0]);
+        return 2;
+    }
+
+    ExecTraceReader a, b;
+    for (int i = 1; i <= 2; ++i)
+    {
+        if (!(i == 1 ? a : b).Open(argv[i]))
+        {
+            fprintf(stderr, "Could not read execution trace %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (a.getRomHash() != b.getRomHash())
+    {
+        printf("warning: traces were recorded with different ROMs\n");
+    }
+    if (a.getSeed() != b.getSeed())
+    {
+        printf("warning: traces were recorded with different seeds (%u, %u)\n", a.getSeed(), b.getSeed());
+    }
+
+    std::vector<ExecRecord> chunkA(CHUNK_RECORDS), chunkB(CHUNK_RECORDS);
+    std::vector<ExecRecord> history; // the records just before the current chunk, for context
+    uint64_t step = 0;
+    for (;;)
+    {
+        size_t readA = a.Read(chunkA.data(), CHUNK_RECORDS);
+        size_t readB = b.Read(chunkB.data(), CHUNK_RECORDS);
+        size_t common = std::min(readA, readB);
+        if (memcmp(chunkA.data(), chunkB.data(), common * sizeof(ExecRecord)) != 0)
+        {
+            size_t i = 0;
+            while (memcmp(&chunkA[i], &chunkB[i], sizeof(ExecRecord)) == 0)
+            {
+                ++i;
+            }
+            printf("Traces diverge at step %llu\n", static_cast<unsigned long long>(step + i));
+            printf("    %14s  %-3s  %-4s  %-3s  %-2s  %-2s\n", "step", "pc", "op", "I", "Vx", "VF");
+            // Context comes from this chunk, topped up from the end of the previous one
+            size_t fromChunk = std::min(i, context);
+            size_t fromHistory = std::min(history.size(), context - fromChunk);
+            for (size_t h = history.size() - fromHistory; h < history.size(); ++h)
+            {
+                PrintRecord("", step - history.size() + h, history[h]);
+            }
+            for (size_t c = i - fromChunk; c < i; ++c)
+            {
+                PrintRecord("", step + c, chunkA[c]);
+            }
+            PrintRecord("a:", step + i, chunkA[i]);
+            PrintRecord("b:", step + i, chunkB[i]);
+            return 1;
+        }
+        step += common;
+        if (readA != readB || readA == 0)
+        {
+            if (a.isTruncated() || b.isTruncated())
+            {
+                printf("warning: %s is truncated\n", a.isTruncated() ? argv[1] : argv[2]);
+            }
+            if (readA == readB)
+            {
+                printf("Traces are identical (%llu steps)\n", static_cast<unsigned long long>(step));
+                return 0;
+            }
+            printf("Traces agree for %llu steps, then %s ends\n", static_cast<unsigned long long>(step),
+                   readA < readB ? argv[1] : argv[2]);
+            return 1;
+        }
+        size_t keep = std::min(context, common);
+        history.assign(chunkA.begin() + (common - keep), chunkA.begin() + common);
+    }
+}